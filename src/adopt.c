@@ -0,0 +1,243 @@
+/* adopt.c
+ * The adoption of the new subtrees, listed in slices by the event loop
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "cwatch.h"
+
+#include <stdint.h>
+#include <sys/eventfd.h>
+
+/* A directory watched, waiting to be listed */
+typedef struct adoption_s
+{
+    int    wd;           /* found again by its watch descriptor, it could be renamed meanwhile */
+    bool_t report;       /* FALSE for the target of a symbolic link, its entries are not new */
+} ADOPTION;
+
+static LIST *adoptions;             /* the directories waiting to be listed, oldest first */
+static int wakeup_fd = -1;          /* readable while there are directories to list */
+
+/* The directory being listed, across the slices */
+static DIR *listing;
+static ADOPTION current;
+
+static unsigned int listed_c;       /* the directories listed since the queue was empty */
+static unsigned long synthesized_c; /* the events synthesized since the queue was empty */
+
+/* Check if an entry was created before the directory was watched */
+static bool_t created_before(int dir_fd, const char *name, const struct timespec *watched)
+{
+    struct statx stx;
+
+    if (statx(dir_fd, name, AT_SYMLINK_NOFOLLOW, STATX_CTIME | STATX_BTIME, &stx) != 0)
+        return FALSE;
+
+    struct timespec created = statx_created(&stx);
+
+    return (timespec_compare(&created, watched) <= 0) ? TRUE : FALSE;
+}
+
+static void adopt_wakeup()
+{
+    uint64_t value = 1;
+
+    if (write(wakeup_fd, &value, sizeof(value)) == -1) {
+        /* The counter is saturated, it is readable anyway */
+    }
+}
+
+static void adopt_queue(int wd, bool_t report)
+{
+    ADOPTION *adoption = (ADOPTION *) malloc(sizeof(ADOPTION));
+    if (adoption == NULL)
+        return;
+
+    adoption->wd = wd;
+    adoption->report = report;
+
+    if (adoptions->first == NULL && listing == NULL)
+        adopt_wakeup();
+    list_push(adoptions, (void *) adoption);
+}
+
+/* Watch a symbolic link found while listing, and adopt its target */
+static void adopt_link(const char *symlink)
+{
+    if (get_link_data_from_path(symlink) != NULL)
+        return;
+
+    char *real_path = resolve_real_path(symlink);
+    DIR *is_a_dir = (real_path != NULL) ? opendir(real_path) : NULL;
+
+    if (is_a_dir != NULL) {
+        closedir(is_a_dir);
+        adopt(real_path, strdup(symlink));
+    }
+    free(real_path);
+}
+
+/* List the next entries of the directory being listed, returns 1 once it is over */
+static int adopt_list(bstring events, unsigned int *entries)
+{
+    LIST_NODE *node = get_node_from_wd(current.wd);
+    if (node == NULL)
+        return 1;
+
+    WD_DATA *wd_data = (WD_DATA *) node->data;
+    char path[MAXPATHLEN + 1];
+    char child_path[MAXPATHLEN + NAME_MAX + 2];
+    struct dirent *dir;
+
+    get_wd_path(wd_data, path);
+    int dir_fd = dirfd(listing);
+
+    while (*entries < ADOPT_SLICE && (dir = readdir(listing))) {
+        if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0)
+            continue;
+        ++*entries;
+
+        if (dir->d_type == DT_DIR) {
+            /* Discard all filename that matches regular expression (-x option) */
+            if (excluded(dir->d_name) || rule_excludes(wd_data->rule, dir->d_name))
+                continue;
+
+            /* The create event read from the kernel adopted it already */
+            snprintf(child_path, sizeof(child_path), "%s%s/", path, dir->d_name);
+            if (get_node_from_path(child_path) != NULL)
+                continue;
+
+            /* Watched before its create event is handled, that does not adopt it again */
+            LIST_NODE *child = add_to_watch_list(child_path, NULL);
+            if (child != NULL)
+                adopt_queue(((WD_DATA *) child->data)->wd, current.report);
+
+            if (current.report == TRUE && created_before(dir_fd, dir->d_name, &wd_data->synced) == TRUE) {
+                append_event(events, wd_data->wd, IN_CREATE | IN_ISDIR, dir->d_name);
+                ++synthesized_c;
+            }
+        } else if (current.report == TRUE && created_before(dir_fd, dir->d_name, &wd_data->synced) == TRUE) {
+            /* The create handler watches the symbolic links */
+            append_event(events, wd_data->wd, IN_CREATE, dir->d_name);
+            ++synthesized_c;
+        } else if (current.report == FALSE && dir->d_type == DT_LNK && nosymlink_flag == FALSE) {
+            snprintf(child_path, sizeof(child_path), "%s%s", path, dir->d_name);
+            adopt_link(child_path);
+        }
+    }
+
+    return (*entries < ADOPT_SLICE) ? 1 : 0;
+}
+
+/* Handle a slice of the adoptions, the loop calls it again while there are more */
+static void adopt_run(void *arg)
+{
+    uint64_t value;
+    unsigned int entries = 0;
+
+    if (read(wakeup_fd, &value, sizeof(value)) == -1) {
+        /* Not readable, it is checked below */
+    }
+
+    bstring events = bfromcstralloc(4096, "");
+
+    while (entries < ADOPT_SLICE) {
+        if (listing == NULL) {
+            ADOPTION *adoption = (ADOPTION *) list_pop(adoptions);
+            if (adoption == NULL)
+                break;
+
+            current = *adoption;
+            free(adoption);
+
+            /* It could be unwatched meanwhile */
+            char path[MAXPATHLEN + 1];
+            LIST_NODE *node = get_node_from_wd(current.wd);
+            if (node == NULL || (listing = opendir(get_wd_path((WD_DATA *) node->data, path))) == NULL)
+                continue;
+        }
+
+        if (adopt_list(events, &entries) == 1) {
+            closedir(listing);
+            listing = NULL;
+            ++listed_c;
+        }
+
+        /* The events of the entries listed so far */
+        if (blength(events) > 0) {
+            dispatch_events((char *) events->data, blength(events));
+            btrunc(events, 0);
+        }
+    }
+
+    bdestroy(events);
+
+    if (listing != NULL || adoptions->first != NULL) {
+        adopt_wakeup();
+    } else if (listed_c > 0) {
+        log_message("ADOPTION COMPLETED:\t%u directories listed, %lu create events synthesized",
+                    listed_c, synthesized_c);
+        listed_c = 0;
+        synthesized_c = 0;
+    }
+
+    /* Write all the records of this slice at once */
+    end_batch();
+}
+
+int adopt_start()
+{
+    adoptions = list_init();
+
+    wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd == -1)
+        return -1;
+
+    if (loop_add(wakeup_fd, adopt_run, NULL) == NULL) {
+        close(wakeup_fd);
+        wakeup_fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+int adopt(const char *real_path, char *symlink)
+{
+    /* The subdirectories are watched by the backend, or walked at once */
+    if (wakeup_fd == -1 || backend->per_directory == 0 || budget_enabled())
+        return watch(real_path, symlink);
+
+    LIST_NODE *node = get_node_from_path(real_path);
+    bool_t watched = (node != NULL) ? TRUE : FALSE;
+
+    if ((node = add_to_watch_list(real_path, symlink)) == NULL) {
+        free(symlink);
+        return -1;
+    }
+
+    /* Already watched, it was adopted by the listing of its parent */
+    if (watched == FALSE)
+        adopt_queue(((WD_DATA *) node->data)->wd, (symlink == NULL) ? TRUE : FALSE);
+
+    return 0;
+}
@@ -0,0 +1,54 @@
+/* adopt.h
+ * The adoption of the new subtrees, listed in slices by the event loop
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __ADOPT_H
+#define __ADOPT_H
+
+#define ADOPT_SLICE 512    /* the entries listed at each turn of the event loop */
+
+/*
+ * A directory created or moved in while monitoring is adopted in the
+ * background: each directory of the subtree is watched first, and is
+ * listed second. The entries found that way were created before the
+ * directory was watched, their create events are synthesized (the
+ * other ones are read from the kernel). The listing is done ADOPT_SLICE
+ * entries at a time, so that the other events are not delayed.
+ */
+
+/**
+ * Start adopting the subtrees from the event loop (see loop_init),
+ * before it the directories are watched at once (see watch)
+ * @return int : -1 in case of error, 0 otherwise
+ */
+int adopt_start();
+
+/**
+ * Watch a new directory, its subtree is adopted in the background
+ * @param char * : the real path of the directory
+ * @param char * : the symbolic link pointing to it (kept by its link data), NULL otherwise
+ * @return int   : -1 if the directory can not be watched, 0 otherwise
+ */
+int adopt(const char *, char *);
+
+#endif /* !__ADOPT_H */
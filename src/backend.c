@@ -0,0 +1,577 @@
+/* backend.c
+ * The notification backends used to watch the directories
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "cwatch.h"
+
+#include <fcntl.h>
+#include <sys/statfs.h>
+#ifdef HAVE_SYS_FANOTIFY_H
+#include <sys/fanotify.h>
+#endif
+
+size_t put_event(char *buffer, int wd, uint32_t mask, const char *name)
+{
+    struct inotify_event *event = (struct inotify_event *) buffer;
+    size_t name_len = strlen(name);
+
+    /*
+     * The name is NUL padded, as the kernel does, to keep the records aligned.
+     * It is never omitted, so that event->name is always a valid string.
+     */
+    event->wd = wd;
+    event->mask = mask;
+    event->cookie = 0;
+    event->len = (name_len + 1 + 3) & ~((size_t) 3);
+
+    memset(event->name, 0, event->len);
+    memcpy(event->name, name, name_len);
+
+    return EVENT_SIZE + event->len;
+}
+
+void append_event(bstring events, int wd, uint32_t mask, const char *name)
+{
+    balloc(events, events->slen + EVENT_SIZE + strlen(name) + 5);
+    events->slen += put_event((char *) events->data + events->slen, wd, mask, name);
+}
+
+struct timespec statx_time(const struct statx_timestamp *timestamp)
+{
+    struct timespec time = { timestamp->tv_sec, timestamp->tv_nsec };
+
+    return time;
+}
+
+struct timespec statx_created(const struct statx *stx)
+{
+    /* The change time, when the filesystem does not store the creation time */
+    return statx_time((stx->stx_mask & STATX_BTIME) ? &stx->stx_btime : &stx->stx_ctime);
+}
+
+/*
+ * INOTIFY BACKEND
+ * A watch for each directory, the kernel reads the records.
+ */
+
+static int inotify_backend_init(void)
+{
+    return inotify_init();
+}
+
+static int inotify_backend_add_watch(const char *path, uint32_t mask)
+{
+    return inotify_add_watch(fd, path, mask);
+}
+
+static int inotify_backend_rm_watch(int wd)
+{
+    return inotify_rm_watch(fd, wd);
+}
+
+static ssize_t inotify_backend_read(char *buffer, size_t len)
+{
+    return read(fd, buffer, len);
+}
+
+struct backend_t inotify_backend =
+{
+    "inotify",
+    1,
+    inotify_backend_init,
+    inotify_backend_add_watch,
+    inotify_backend_rm_watch,
+    inotify_backend_read
+};
+
+/*
+ * FANOTIFY BACKEND
+ * A mark on the whole filesystem (FAN_MARK_FILESYSTEM) reports the events
+ * of every directory, identified by its file handle (FAN_REPORT_DFID_NAME).
+ * The watch descriptors are only known by cwatch: a directory gets one
+ * the first time it is read in an event, if it belongs to a watched subtree,
+ * so there is no kernel state and no traversing for each directory.
+ */
+#if defined(HAVE_SYS_FANOTIFY_H) && defined(FAN_REPORT_DFID_NAME)
+
+#define FAN_KEY_LEN         (1 + sizeof(fsid_t) + sizeof(int) + MAX_HANDLE_SZ)
+#define FAN_MAX_UNWATCHED   16384
+
+/* Used to store a marked filesystem */
+typedef struct fan_fs_s
+{
+    fsid_t   fsid;
+    int      mount_fd;    /* a directory of the filesystem, used to open the file handles */
+    uint32_t mask;        /* the events of the mark, the union of the masks of its directories */
+} FAN_FS;
+
+/* Used to store a directory identified by its file handle */
+typedef struct fan_dir_s
+{
+    int           wd;               /* the watch descriptor, -1 if the directory is not watched */
+    unsigned char key[FAN_KEY_LEN]; /* key length, fsid, handle type and handle bytes */
+} FAN_DIR;
+
+/*
+ * The inotify events and their fanotify equivalent
+ * In the order they happen to a file: the events of a record merged
+ * by fanotify are split in this order (see fan_split).
+ */
+static const uint32_t fan_events[][2] =
+{
+    {IN_CREATE,        FAN_CREATE},
+    {IN_MOVED_TO,      FAN_MOVED_TO},
+    {IN_OPEN,          FAN_OPEN},
+    {IN_ACCESS,        FAN_ACCESS},
+    {IN_MODIFY,        FAN_MODIFY},
+    {IN_ATTRIB,        FAN_ATTRIB},
+    {IN_CLOSE_WRITE,   FAN_CLOSE_WRITE},
+    {IN_CLOSE_NOWRITE, FAN_CLOSE_NOWRITE},
+    {IN_MOVED_FROM,    FAN_MOVED_FROM},
+    {IN_DELETE,        FAN_DELETE},
+    {IN_DELETE_SELF,   FAN_DELETE_SELF},
+    {IN_MOVE_SELF,     FAN_MOVE_SELF},
+    {IN_Q_OVERFLOW,    FAN_Q_OVERFLOW},
+    {IN_ISDIR,         FAN_ONDIR}
+};
+
+#define FAN_EVENTS_QTY  (sizeof(fan_events) / sizeof(fan_events[0]))
+#define FAN_SPLIT_QTY   (FAN_EVENTS_QTY - 2)   /* the events split, not IN_Q_OVERFLOW and IN_ISDIR */
+
+static LIST *fan_fs_list;             /* the marked filesystems */
+static HASH *fan_dir_index;           /* the directories by file handle */
+static HASH *fan_wd_index;            /* the watched directories by watch descriptor */
+static unsigned int fan_unwatched_c;  /* the number of directories not watched in fan_dir_index */
+static int fan_last_wd;               /* the last watch descriptor given */
+static struct file_handle *fan_handle;
+static char *fan_buffer;              /* the fanotify records read */
+static size_t fan_buffer_len;
+static size_t fan_read_len;           /* the length of the records read */
+static size_t fan_next;               /* the first record not converted yet */
+
+/* Convert an event mask, to fanotify (to_fanotify != 0) or to inotify */
+static uint32_t fan_convert_mask(uint32_t mask, int to_fanotify)
+{
+    uint32_t converted = 0;
+    size_t i;
+
+    for (i = 0; i < FAN_EVENTS_QTY; ++i) {
+        if (mask & fan_events[i][to_fanotify ? 0 : 1])
+            converted |= fan_events[i][to_fanotify ? 1 : 0];
+    }
+
+    return converted;
+}
+
+/*
+ * Write an inotify record for each event of a fanotify mask, as fanotify
+ * merges the events of the same file in one record, if there is room
+ * @return size_t : the length of the records, 0 if they do not fit
+ */
+static size_t fan_split(char *buffer, size_t len, int wd, uint32_t fan_mask, const char *name)
+{
+    uint32_t mask = fan_convert_mask(fan_mask, 0);
+    size_t record_len = EVENT_SIZE + ((strlen(name) + 1 + 3) & ~((size_t) 3));
+    size_t out = 0;
+    size_t i, events_qty = 0;
+
+    for (i = 0; i < FAN_SPLIT_QTY; ++i) {
+        if (mask & fan_events[i][0])
+            ++events_qty;
+    }
+
+    if (events_qty * record_len > len)
+        return 0;
+
+    for (i = 0; i < FAN_SPLIT_QTY; ++i) {
+        if (mask & fan_events[i][0])
+            out += put_event(buffer + out, wd, fan_events[i][0] | (mask & IN_ISDIR), name);
+    }
+
+    return out;
+}
+
+static unsigned long fan_key_hash(const void *key)
+{
+    const unsigned char *p = (const unsigned char *) key;
+    unsigned long hash = 2166136261UL;
+    size_t i;
+
+    for (i = 0; i <= p[0]; ++i) {
+        hash ^= p[i];
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+static int fan_key_compare(const void *a, const void *b)
+{
+    const unsigned char *p = (const unsigned char *) a;
+
+    return memcmp(p, b, p[0] + 1);
+}
+
+static void fan_make_key(unsigned char *key, const void *fsid, const struct file_handle *handle)
+{
+    size_t handle_bytes = (handle->handle_bytes > MAX_HANDLE_SZ) ? MAX_HANDLE_SZ : handle->handle_bytes;
+
+    key[0] = (unsigned char) (sizeof(fsid_t) + sizeof(int) + handle_bytes);
+    memcpy(key + 1, fsid, sizeof(fsid_t));
+    memcpy(key + 1 + sizeof(fsid_t), &handle->handle_type, sizeof(int));
+    memcpy(key + 1 + sizeof(fsid_t) + sizeof(int), handle->f_handle, handle_bytes);
+}
+
+static FAN_FS *fan_get_fs(const void *fsid)
+{
+    LIST_NODE *node = fan_fs_list->first;
+
+    while (node) {
+        FAN_FS *fs = (FAN_FS *) node->data;
+        if (memcmp(&fs->fsid, fsid, sizeof(fsid_t)) == 0)
+            return fs;
+        node = node->next;
+    }
+
+    return NULL;
+}
+
+/* Forget the directories that are not watched, when there are too many */
+static void fan_purge_unwatched()
+{
+    LIST *list = list_init();
+    HASH_ENTRY *entry = NULL;
+    FAN_DIR *dir;
+
+    while ((entry = hash_next(fan_dir_index, entry)) != NULL) {
+        if (((FAN_DIR *) entry->data)->wd == -1)
+            list_push(list, entry->data);
+    }
+
+    while ((dir = (FAN_DIR *) list_pop(list)) != NULL) {
+        hash_remove(fan_dir_index, dir->key);
+        free(dir);
+    }
+
+    list_free(list);
+    fan_unwatched_c = 0;
+}
+
+/* Set the watch descriptor of a directory, -1 if it is not watched */
+static void fan_set_dir(const unsigned char *key, int wd)
+{
+    FAN_DIR *dir = (FAN_DIR *) hash_get(fan_dir_index, key);
+
+    if (dir != NULL) {
+        if (dir->wd != -1)
+            hash_remove(fan_wd_index, &dir->wd);
+        else
+            --fan_unwatched_c;
+    } else {
+        if (wd == -1 && fan_unwatched_c >= FAN_MAX_UNWATCHED)
+            fan_purge_unwatched();
+
+        dir = (FAN_DIR *) malloc(sizeof(FAN_DIR));
+        memcpy(dir->key, key, key[0] + 1);
+        hash_put(fan_dir_index, dir->key, (void *) dir);
+    }
+
+    dir->wd = wd;
+    if (wd != -1)
+        hash_put(fan_wd_index, &dir->wd, (void *) dir);
+    else
+        ++fan_unwatched_c;
+}
+
+/* Resolve the real path of a directory file handle (with the ending slash) */
+static char *fan_handle_path(const void *fsid, struct file_handle *handle)
+{
+    FAN_FS *fs = fan_get_fs(fsid);
+    if (fs == NULL)
+        return NULL;
+
+    int dir_fd = open_by_handle_at(fs->mount_fd, handle, O_PATH);
+    if (dir_fd == -1)
+        return NULL;
+
+    char *path = fd_real_path(dir_fd);
+    close(dir_fd);
+
+    return path;
+}
+
+/* Check if a directory belongs to a watched subtree, as watch() would do */
+static bool_t fan_is_watchable(const char *path)
+{
+    if (recursive_flag == FALSE)
+        return FALSE;
+
+    TRIE_NODE *trie_node = trie_find_prefix(wd_tree, path);
+    if (trie_node == NULL)
+        return FALSE;
+
+    WD_DATA *wd_data = (WD_DATA *) ((LIST_NODE *) trie_node->data)->data;
+
+    /* Discard the directories whose name matches the regular expression (-x option) */
+    RULE *rule = get_rule(path);
+    char wd_path[MAXPATHLEN + 1];
+    char *subpath = strdup(path + strlen(get_wd_path(wd_data, wd_path)));
+    char *save = NULL;
+    char *name = strtok_r(subpath, "/", &save);
+    bool_t watchable = TRUE;
+
+    while (name != NULL && watchable == TRUE) {
+        if (excluded(name) || rule_excludes(rule, name))
+            watchable = FALSE;
+        name = strtok_r(NULL, "/", &save);
+    }
+    free(subpath);
+
+    return watchable;
+}
+
+/* Get the watch descriptor of a directory, watching it when needed */
+static int fan_get_wd(const void *fsid, struct file_handle *handle)
+{
+    unsigned char key[FAN_KEY_LEN];
+    fan_make_key(key, fsid, handle);
+
+    FAN_DIR *dir = (FAN_DIR *) hash_get(fan_dir_index, key);
+    if (dir != NULL)
+        return dir->wd;
+
+    int wd = -1;
+    char *path = fan_handle_path(fsid, handle);
+
+    if (path != NULL && fan_is_watchable(path) == TRUE) {
+        LIST_NODE *node = add_to_watch_list(path, NULL);
+        if (node != NULL)
+            wd = ((WD_DATA *) node->data)->wd;
+    }
+    free(path);
+
+    /* Remember the directories that are not watched, the next events will be discarded */
+    if (wd == -1)
+        fan_set_dir(key, -1);
+
+    return wd;
+}
+
+static int fanotify_backend_init(void)
+{
+    fan_fs_list = list_init();
+    fan_dir_index = hash_init(fan_key_hash, fan_key_compare);
+    fan_wd_index = hash_init(hash_int, hash_int_compare);
+    fan_handle = (struct file_handle *) malloc(sizeof(struct file_handle) + MAX_HANDLE_SZ);
+
+    return fanotify_init(FAN_CLOEXEC | FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME, O_RDONLY | O_LARGEFILE);
+}
+
+static int fanotify_backend_add_watch(const char *path, uint32_t mask)
+{
+    struct statfs fs_stat;
+    if (statfs(path, &fs_stat) == -1)
+        return -1;
+
+    /*
+     * Mark the filesystem of the directory, again when the mask is wider (the masks are ORed).
+     * A subdirectory is only watched once one of its events is read: the events
+     * of the rules below the directory are in the mark from the start.
+     */
+    FAN_FS *fs = fan_get_fs(&fs_stat.f_fsid);
+    mask |= rules_subtree_mask(path);
+    uint32_t fan_mask = fan_convert_mask(mask & ~IN_Q_OVERFLOW, 1) | FAN_ONDIR;
+    if (fs == NULL || (fan_mask & ~fs->mask) != 0) {
+        if (fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, fan_mask, AT_FDCWD, path) == -1)
+            return -1;
+    }
+
+    if (fs == NULL) {
+        fs = (FAN_FS *) malloc(sizeof(FAN_FS));
+        fs->fsid = fs_stat.f_fsid;
+        fs->mount_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        fs->mask = 0;
+        list_push(fan_fs_list, (void *) fs);
+    }
+    fs->mask |= fan_mask;
+
+    int mount_id;
+    fan_handle->handle_bytes = MAX_HANDLE_SZ;
+    if (name_to_handle_at(AT_FDCWD, path, fan_handle, &mount_id, 0) == -1)
+        return -1;
+
+    unsigned char key[FAN_KEY_LEN];
+    fan_make_key(key, &fs->fsid, fan_handle);
+
+    /* Like inotify, a directory already watched keeps its watch descriptor */
+    FAN_DIR *dir = (FAN_DIR *) hash_get(fan_dir_index, key);
+    if (dir != NULL && dir->wd != -1)
+        return dir->wd;
+
+    int wd = ++fan_last_wd;
+    fan_set_dir(key, wd);
+
+    return wd;
+}
+
+static int fanotify_backend_rm_watch(int wd)
+{
+    FAN_DIR *dir = (FAN_DIR *) hash_remove(fan_wd_index, &wd);
+    if (dir == NULL)
+        return -1;
+
+    hash_remove(fan_dir_index, dir->key);
+    free(dir);
+
+    return 0;
+}
+
+static ssize_t fanotify_backend_read(char *buffer, size_t len)
+{
+    /* The records left by the previous read are converted first, the queue is read once they are */
+    if (fan_next == fan_read_len) {
+        if (fan_buffer_len < len) {
+            fan_buffer = (char *) realloc(fan_buffer, len);
+            fan_buffer_len = len;
+        }
+
+        ssize_t n = read(fd, fan_buffer, len);
+        if (n <= 0)
+            return n;
+
+        fan_read_len = n;
+        fan_next = 0;
+    }
+
+    /*
+     * A record can be split in several inotify records (see fan_split): the
+     * ones that do not fit in the buffer are kept for the next read. One
+     * record always fits, the buffer is at least EVENT_READ_MIN long.
+     */
+    size_t out = 0, converted;
+    size_t remaining = fan_read_len - fan_next;
+    struct fanotify_event_metadata *metadata = (struct fanotify_event_metadata *) (fan_buffer + fan_next);
+
+    for (; FAN_EVENT_OK(metadata, remaining); metadata = FAN_EVENT_NEXT(metadata, remaining)) {
+        if (metadata->vers != FANOTIFY_METADATA_VERSION) {
+            fan_next = fan_read_len;
+            errno = EPROTO;
+            return -1;
+        }
+
+        if (metadata->mask & FAN_Q_OVERFLOW) {
+            if (len - out < EVENT_SIZE + 4)
+                break;
+            if (metadata->fd >= 0)
+                close(metadata->fd);
+            out += put_event(buffer + out, -1, IN_Q_OVERFLOW, "");
+            continue;
+        }
+
+        if (metadata->fd >= 0) {
+            close(metadata->fd);
+            metadata->fd = FAN_NOFD;
+        }
+
+        struct fanotify_event_info_fid *fid = (struct fanotify_event_info_fid *) (metadata + 1);
+        if (metadata->event_len < sizeof(struct fanotify_event_metadata) + sizeof(struct fanotify_event_info_fid)
+            || (fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME
+                && fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID))
+        {
+            continue;
+        }
+
+        /* The name follows the file handle, "." is the directory itself */
+        struct file_handle *handle = (struct file_handle *) fid->handle;
+        const char *name = "";
+        if (fid->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME) {
+            name = (const char *) handle->f_handle + handle->handle_bytes;
+            if (strcmp(name, ".") == 0)
+                name = "";
+        }
+
+        int wd = fan_get_wd(&fid->fsid, handle);
+        if (wd == -1)
+            continue;
+
+        converted = fan_split(buffer + out, len - out, wd, metadata->mask, name);
+        if (converted == 0 && out > 0)
+            break;
+        out += converted;
+    }
+
+    fan_next = FAN_EVENT_OK(metadata, remaining)
+        ? (size_t) ((char *) metadata - fan_buffer)
+        : fan_read_len;
+
+    return out;
+}
+
+#else /* fanotify is not available */
+
+static int fanotify_backend_init(void)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static int fanotify_backend_add_watch(const char *path, uint32_t mask)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static int fanotify_backend_rm_watch(int wd)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static ssize_t fanotify_backend_read(char *buffer, size_t len)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
+
+struct backend_t fanotify_backend =
+{
+    "fanotify",
+    0,
+    fanotify_backend_init,
+    fanotify_backend_add_watch,
+    fanotify_backend_rm_watch,
+    fanotify_backend_read
+};
+
+struct backend_t *get_backend(const char *name)
+{
+    if (strcmp(name, inotify_backend.name) == 0)
+        return &inotify_backend;
+
+    if (strcmp(name, fanotify_backend.name) == 0)
+        return &fanotify_backend;
+
+    return NULL;
+}
@@ -0,0 +1,102 @@
+/* backend.h
+ * The notification backends used to watch the directories
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __BACKEND_H
+#define __BACKEND_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "bstrlib.h"
+
+/* Declared by <sys/stat.h> under _GNU_SOURCE, that a file could include first */
+struct statx;
+struct statx_timestamp;
+
+/*
+ * Used to describe a notification backend
+ * Every backend reads inotify_event records, so that the events LUT
+ * and the event handlers do not depend on the backend in use.
+ */
+struct backend_t
+{
+    char *name;           /* the backend name (inotify, fanotify) */
+    int  per_directory;   /* 1 if each directory needs a watch, 0 if a watch covers the whole subtree */
+    int (*init)(void);    /* open the file descriptor to read from, -1 in case of error */
+    int (*add_watch)(
+        const char *,
+        uint32_t
+        );                /* watch a directory for an inotify event mask, returns the watch descriptor */
+    int (*rm_watch)(int); /* release a watch descriptor */
+    ssize_t (*read)(
+        char *,
+        size_t
+        );                /* read the inotify_event records, 0 if there is none to report */
+};
+
+extern struct backend_t inotify_backend;
+extern struct backend_t fanotify_backend;
+
+/**
+ * Write an inotify_event record, as read from the kernel
+ * @param char *       : the buffer (aligned as an inotify_event)
+ * @param int          : the watch descriptor
+ * @param uint32_t     : the event mask
+ * @param const char * : the name of the file, "" for the directory itself
+ * @return size_t      : the size of the record
+ */
+size_t put_event(char *, int, uint32_t, const char *);
+
+/**
+ * Append a synthesized inotify_event record to the records of a bstring
+ * @param bstring      : the records
+ * @param int          : the watch descriptor
+ * @param uint32_t     : the event mask
+ * @param const char * : the name of the file, "" for the directory itself
+ */
+void append_event(bstring, int, uint32_t, const char *);
+
+/**
+ * Convert a statx timestamp, to be compared with timespec_compare
+ * @param const struct statx_timestamp * : the timestamp
+ * @return struct timespec               : the same timestamp
+ */
+struct timespec statx_time(const struct statx_timestamp *);
+
+/**
+ * Get the creation time of a file, to tell if it was created while it was not watched
+ * @param const struct statx * : the file stat (STATX_CTIME | STATX_BTIME requested)
+ * @return struct timespec     : the birth time, the change time when the filesystem does not store it
+ */
+struct timespec statx_created(const struct statx *);
+
+/**
+ * Search a backend by name
+ * @param char *              : the backend name
+ * @return struct backend_t * : the backend, NULL otherwise
+ */
+struct backend_t *get_backend(const char *);
+
+#endif /* !__BACKEND_H */
@@ -0,0 +1,704 @@
+/* bench.c
+ * Benchmark of cwatch on a synthetic tree and event storms (make bench)
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* pipe2(), accept4(), ... */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <ftw.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define PROGRAM_NAME    "cwatch-bench"
+#define LINE_LEN        4096
+#define DRAIN_QUIET_MS  500         /* the output is drained until it is quiet for so long */
+
+typedef enum {FALSE,TRUE} bool_t;
+
+/* The options of the benchmark */
+typedef struct bench_options_s
+{
+    char         *cwatch;           /* the cwatch binary */
+    char         *backend;          /* --backend given to cwatch, NULL for the default one */
+    char         *work_dir;         /* where the trees are generated, a temporary directory otherwise */
+    unsigned int fanout;            /* the subdirectories of each directory */
+    unsigned int depth;             /* the levels of subdirectories */
+    unsigned int symlinks;          /* the percent of directories with a symbolic link */
+    unsigned int scan_threads;      /* --scan-threads given to cwatch, 0 for the default */
+    unsigned int rate;              /* the operations per second of the first storm */
+    unsigned int steps;             /* the storms, the rate is doubled after each one */
+    unsigned int step_ms;           /* the duration of each storm */
+    bool_t       spawn;             /* execute a command (-c) for each event, instead of -F */
+    bool_t       reader_thread;     /* --reader-thread given to cwatch */
+} BENCH_OPTIONS;
+
+/* A file of the storm, the name is "f<seq>" (or "g<seq>" once renamed) */
+typedef struct bench_file_s
+{
+    unsigned long seq;
+    unsigned int  dir;
+    bool_t        renamed;
+} BENCH_FILE;
+
+static BENCH_OPTIONS options = {NULL, NULL, NULL, 10, 3, 5, 0, 2000, 8, 1000, FALSE, FALSE};
+
+static char **dirs;                 /* the directories of the watched tree */
+static unsigned int dirs_qty;
+static unsigned int links_qty;
+static char root_dir[PATH_MAX];
+static char socket_path[PATH_MAX];
+
+static pid_t cwatch_pid;
+static int output_fd;               /* the standard output of cwatch */
+static char line[LINE_LEN];
+static size_t line_len;
+
+static double *create_times;        /* when each file is created, by seq */
+static size_t create_times_len;
+static double *latencies;           /* from a create to its output line, seconds */
+static size_t latencies_qty;
+static unsigned long lines_read;
+
+static struct option long_options[] =
+{
+    {"cwatch",       required_argument, 0, 'c'},
+    {"backend",      required_argument, 0, 'b'},
+    {"dir",          required_argument, 0, 'd'},
+    {"fanout",       required_argument, 0, 'f'},
+    {"depth",        required_argument, 0, 'D'},
+    {"symlinks",     required_argument, 0, 'l'},
+    {"scan-threads", required_argument, 0, 't'},
+    {"rate",         required_argument, 0, 'r'},
+    {"steps",        required_argument, 0, 's'},
+    {"step-ms",      required_argument, 0, 'm'},
+    {"spawn",        no_argument,       0, 'S'},
+    {"reader-thread", no_argument,      0, 'R'},
+    {"help",         no_argument,       0, 'h'},
+    {0, 0, 0, 0}
+};
+
+static void help(int error)
+{
+    printf("Usage: %s --cwatch CWATCH [-options]\n\n", PROGRAM_NAME);
+    printf("  Generate a tree, start cwatch on it and drive storms of create, modify,\n");
+    printf("  rename and delete operations, doubling the rate after each storm.\n\n");
+    printf("  --cwatch CWATCH      the cwatch binary to measure\n");
+    printf("  --backend NAME       the backend used by cwatch (default: its own)\n");
+    printf("  --dir DIRECTORY      where the trees are generated (default: a temporary one)\n");
+    printf("  --fanout N           the subdirectories of each directory (default: %u)\n", options.fanout);
+    printf("  --depth N            the levels of subdirectories (default: %u)\n", options.depth);
+    printf("  --symlinks PERCENT   the directories with a symbolic link to another tree (default: %u)\n", options.symlinks);
+    printf("  --scan-threads N     the threads of the initial scan of cwatch (default: its own)\n");
+    printf("  --rate N             the operations per second of the first storm (default: %u)\n", options.rate);
+    printf("  --steps N            the number of storms (default: %u)\n", options.steps);
+    printf("  --step-ms MS         the duration of each storm (default: %u)\n", options.step_ms);
+    printf("  --spawn              cwatch executes a command for each event, instead of -F\n");
+    printf("  --reader-thread      cwatch reads the kernel queue on a dedicated thread\n");
+
+    exit(error);
+}
+
+static unsigned int parse_number(const char *str, unsigned int min)
+{
+    char *end = NULL;
+    unsigned long value = strtoul(str, &end, 10);
+
+    if (end == str || *end != '\0' || value < min || value > 1000000000UL) {
+        printf("The number \"%s\" is not valid.\n\n", str);
+        help(1);
+    }
+
+    return (unsigned int) value;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(const char *message)
+{
+    printf("ERROR: %s (%s)\n", message, strerror(errno));
+
+    if (cwatch_pid > 0)
+        kill(cwatch_pid, SIGKILL);
+
+    exit(1);
+}
+
+/* Format a path, that has to fit in the buffer */
+static void make_path(char *path, size_t len, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    int written = vsnprintf(path, len, format, args);
+    va_end(args);
+
+    if (written < 0 || (size_t) written >= len) {
+        errno = ENAMETOOLONG;
+        die("Unable to build a path");
+    }
+}
+
+/*
+ * TREE GENERATION
+ */
+
+static void add_dir(const char *path)
+{
+    if (mkdir(path, 0755) == -1 && errno != EEXIST)
+        die("Unable to create a directory");
+
+    dirs = (char **) realloc(dirs, (dirs_qty + 1) * sizeof(char *));
+    dirs[dirs_qty++] = strdup(path);
+}
+
+/* Create the subdirectories of a directory, down to the depth */
+static void make_tree(const char *path, unsigned int depth, bool_t watched, char **targets, unsigned int targets_qty)
+{
+    char child[PATH_MAX];
+    unsigned int i;
+
+    if (watched == TRUE) {
+        add_dir(path);
+    } else if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+        die("Unable to create a directory");
+    }
+
+    /* A symbolic link to a directory of the other tree */
+    if (watched == TRUE && targets_qty > 0 && (unsigned int) (rand() % 100) < options.symlinks) {
+        make_path(child, sizeof(child), "%slink", path);
+        if (symlink(targets[rand() % targets_qty], child) == -1)
+            die("Unable to create a symbolic link");
+        ++links_qty;
+    }
+
+    if (depth == 0)
+        return;
+
+    for (i = 0; i < options.fanout; ++i) {
+        make_path(child, sizeof(child), "%sd%u/", path, i);
+        make_tree(child, depth - 1, watched, targets, targets_qty);
+    }
+}
+
+/* The directories of the tree pointed by the symbolic links */
+static char **make_targets(const char *path, unsigned int *qty)
+{
+    char **targets = NULL;
+    char child[PATH_MAX];
+    unsigned int i;
+
+    *qty = 0;
+    if (mkdir(path, 0755) == -1 && errno != EEXIST)
+        die("Unable to create a directory");
+
+    for (i = 0; i < options.fanout; ++i) {
+        make_path(child, sizeof(child), "%st%u", path, i);
+        if (mkdir(child, 0755) == -1 && errno != EEXIST)
+            die("Unable to create a directory");
+
+        targets = (char **) realloc(targets, (*qty + 1) * sizeof(char *));
+        targets[(*qty)++] = strdup(child);
+    }
+
+    return targets;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    remove(path);
+
+    return 0;
+}
+
+/*
+ * CWATCH PROCESS
+ */
+
+static void start_cwatch()
+{
+    int pipe_fds[2];
+
+    if (pipe2(pipe_fds, O_CLOEXEC) == -1)
+        die("Unable to create a pipe");
+
+    cwatch_pid = fork();
+    if (cwatch_pid == -1)
+        die("Unable to start cwatch");
+
+    if (cwatch_pid == 0) {
+        char *argv[16];
+        char threads[16];
+        int argc = 0;
+
+        argv[argc++] = options.cwatch;
+        argv[argc++] = "-r";
+        argv[argc++] = "-d";
+        argv[argc++] = root_dir;
+        argv[argc++] = (options.spawn == TRUE) ? "-c" : "-F";
+        argv[argc++] = (options.spawn == TRUE) ? "echo %e %f" : "%e %f";
+        argv[argc++] = "--metrics-socket";
+        argv[argc++] = socket_path;
+        if (options.backend != NULL) {
+            argv[argc++] = "--backend";
+            argv[argc++] = options.backend;
+        }
+        if (options.scan_threads > 0) {
+            snprintf(threads, sizeof(threads), "%u", options.scan_threads);
+            argv[argc++] = "--scan-threads";
+            argv[argc++] = threads;
+        }
+        if (options.reader_thread == TRUE)
+            argv[argc++] = "--reader-thread";
+        argv[argc] = NULL;
+
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd != -1)
+            dup2(null_fd, STDERR_FILENO);
+
+        execv(options.cwatch, argv);
+        _exit(127);
+    }
+
+    close(pipe_fds[1]);
+    output_fd = pipe_fds[0];
+    fcntl(output_fd, F_SETFL, fcntl(output_fd, F_GETFL) | O_NONBLOCK);
+}
+
+/* Read the metrics of cwatch, -1 if it is not listening yet */
+static int read_metrics(const char *name, double *value)
+{
+    struct sockaddr_un address;
+    char buffer[64 * 1024];
+    size_t len = 0;
+    ssize_t n;
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1)
+        return -1;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, socket_path, strlen(socket_path) + 1);
+
+    if (connect(sock, (struct sockaddr *) &address, sizeof(address)) == -1) {
+        close(sock);
+        return -1;
+    }
+
+    while (len < sizeof(buffer) - 1 && (n = read(sock, buffer + len, sizeof(buffer) - 1 - len)) > 0)
+        len += n;
+    buffer[len] = '\0';
+    close(sock);
+
+    /* The line "<name> <value>" */
+    size_t name_len = strlen(name);
+    char *c = buffer;
+    while ((c = strstr(c, name)) != NULL) {
+        if ((c == buffer || c[-1] == '\n') && c[name_len] == ' ') {
+            *value = strtod(c + name_len + 1, NULL);
+            return 0;
+        }
+        c += name_len;
+    }
+
+    *value = 0;
+
+    return 0;
+}
+
+/* Wait for cwatch to listen on the metrics socket, once the tree is watched */
+static double wait_cwatch()
+{
+    double watches = 0;
+
+    while (read_metrics("cwatch_watches", &watches) == -1) {
+        if (waitpid(cwatch_pid, NULL, WNOHANG) == cwatch_pid) {
+            cwatch_pid = 0;
+            errno = ECHILD;
+            die("cwatch terminated during the startup");
+        }
+        usleep(1000);
+    }
+
+    return watches;
+}
+
+static void stop_cwatch()
+{
+    kill(cwatch_pid, SIGTERM);
+    waitpid(cwatch_pid, NULL, 0);
+    cwatch_pid = 0;
+    close(output_fd);
+}
+
+static long read_rss_kb(pid_t pid)
+{
+    char path[64], buffer[256];
+    long rss = -1;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", (int) pid);
+    FILE *status = fopen(path, "r");
+    if (status == NULL)
+        return -1;
+
+    while (fgets(buffer, sizeof(buffer), status) != NULL) {
+        if (sscanf(buffer, "VmRSS: %ld", &rss) == 1)
+            break;
+    }
+    fclose(status);
+
+    return rss;
+}
+
+/* A line written by cwatch: "<event> <file>" */
+static void handle_line(const char *text, double time)
+{
+    unsigned long seq;
+
+    ++lines_read;
+
+    if (sscanf(text, "create f%lu", &seq) == 1 && seq < create_times_len && create_times[seq] > 0) {
+        latencies[latencies_qty++] = time - create_times[seq];
+        create_times[seq] = 0;
+    }
+}
+
+/* Read the output of cwatch, waiting up to timeout_ms; -1 once it is terminated */
+static int read_output(int timeout_ms)
+{
+    struct pollfd pfd = {output_fd, POLLIN, 0};
+    char buffer[64 * 1024];
+    ssize_t n, i;
+
+    if (poll(&pfd, 1, timeout_ms) <= 0)
+        return 0;
+
+    double time = now();
+
+    while ((n = read(output_fd, buffer, sizeof(buffer))) > 0) {
+        for (i = 0; i < n; ++i) {
+            if (buffer[i] == '\n') {
+                line[line_len] = '\0';
+                handle_line(line, time);
+                line_len = 0;
+            } else if (line_len < LINE_LEN - 1) {
+                line[line_len++] = buffer[i];
+            }
+        }
+    }
+
+    return (n == 0) ? -1 : 0;
+}
+
+/*
+ * STORM
+ */
+
+static BENCH_FILE *files;           /* the files alive */
+static size_t files_qty;
+static unsigned long next_seq;
+static long last_modified = -1;     /* inotify merges an event identical to the previous one */
+
+static void file_path(char *path, size_t len, const BENCH_FILE *file)
+{
+    snprintf(path, len, "%s%c%lu", dirs[file->dir], (file->renamed == TRUE) ? 'g' : 'f', file->seq);
+}
+
+/* Execute an operation, returns the number of lines expected from cwatch */
+static int storm_operation()
+{
+    char path[PATH_MAX], new_path[PATH_MAX];
+    int operation = (files_qty < 64) ? 0 : rand() % 4;
+    size_t index = (files_qty > 0) ? (size_t) rand() % files_qty : 0;
+    BENCH_FILE *file = &files[index];
+
+    if (operation == 1 && (long) file->seq == last_modified)
+        operation = 0;
+    last_modified = (operation == 1) ? (long) file->seq : -1;
+
+    switch (operation) {
+    case 0: /* create */
+    {
+        BENCH_FILE created = {next_seq++, (unsigned int) rand() % dirs_qty, FALSE};
+
+        if (created.seq >= create_times_len) {
+            create_times_len = (create_times_len == 0) ? 65536 : create_times_len * 2;
+            create_times = (double *) realloc(create_times, create_times_len * sizeof(double));
+            latencies = (double *) realloc(latencies, create_times_len * sizeof(double));
+        }
+
+        file_path(path, sizeof(path), &created);
+        create_times[created.seq] = now();
+
+        int file_fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (file_fd == -1)
+            die("Unable to create a file");
+        close(file_fd);
+
+        files = (BENCH_FILE *) realloc(files, (files_qty + 1) * sizeof(BENCH_FILE));
+        files[files_qty++] = created;
+
+        return 1;
+    }
+    case 1: /* modify */
+    {
+        file_path(path, sizeof(path), file);
+
+        int file_fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (file_fd == -1)
+            die("Unable to modify a file");
+        if (write(file_fd, "x", 1) != 1)
+            die("Unable to modify a file");
+        close(file_fd);
+
+        return 1;
+    }
+    case 2: /* rename, moved_from and moved_to without a cookie to pair them (fanotify) */
+        file_path(path, sizeof(path), file);
+        file->renamed = (file->renamed == TRUE) ? FALSE : TRUE;
+        file_path(new_path, sizeof(new_path), file);
+
+        if (rename(path, new_path) == -1)
+            die("Unable to rename a file");
+
+        return (options.backend != NULL && strcmp(options.backend, "fanotify") == 0) ? 2 : 1;
+    default: /* delete */
+        file_path(path, sizeof(path), file);
+
+        if (unlink(path) == -1)
+            die("Unable to delete a file");
+
+        files[index] = files[--files_qty];
+
+        return 1;
+    }
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+static double percentile(double p)
+{
+    if (latencies_qty == 0)
+        return 0;
+
+    size_t index = (size_t) (p * (latencies_qty - 1));
+
+    return latencies[index] * 1000;
+}
+
+/* Drive a storm at a rate, returns FALSE once events are lost */
+static bool_t storm(unsigned int rate, double *achieved)
+{
+    unsigned long operations = (unsigned long) rate * options.step_ms / 1000;
+    unsigned long expected = 0, i = 0;
+    double overflows_before, overflows_after;
+
+    lines_read = 0;
+    latencies_qty = 0;
+    read_metrics("cwatch_queue_overflows_total", &overflows_before);
+
+    double start = now();
+
+    while (i < operations) {
+        double next = start + (double) i / rate;
+        double current = now();
+
+        if (current >= next) {
+            expected += storm_operation();
+            ++i;
+
+            /* Do not fall behind reading the output */
+            if (i % 64 == 0 && read_output(0) == -1)
+                die("cwatch terminated");
+        } else if (read_output((int) ((next - current) * 1000)) == -1) {
+            die("cwatch terminated");
+        }
+    }
+
+    double elapsed = now() - start;
+
+    /* Wait for the last events */
+    unsigned long last = lines_read;
+    double quiet = now();
+    while (lines_read < expected && (now() - quiet) * 1000 < DRAIN_QUIET_MS) {
+        if (read_output(50) == -1)
+            die("cwatch terminated");
+        if (lines_read != last) {
+            last = lines_read;
+            quiet = now();
+        }
+    }
+
+    read_metrics("cwatch_queue_overflows_total", &overflows_after);
+    qsort(latencies, latencies_qty, sizeof(double), compare_double);
+
+    *achieved = operations / elapsed;
+
+    long lost = (long) expected - (long) lines_read;
+    printf("%10u %12.0f %12.0f %8ld %10.0f %9.3f %9.3f %9.3f %9.3f\n",
+           rate, operations / elapsed, lines_read / (now() - start), (lost > 0) ? lost : 0,
+           overflows_after - overflows_before,
+           percentile(0.50), percentile(0.90), percentile(0.99), percentile(1.0));
+
+    return (lost > 0 || overflows_after > overflows_before) ? FALSE : TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+    int c;
+
+    while ((c = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'c': options.cwatch = optarg; break;
+        case 'b': options.backend = optarg; break;
+        case 'd': options.work_dir = optarg; break;
+        case 'f': options.fanout = parse_number(optarg, 1); break;
+        case 'D': options.depth = parse_number(optarg, 0); break;
+        case 'l': options.symlinks = parse_number(optarg, 0); break;
+        case 't': options.scan_threads = parse_number(optarg, 1); break;
+        case 'r': options.rate = parse_number(optarg, 1); break;
+        case 's': options.steps = parse_number(optarg, 1); break;
+        case 'm': options.step_ms = parse_number(optarg, 10); break;
+        case 'S': options.spawn = TRUE; break;
+        case 'R': options.reader_thread = TRUE; break;
+        case 'h': help(0);
+        default:  help(1);
+        }
+    }
+
+    if (options.cwatch == NULL || access(options.cwatch, X_OK) == -1)
+        help(1);
+
+    signal(SIGPIPE, SIG_IGN);
+    srand(42);
+
+    /* The trees */
+    char base[PATH_MAX], targets_dir[PATH_MAX];
+    if (options.work_dir != NULL) {
+        make_path(base, sizeof(base), "%s/cwatch-bench.%d", options.work_dir, (int) getpid());
+        if (mkdir(base, 0755) == -1)
+            die("Unable to create the work directory");
+    } else {
+        snprintf(base, sizeof(base), "/tmp/cwatch-bench.XXXXXX");
+        if (mkdtemp(base) == NULL)
+            die("Unable to create the work directory");
+    }
+
+    make_path(root_dir, sizeof(root_dir), "%s/root/", base);
+    make_path(targets_dir, sizeof(targets_dir), "%s/targets/", base);
+    make_path(socket_path, sizeof(socket_path), "%s/metrics.sock", base);
+    if (strlen(socket_path) >= sizeof(((struct sockaddr_un *) NULL)->sun_path)) {
+        errno = ENAMETOOLONG;
+        die("Unable to use the metrics socket");
+    }
+
+    unsigned int targets_qty;
+    char **targets = make_targets(targets_dir, &targets_qty);
+
+    /* The memory of cwatch watching the empty root, not taken as the one of the directories */
+    if (mkdir(root_dir, 0755) == -1)
+        die("Unable to create a directory");
+    start_cwatch();
+    double empty_watches = wait_cwatch();
+    long empty_rss = read_rss_kb(cwatch_pid);
+    stop_cwatch();
+
+    double start = now();
+    make_tree(root_dir, options.depth, TRUE, targets, targets_qty);
+    printf("TREE:    %u directories, %u symbolic links (fanout %u, depth %u) in %.3f seconds\n",
+           dirs_qty, links_qty, options.fanout, options.depth, now() - start);
+
+    /* Startup: cwatch listens on the metrics socket once the tree is watched */
+    start = now();
+    start_cwatch();
+    double watches = wait_cwatch();
+    double startup = now() - start;
+
+    long rss = read_rss_kb(cwatch_pid);
+    printf("STARTUP: %.0f directories watched in %.3f seconds (%.0f directories/s)\n",
+           watches, startup, watches / startup);
+    /* The RSS is counted in pages, a small tree is below its resolution */
+    if (rss > empty_rss && empty_rss > 0 && watches > empty_watches)
+        printf("MEMORY:  %ld KB RSS (%ld KB watching the empty root), %.0f bytes per watched directory\n",
+               rss, empty_rss, (rss - empty_rss) * 1024.0 / (watches - empty_watches));
+    else if (rss > 0)
+        printf("MEMORY:  %ld KB RSS (%ld KB watching the empty root), too few directories to measure\n",
+               rss, empty_rss);
+
+    /* Storms, until the events are lost */
+    printf("\n%10s %12s %12s %8s %10s %9s %9s %9s %9s\n",
+           "rate", "ops/s", "events/s", "lost", "overflows", "p50 ms", "p90 ms", "p99 ms", "max ms");
+
+    unsigned int rate = options.rate, step;
+    double achieved, sustained = 0;
+    for (step = 0; step < options.steps; ++step, rate *= 2) {
+        if (storm(rate, &achieved) == FALSE)
+            break;
+        if (achieved > sustained)
+            sustained = achieved;
+    }
+
+    if (sustained > 0)
+        printf("\nSUSTAINED: %.0f operations/s without lost events\n", sustained);
+    else
+        printf("\nSUSTAINED: events lost from the first storm\n");
+
+    rss = read_rss_kb(cwatch_pid);
+    if (rss > 0)
+        printf("MEMORY:  %ld KB RSS after the storms\n", rss);
+
+    stop_cwatch();
+
+    nftw(base, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+
+    return 0;
+}
@@ -0,0 +1,311 @@
+/* budget.c
+ * The watch budget: lazy expansion of the deep directories and LRU eviction
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "cwatch.h"
+
+#include <limits.h>
+
+/* The initial scan is not over: the budget is given to the shallow directories */
+static bool_t scanning = TRUE;
+
+/* When the areas below the frontiers were swept the last time */
+static struct timespec last_sweep;
+
+int budget_enabled()
+{
+    /* A watch covers the whole subtree, when the backend is not per directory */
+    return ((max_watches > 0 || eager_depth_set == TRUE) && backend->per_directory) ? 1 : 0;
+}
+
+unsigned int path_depth(const char *path)
+{
+    unsigned int depth = 0;
+    const char *c;
+
+    for (c = path; *c != '\0'; ++c) {
+        if (*c == '/' && c[1] != '/' && c[1] != '\0')
+            ++depth;
+    }
+
+    return depth;
+}
+
+unsigned int budget_levels(const char *path)
+{
+    if (eager_depth_set == FALSE)
+        return UINT_MAX;
+
+    /* Outside of the roots, a directory is as deep as the symbolic link pointing to it */
+    char *root = get_root_of(path);
+    unsigned int depth = (root != NULL) ? path_depth(path) - path_depth(root) : 0;
+
+    return (depth < eager_depth) ? eager_depth - depth : 0;
+}
+
+int budget_reserve(const char *path)
+{
+    if (max_watches == 0 || wd_index->count < max_watches)
+        return 0;
+
+    return budget_evict(path);
+}
+
+int budget_evict(const char *path)
+{
+    if (max_watches == 0 || scanning == TRUE)
+        return -1;
+
+    char candidate[MAXPATHLEN + 1];
+    LIST_NODE *node;
+
+    /* The coldest first, only the leaves of the watched tree are evicted */
+    for (node = list_wd->first; node != NULL; node = node->next) {
+        WD_DATA *wd_data = (WD_DATA *) node->data;
+
+        if (wd_data->refs > 0
+            || (wd_data->entry->children != NULL && wd_data->entry->children->count > 0))
+        {
+            continue;
+        }
+
+        get_wd_path(wd_data, candidate);
+        if (is_root(candidate) == TRUE || is_child_of(path, candidate) == TRUE)
+            continue;
+
+        /* Its parent covers it from now on, by its activity and by the sweeps */
+        TRIE_NODE *parent;
+        for (parent = wd_data->entry->parent; parent != NULL; parent = parent->parent) {
+            if (parent->data != NULL) {
+                ((WD_DATA *) ((LIST_NODE *) parent->data)->data)->flags |= WD_FRONTIER;
+                break;
+            }
+        }
+
+        log_message("EVICTING:\t\t\"%s\"", candidate);
+        metrics_count(METRIC_WATCHES_EVICTED);
+        unwatch(candidate, FALSE);
+
+        return 0;
+    }
+
+    return -1;
+}
+
+void budget_touch(WD_DATA *wd_data)
+{
+    TRIE_NODE *trie_node;
+
+    for (trie_node = wd_data->entry; trie_node != NULL; trie_node = trie_node->parent) {
+        LIST_NODE *node = (LIST_NODE *) trie_node->data;
+
+        if (node != NULL && node != list_wd->last) {
+            list_unlink(list_wd, node);
+            list_link(list_wd, node);
+        }
+    }
+
+    if (wd_data->flags & WD_FRONTIER)
+        budget_expand(wd_data);
+}
+
+void budget_expand(WD_DATA *wd_data)
+{
+    char path[MAXPATHLEN + 1];
+    char child_path[MAXPATHLEN + NAME_MAX + 2];
+    struct dirent *dir;
+
+    wd_data->flags &= ~WD_FRONTIER;
+    if (recursive_flag == FALSE)
+        return;
+
+    DIR *dir_stream = opendir(get_wd_path(wd_data, path));
+    if (dir_stream == NULL)
+        return;
+
+    while ((dir = readdir(dir_stream))) {
+        LIST_NODE *node = NULL;
+
+        if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0)
+            continue;
+
+        if (dir->d_type == DT_DIR) {
+            /* Discard all filename that matches regular expression (-x option) */
+            if (excluded(dir->d_name) || rule_excludes(wd_data->rule, dir->d_name))
+                continue;
+
+            snprintf(child_path, sizeof(child_path), "%s%s/", path, dir->d_name);
+            if (get_node_from_path(child_path) != NULL || rule_skips(child_path))
+                continue;
+
+            node = add_to_watch_list(child_path, NULL);
+        } else if (dir->d_type == DT_LNK && nosymlink_flag == FALSE) {
+            snprintf(child_path, sizeof(child_path), "%s%s", path, dir->d_name);
+            if (get_link_data_from_path(child_path) != NULL)
+                continue;
+
+            char *real_path = resolve_real_path(child_path);
+            DIR *is_a_dir = (real_path != NULL) ? opendir(real_path) : NULL;
+            if (is_a_dir == NULL) {
+                free(real_path);
+                continue;
+            }
+            closedir(is_a_dir);
+
+            /* A target already watched is not a frontier */
+            if (get_node_from_path(real_path) != NULL) {
+                add_to_watch_list(real_path, strdup(child_path));
+                free(real_path);
+                continue;
+            }
+
+            char *link = strdup(child_path);
+            if ((node = add_to_watch_list(real_path, link)) == NULL)
+                free(link);
+            free(real_path);
+        } else {
+            continue;
+        }
+
+        /* Out of budget, it is expanded again by its next activity */
+        if (node == NULL)
+            wd_data->flags |= WD_FRONTIER;
+        else
+            ((WD_DATA *) node->data)->flags |= WD_FRONTIER;
+    }
+
+    closedir(dir_stream);
+}
+
+void budget_start()
+{
+    scanning = FALSE;
+    clock_gettime(CLOCK_REALTIME, &last_sweep);
+}
+
+/* Collect the directories below a frontier that are not watched, and changed since the last sweep */
+static void sweep_area(const char *path, const struct timespec *since, LIST *changed)
+{
+    LIST *list = list_init();
+    list_push(list, (void *) strdup(path));
+
+    char child_path[MAXPATHLEN + NAME_MAX + 2];
+    struct dirent *dir;
+    struct stat st;
+    char *p;
+
+    while ((p = (char *) list_pop(list)) != NULL) {
+        DIR *dir_stream = opendir(p);
+        if (dir_stream == NULL) {
+            free(p);
+            continue;
+        }
+
+        int dir_fd = dirfd(dir_stream);
+        RULE *rule = get_rule(p);
+
+        while ((dir = readdir(dir_stream))) {
+            if (dir->d_type != DT_DIR
+                || strcmp(dir->d_name, ".") == 0
+                || strcmp(dir->d_name, "..") == 0
+                || excluded(dir->d_name)
+                || rule_excludes(rule, dir->d_name))
+            {
+                continue;
+            }
+
+            /* The watched ones report their own changes */
+            snprintf(child_path, sizeof(child_path), "%s%s/", p, dir->d_name);
+            if (get_node_from_path(child_path) != NULL || rule_skips(child_path))
+                continue;
+
+            if (fstatat(dir_fd, dir->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0
+                && timespec_compare(&st.st_mtim, since) > 0)
+            {
+                list_push(changed, (void *) strdup(child_path));
+            }
+
+            list_push(list, (void *) strdup(child_path));
+        }
+
+        closedir(dir_stream);
+        free(p);
+    }
+
+    list_free(list);
+}
+
+int budget_sweep()
+{
+    struct timespec since = last_sweep;
+    clock_gettime(CLOCK_REALTIME, &last_sweep);
+
+    LIST *frontiers = list_init();
+    LIST *changed = list_init();
+    char path[MAXPATHLEN + 1];
+    LIST_NODE *node;
+    char *p;
+    int changed_c = 0;
+
+    /* The areas not watched are below the frontiers */
+    for (node = list_wd->first; node != NULL; node = node->next) {
+        WD_DATA *wd_data = (WD_DATA *) node->data;
+
+        if (wd_data->flags & WD_FRONTIER)
+            list_push(frontiers, (void *) strdup(get_wd_path(wd_data, path)));
+    }
+
+    while ((p = (char *) list_pop(frontiers)) != NULL) {
+        sweep_area(p, &since, changed);
+        free(p);
+    }
+
+    /* Watched from now on, the changes made since the last sweep are reported */
+    LIST *added = list_init();
+    while ((p = (char *) list_pop(changed)) != NULL) {
+        if (get_node_from_path(p) == NULL && (node = add_to_watch_list(p, NULL)) != NULL) {
+            WD_DATA *wd_data = (WD_DATA *) node->data;
+
+            wd_data->flags |= WD_FRONTIER;
+            wd_data->synced = since;
+            list_push(added, (void *) p);
+        } else {
+            free(p);
+        }
+    }
+
+    /* Once all of them are watched, as the events handled expand the frontiers */
+    while ((p = (char *) list_pop(added)) != NULL) {
+        resync_watched(p);
+        free(p);
+        ++changed_c;
+    }
+
+    list_free(frontiers);
+    list_free(changed);
+    list_free(added);
+
+    log_message("SWEEP COMPLETED:\t%d changed directories were not watched", changed_c);
+
+    return changed_c;
+}
@@ -0,0 +1,102 @@
+/* budget.h
+ * The watch budget: lazy expansion of the deep directories and LRU eviction
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __BUDGET_H
+#define __BUDGET_H
+
+#include <stdint.h>
+
+/*
+ * With --max-watches or --eager-depth, not every directory is watched:
+ * a directory marked as a frontier (WD_FRONTIER) has subdirectories
+ * that are not watched. They are watched once it shows activity, and
+ * the areas below the frontiers are swept for the changes of their mtime.
+ */
+#define SWEEP_INTERVAL 60   /* the default seconds between the sweeps */
+
+struct wd_data_s;
+
+/**
+ * Returns 1 if a budget is given (--max-watches or --eager-depth)
+ * @return int
+ */
+int budget_enabled();
+
+/**
+ * The number of components of an absolute path ("/home/user/" has 2)
+ * @param char *          : the path
+ * @return unsigned int
+ */
+unsigned int path_depth(const char *);
+
+/**
+ * The levels of subdirectories watched at once below a directory,
+ * as given by --eager-depth from the root it belongs to
+ * @param char *         : the directory, or the symbolic link pointing to it
+ * @return unsigned int  : the levels, UINT_MAX if there is no limit
+ */
+unsigned int budget_levels(const char *);
+
+/**
+ * Make room for a watch: with --max-watches, the least recently active
+ * directory is evicted (with its subtree) once the budget is used.
+ * During the initial scan no directory is evicted, the shallow ones are kept.
+ * @param char * : the directory to watch, its ancestors are not evicted
+ * @return int   : -1 if there is no room, 0 otherwise
+ */
+int budget_reserve(const char *);
+
+/**
+ * Evict the least recently active directory (see budget_reserve)
+ * @param char * : the directory to watch, its ancestors are not evicted
+ * @return int   : -1 if no directory can be evicted, 0 otherwise
+ */
+int budget_evict(const char *);
+
+/**
+ * A directory shows activity: it and its ancestors become the most
+ * recently active (the tail of list_wd), and a frontier is expanded
+ * @param WD_DATA * : the wd_data of the directory
+ */
+void budget_touch(struct wd_data_s *);
+
+/**
+ * Watch the subdirectories of a frontier, one level (they are frontiers in turn)
+ * @param WD_DATA * : the wd_data of the directory
+ */
+void budget_expand(struct wd_data_s *);
+
+/**
+ * The initial scan is over: the directories can be evicted from now on
+ */
+void budget_start();
+
+/**
+ * Sweep the areas below the frontiers: the directories changed since
+ * the last sweep are watched, and their changes are reported (see resync_watched)
+ * @return int : the number of changed directories
+ */
+int budget_sweep();
+
+#endif /* !__BUDGET_H */
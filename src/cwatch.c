@@ -24,20 +24,75 @@
 
 #include "cwatch.h"
 
+/* Command line options without a short equivalent */
+enum
+{
+    OPT_COALESCE = 256,
+    OPT_COALESCE_BURST,
+    OPT_BATCH,
+    OPT_BATCH_NULL,
+    OPT_MAX_JOBS,
+    OPT_SKIP_UNCHANGED,
+    OPT_FINGERPRINT_CACHE,
+    OPT_SCAN_THREADS,
+    OPT_MAX_WATCHES,
+    OPT_EAGER_DEPTH,
+    OPT_SWEEP_INTERVAL,
+    OPT_BACKEND,
+    OPT_READ_BUFFER,
+    OPT_READER_THREAD,
+    OPT_IO_URING,
+    OPT_STATE_FILE,
+    OPT_STATE_INTERVAL,
+    OPT_ROOTS_FILE,
+    OPT_EXCLUDE_GLOB,
+    OPT_RULES,
+    OPT_METRICS_SOCKET,
+    OPT_DAEMON,
+    OPT_LOG_RATE,
+    OPT_OUTPUT,
+    OPT_OUTPUT_FLUSH
+};
+
 /* Command line long options */
 static struct option long_options[] =
 {   
     /* Options that set index */
     {"command",       required_argument, 0, 'c'}, /* exclude format */
     {"format",        required_argument, 0, 'F'}, /* exclude command */
+    {"output",        required_argument, 0, OPT_OUTPUT},
+    {"output-flush",  required_argument, 0, OPT_OUTPUT_FLUSH},
     {"directory",     required_argument, 0, 'd'},
+    {"roots-file",    required_argument, 0, OPT_ROOTS_FILE},
     {"events",        required_argument, 0, 'e'},
     {"exclude",       required_argument, 0, 'x'},
+    {"exclude-glob",  required_argument, 0, OPT_EXCLUDE_GLOB},
+    {"rules",         required_argument, 0, OPT_RULES},
+    {"metrics-socket", required_argument, 0, OPT_METRICS_SOCKET},
+    {"daemon",        required_argument, 0, OPT_DAEMON},
     {"regex-catch",   required_argument, 0, 'X'}, /* catch a regex */
     {"no-symlink",    no_argument,       0, 'n'},
     {"recursive",     no_argument,       0, 'r'},
     {"verbose",       no_argument,       0, 'v'},
     {"syslog",        no_argument,       0, 'l'},
+    {"log-rate",      required_argument, 0, OPT_LOG_RATE},
+    {"coalesce",      required_argument, 0, OPT_COALESCE},
+    {"coalesce-burst", no_argument,      0, OPT_COALESCE_BURST},
+    {"batch",         no_argument,       0, OPT_BATCH},
+    {"batch-null",    no_argument,       0, OPT_BATCH_NULL},
+    {"max-jobs",      required_argument, 0, OPT_MAX_JOBS},
+    {"skip-unchanged", no_argument,      0, OPT_SKIP_UNCHANGED},
+    {"fingerprint-cache", required_argument, 0, OPT_FINGERPRINT_CACHE},
+    {"scan-threads",  required_argument, 0, OPT_SCAN_THREADS},
+    {"max-watches",   required_argument, 0, OPT_MAX_WATCHES},
+    {"eager-depth",   required_argument, 0, OPT_EAGER_DEPTH},
+    {"sweep-interval", required_argument, 0, OPT_SWEEP_INTERVAL},
+    {"backend",       required_argument, 0, OPT_BACKEND},
+    {"read-buffer",   required_argument, 0, OPT_READ_BUFFER},
+    {"reader-thread", no_argument,       0, OPT_READER_THREAD},
+    {"io-uring",      no_argument,       0, OPT_IO_URING},
+    {"state-file",    required_argument, 0, OPT_STATE_FILE},
+    {"state-interval", required_argument, 0, OPT_STATE_INTERVAL},
     {"version",       no_argument,       0, 'V'},
     {"help",          no_argument,       0, 'h'},
     {0, 0, 0, 0}
@@ -90,6 +145,12 @@ static struct event_t events_lut[] =
     
 };
 
+/* When the events being dispatched were read, 0 for the synthesized ones (see metrics_observe) */
+static uint64_t read_time;
+
+/* The wd_data of the watched directories */
+static SLAB *wd_slab;
+
 void print_version()
 {
     printf("%s %s (%s)\n"
@@ -103,12 +164,14 @@ int help(int error)
 {
     printf("Usage: %s -c COMMAND -d DIRECTORY [-v] [-s] [-options]\n", PROGRAM_NAME);
     printf("   or: %s -F FORMAT  -d DIRECTORY [-v] [-s] [-options]\n", PROGRAM_NAME);
+    printf("   or: %s --daemon SOCKET [-v] [-s] [-options]\n", PROGRAM_NAME);
     printf("   or: %s [-V|--version]\n", PROGRAM_NAME);
     printf("   or: %s [-h|--help]\n\n", PROGRAM_NAME);
     printf("  -c --command COMMAND\n");
     printf("     Execute a user-specified command.\n");
     printf("     Injection of specal special characters is possible\n");
     printf("     (See the TABLE OF SPECIAL CHARACTERS)\n");
+    printf("     The command is executed through /bin/sh only if it uses the shell syntax\n");
     printf("     warn: This option exclude the use of -F option\n\n");
     printf("  -F --format  FORMAT\n");
     printf("     Output in a user-specified format, using printf-like syntax.\n");
@@ -117,14 +180,19 @@ int help(int error)
     printf("     (See the TABLE OF SPECIAL CHARACTERS)\n");
     printf("     warn: This option exclude the use of -c and -v option\n\n");
     printf("  *TABLE OF SPECIAL CHARACTERS*\n\n");
-    printf("       %sr : full path of the root DIRECTORY\n", "%");
+    printf("       %sr : full path of the root DIRECTORY of the event\n", "%");
     printf("       %sp : full path of the file/directory where the event occurs\n", "%");
     printf("       %sf : the name of the file/directory that triggered the event\n", "%");
     printf("       %se : the type of the occured event (the the list below)\n", "%");
     printf("       %sx : the first occurence that match the regex given by -X option\n", "%");
-    printf("       %sn : the number of times the command is executed\n\n", "%");
+    printf("       %sn : the number of times the command is executed\n", "%");
+    printf("            (the number of events folded together with --coalesce)\n");
+    printf("       %so : full path of the file/directory before a rename\n\n", "%");
     printf("  -d  --directory DIRECTORY\n");
-    printf("      The directory to monitor\n\n");
+    printf("      The directory to monitor, it can be given more than once\n\n");
+    printf("  --roots-file FILE\n");
+    printf("      Monitor the directories listed in FILE, one for each line\n");
+    printf("      (the empty lines and the ones starting with # are skipped)\n\n");
     printf("  *LIST OF OTHER OPTIONS*\n\n");
     printf("  -e  --events [event,[event,[,..]]]\n");
     printf("      Specify which type of events to monitor. List of events:\n");
@@ -138,6 +206,7 @@ int help(int error)
     printf("        moved_from       : File was moved out of watched directory.\n");
     printf("        moved_to         : File was moved into watched directory.\n");
     printf("        move             : A file/dir within watched directory was moved\n");
+    printf("                           (moved inside the watched tree, it is a single rename event)\n");
     printf("        create           : A file was created within watched directory\n");
     printf("        delete           : A file was deleted within watched directory\n");
     printf("        delete_self      : The watched file was deleted\n");
@@ -154,16 +223,119 @@ int help(int error)
     printf("      Enable the recursively monitor of the directory\n\n");
     printf("  -x  --exclude <regex>\n");
     printf("      Do not process any events whose filename matches the specified POSIX REGEX\n");
-    printf("      POSIX extended regular expression, case sensitive\n\n");
+    printf("      POSIX extended regular expression, case sensitive\n");
+    printf("      It can be given more than once\n\n");
+    printf("  --exclude-glob <pattern>\n");
+    printf("      Do not process any events whose filename matches the shell wildcard pattern\n");
+    printf("      (like *.swp or node_modules), it can be given more than once\n\n");
+    printf("  --rules FILE\n");
+    printf("      Watch the subtrees listed in FILE for their own events, one rule for each line:\n");
+    printf("        DIRECTORY EVENTS [PATTERN ...]\n");
+    printf("      EVENTS is a list of events as given to -e, \"-\" for the ones of -e\n");
+    printf("      or \"skip\" to not watch the subtree, the names matching the PATTERNs\n");
+    printf("      (see --exclude-glob) are excluded. The deepest DIRECTORY applies.\n\n");
     printf("  -X  --regex-catch <regex>\n");
     printf("      Match the parenthetical <regex> against the filename whose triggered the event,\n");
     printf("      The first matched occurrence will be available as %sx special character\n", "%");
     printf("      Usage note: %s will be triggered only if a match occurs!\n", PROGRAM_NAME);
     printf("      POSIX extended regular expression, case sensitive\n\n");
+    printf("  --coalesce <ms>\n");
+    printf("      Wait <ms> milliseconds after the first event before executing the command,\n");
+    printf("      the events with the same type and path are executed only once\n\n");
+    printf("  --coalesce-burst\n");
+    printf("      With --coalesce, execute the command only once for the whole window,\n");
+    printf("      using the information of its last event\n\n");
+    printf("  --max-jobs N\n");
+    printf("      Do not run more than N commands at the same time, the other ones\n");
+    printf("      wait for a running command to terminate (default: no limit)\n\n");
+    printf("  --skip-unchanged\n");
+    printf("      Do not execute the modify, close_write and attrib events of a file whose\n");
+    printf("      content is the one seen by its last event: the size, mtime and inode of\n");
+    printf("      the files are kept with a hash of their content (XXH64), only computed\n");
+    printf("      when they differ. The first event of a file is always executed, and a\n");
+    printf("      modify event can see the file half written: use it with close_write,\n");
+    printf("      or with --coalesce. The files are read to be hashed: the open, access\n");
+    printf("      and close_nowrite events of the reading are seen by the watchers of\n");
+    printf("      these events, cwatch included\n\n");
+    printf("  --fingerprint-cache N\n");
+    printf("      With --skip-unchanged, the max number of files kept, the least recently\n");
+    printf("      checked ones are forgotten (default: %d)\n\n", FINGERPRINT_CACHE);
+    printf("  --scan-threads N\n");
+    printf("      With -r, traverse the directories to watch at startup using N threads\n");
+    printf("      (default: 1)\n\n");
+    printf("  --max-watches N\n");
+    printf("      With -r, do not use more than N watches. Once they are used, the least\n");
+    printf("      recently active directory is not watched any more: it is watched again\n");
+    printf("      by the activity of its parent, or when a sweep finds it changed\n\n");
+    printf("  --eager-depth N\n");
+    printf("      With -r, watch at startup the directories up to N levels below the roots.\n");
+    printf("      The deeper ones are watched one level at a time, when their parent shows\n");
+    printf("      activity, or when a sweep finds them changed\n\n");
+    printf("  --sweep-interval SECONDS\n");
+    printf("      With --max-watches or --eager-depth, the seconds between the sweeps of the\n");
+    printf("      directories not watched, for the changes of their mtime (default: %d, 0 to\n", SWEEP_INTERVAL);
+    printf("      disable). The directories watched by inotify only (see --backend)\n\n");
+    printf("  --backend inotify|fanotify\n");
+    printf("      The notification backend (default: inotify). fanotify watches the whole\n");
+    printf("      filesystem of the directory without a watch for each directory (Linux >= 5.9,\n");
+    printf("      CAP_SYS_ADMIN): symbolic links are only followed when created while monitoring\n\n");
+    printf("  --read-buffer SIZE\n");
+    printf("      The size of the buffer the events are read into, with an optional K or M suffix\n");
+    printf("      (default: %luK). The events read are handled together, a larger buffer\n", (unsigned long) (EVENT_BUF_LEN / 1024));
+    printf("      gives larger batches and fewer overflows of the kernel queue during storms\n\n");
+    printf("  --reader-thread\n");
+    printf("      Read the kernel queue on a dedicated thread, into a ring of %d buffers\n", READER_CHUNKS);
+    printf("      (see --read-buffer): the queue is read while the events are handled and\n");
+    printf("      the commands executed. With the inotify backend only\n\n");
+    printf("  --io-uring\n");
+    printf("      Probe the entries of the directories to watch in batches of %d operations\n", URING_ENTRIES);
+    printf("      with io_uring (statx and openat, Linux >= 5.6), relative to the directory,\n");
+    printf("      instead of one after another: useful on network filesystems, where each\n");
+    printf("      one is a round trip. Not used by --scan-threads\n\n");
+    printf("  --state-file FILE\n");
+    printf("      Save the watched directories into FILE when terminating and periodically,\n");
+    printf("      and restore them at startup without reading the unchanged directories.\n");
+    printf("      The changes made while %s was not running are reported as events\n\n", PROGRAM_NAME);
+    printf("  --state-interval SECONDS\n");
+    printf("      With --state-file, the seconds between the saves (default: %d, 0 to disable)\n\n", STATE_INTERVAL);
+    printf("  --batch\n");
+    printf("      Start the COMMAND only once and write a record to its standard input\n");
+    printf("      for each event. The record is defined by -F FORMAT (default: \"%se %sp%sf\")\n", "%", "%", "%");
+    printf("      and the records read together are written at once\n\n");
+    printf("  --batch-null\n");
+    printf("      With --batch, terminate the records with a NUL character instead of a newline\n\n");
+    printf("  --output text|jsonl|nul|binary\n");
+    printf("      The encoding of the records written to the standard output, instead\n");
+    printf("      of -F FORMAT. Each record has the root, the path, the name, the event,\n");
+    printf("      the old path of a rename (in JSON only for a rename), the cookie,\n");
+    printf("      the count of events folded and the time: a JSON object per\n");
+    printf("      line, each field terminated by a NUL character, or a binary header\n");
+    printf("      followed by the strings (see src/output.h)\n\n");
+    printf("  --output-flush MS\n");
+    printf("      The max milliseconds the records are kept before being written at once\n");
+    printf("      (default: 0, written once the events read are handled)\n\n");
+    printf("  --metrics-socket PATH\n");
+    printf("      Collect the counters and the latency histograms of cwatch, served in the\n");
+    printf("      Prometheus text format to each connection to the UNIX socket PATH,\n");
+    printf("      and written to the standard error on SIGUSR1\n\n");
+    printf("  --daemon SOCKET\n");
+    printf("      Serve the watch specs added at runtime through the UNIX socket SOCKET,\n");
+    printf("      instead of -d, -c and -F. Each line written to it is a request:\n");
+    printf("        add root=DIRECTORY [events=EVENTS] [exclude=REGEX ...] command=COMMAND\n");
+    printf("        add root=DIRECTORY [events=EVENTS] [exclude=REGEX ...] format=FORMAT\n");
+    printf("        remove ID\n");
+    printf("        list\n");
+    printf("      answered by \"ok [ID]\" or \"error MESSAGE\". The COMMAND (executed through\n");
+    printf("      /bin/sh) or the FORMAT takes the rest of the line. The directories are\n");
+    printf("      watched once for all the specs, each event is executed for the specs\n");
+    printf("      whose DIRECTORY, EVENTS (default: the ones of -e) and REGEXes match it\n\n");
     printf("  -v  --verbose\n");
     printf("      Verbose mode\n\n");
     printf("  -s  --syslog\n");
     printf("      Verbose mode through syslog\n\n");
+    printf("  --log-rate N\n");
+    printf("      The max number of log messages per second, the others are dropped\n");
+    printf("      and counted (default: %d, 0 for no limit)\n\n", LOG_RATE);
     printf("  -h  --help\n");
     printf("      Print this help and exit\n\n");
     printf("  -V  --version\n");
@@ -178,29 +350,47 @@ int help(int error)
     return 0;
 }
 
-void log_message(char *message)
+void log_message(const char *message_format, ...)
 {
-    if (verbose_flag && (NULL == format)) {
+    bool_t to_stdout = (verbose_flag && (NULL == format || batch_flag)) ? TRUE : FALSE;
+    
+    if (to_stdout == FALSE && syslog_flag == FALSE)
+        return;
+
+    char message[LOG_MESSAGE_LEN];
+    va_list arguments;
+
+    /* Queued to the logger thread, once it is started (see logger_start) */
+    va_start(arguments, message_format);
+    int queued = logger_vwrite(message_format, arguments);
+    va_end(arguments);
+
+    if (queued == 0)
+        return;
+
+    va_start(arguments, message_format);
+    vsnprintf(message, LOG_MESSAGE_LEN, message_format, arguments);
+    va_end(arguments);
+    
+    if (to_stdout) {
         printf("%s\n", message);
     }
     
     if (syslog_flag) {
         openlog(PROGRAM_NAME, LOG_PID, LOG_LOCAL1);
-        syslog(LOG_INFO, message);
+        syslog(LOG_INFO, "%s", message);
         closelog();
     }
-    
-    free(message);
 }
 
 char *resolve_real_path(const char *path)
 {
-    char *resolved = malloc(MAXPATHLEN + 1);
-    
-    realpath(path, resolved);
+    char *resolved = malloc(MAXPATHLEN + 2);
     
-    if (resolved == NULL)
+    if (resolved == NULL || realpath(path, resolved) == NULL) {
+        free(resolved);
         return NULL;
+    }
     
     strcat(resolved, "/");
      
@@ -209,66 +399,77 @@ char *resolve_real_path(const char *path)
 
 LIST_NODE *get_node_from_path(const char *path)
 {
-    LIST_NODE *node = list_wd->first;
-    while (node) {
-        WD_DATA *wd_data = (WD_DATA *) node->data;
-        if (strcmp(path, wd_data->path) == 0)
-            return node;
-        node = node->next;
-    }
-    
-    return NULL;
+    TRIE_NODE *trie_node = trie_find(wd_tree, path);
+
+    return (trie_node != NULL) ? (LIST_NODE *) trie_node->data : NULL;
 }
 
 LIST_NODE *get_node_from_wd(const int wd)
 {
-    LIST_NODE *node = list_wd->first;
-    while (node) {
-        WD_DATA *wd_data = (WD_DATA *) node->data;
-        if (wd == wd_data->wd)
-            return node;
-        node = node->next;    
-    }
-    
-    return NULL;
+    return (LIST_NODE *) hash_get(wd_index, &wd);
 }
 
-WD_DATA *create_wd_data(char *real_path, int wd)
+WD_DATA *create_wd_data(const char *real_path, int wd)
 {
-    WD_DATA *wd_data = malloc(sizeof(WD_DATA));
+    if (wd_slab == NULL && (wd_slab = slab_init(sizeof(WD_DATA), WD_SLAB_CHUNK)) == NULL)
+        return NULL;
+
+    WD_DATA *wd_data = (WD_DATA *) slab_alloc(wd_slab);
     if (wd_data == NULL)
         return NULL;
     
+    wd_data->node.data = (void *) wd_data;
     wd_data->wd = wd;
-    wd_data->path = real_path;
-    wd_data->links = list_init();
+    wd_data->entry = NULL;
+    wd_data->links = NULL;
+    wd_data->owned = NULL;
+    wd_data->refs = 0;
+    wd_data->flags = 0;
+    wd_data->root = get_root_of(real_path);
+    wd_data->rule = NULL;
+    wd_data->mask = event_mask;
+    snapshot_wd_data(wd_data, real_path);
 
     return wd_data;
 }
 
-LIST_NODE *get_link_node_from_path(const char *symlink)
+char *get_wd_path(const WD_DATA *wd_data, char *buffer)
 {
-    LIST_NODE *node = list_wd->first;
-    WD_DATA *wd_data;
-    LIST_NODE *link_node;
-    LINK_DATA *link_data;
-    
-    while (node) {
-        wd_data = (WD_DATA*) node->data;
-        
-        link_node = wd_data->links->first;
-        while (link_node) {
-            link_data = (LINK_DATA*) link_node->data;
-                
-            if (strcmp(link_data->path, symlink) == 0) {
-                return link_node;
-            }
-            link_node = link_node->next;
-        }
-        node = node->next;
+    if (wd_data->entry == NULL || trie_path(wd_data->entry, buffer, MAXPATHLEN + 1) == 0)
+        buffer[0] = '\0';
+
+    return buffer;
+}
+
+void snapshot_wd_data(WD_DATA *wd_data, const char *real_path)
+{
+    struct stat st;
+
+    clock_gettime(CLOCK_REALTIME, &wd_data->synced);
+
+    if (stat(real_path, &st) == 0) {
+        wd_data->ino = st.st_ino;
+        wd_data->nlink = st.st_nlink;
+        wd_data->mtime = st.st_mtim;
+    } else {
+        wd_data->ino = 0;
+        wd_data->nlink = 0;
+        wd_data->mtime.tv_sec = wd_data->mtime.tv_nsec = 0;
     }
-    
-    return NULL;
+}
+
+int timespec_compare(const struct timespec *a, const struct timespec *b)
+{
+    if (a->tv_sec != b->tv_sec)
+        return (a->tv_sec < b->tv_sec) ? -1 : 1;
+    if (a->tv_nsec != b->tv_nsec)
+        return (a->tv_nsec < b->tv_nsec) ? -1 : 1;
+    return 0;
+}
+
+LIST_NODE *get_link_node_from_path(const char *symlink)
+{
+    return (LIST_NODE *) hash_get(link_index, symlink);
 }
 
 LINK_DATA *get_link_data_from_wd_data(const char *symlink, const WD_DATA *wd_data)
@@ -276,40 +477,22 @@ LINK_DATA *get_link_data_from_wd_data(const char *symlink, const WD_DATA *wd_dat
     if (NULL == wd_data)
         return NULL;
     
-    LIST_NODE *link_node;
-    LINK_DATA *link_data;
- 
-    link_node = wd_data->links->first;
-    while (link_node) {
-        link_data = (LINK_DATA*) link_node->data;
-
-        if (strcmp(link_data->path, symlink) == 0) {
-            return link_data;
-        }
-        link_node = link_node->next;
-    }
+    LINK_DATA *link_data = get_link_data_from_path(symlink);
+
+    if (link_data != NULL && link_data->wd_data == wd_data)
+        return link_data;
     
     return NULL;
 }
 
 LINK_DATA *get_link_data_from_path(const char *symlink)
 {
-    LIST_NODE *node = list_wd->first;
-    WD_DATA *wd_data;
-    LINK_DATA *link_data;
-    
-    while (node) {
-        wd_data = (WD_DATA*) node->data;
-        
-        link_data = get_link_data_from_wd_data(symlink, wd_data);
+    LIST_NODE *link_node = get_link_node_from_path(symlink);
 
-        if (link_data != NULL) {
-            return link_data;
-        }
-        node = node->next;
-    }
+    if (link_node == NULL)
+        return NULL;
     
-    return NULL;
+    return (LINK_DATA *) link_node->data;
 }
 
 LINK_DATA *create_link_data(char *symlink, WD_DATA *wd_data)
@@ -321,6 +504,28 @@ LINK_DATA *create_link_data(char *symlink, WD_DATA *wd_data)
     
     link_data->path = symlink;
     link_data->wd_data = wd_data;
+    link_data->node = NULL;
+    link_data->owner = NULL;
+    link_data->owned.data = (void *) link_data;
+
+    /* The directory containing it releases the link when it is unwatched */
+    char owner_path[MAXPATHLEN + 1];
+    char *slash = strrchr(symlink, '/');
+    size_t owner_len = (slash != NULL) ? (size_t) (slash - symlink) + 1 : 0;
+
+    if (owner_len > 0 && owner_len <= MAXPATHLEN) {
+        memcpy(owner_path, symlink, owner_len);
+        owner_path[owner_len] = '\0';
+
+        LIST_NODE *owner_node = get_node_from_path(owner_path);
+        if (owner_node != NULL) {
+            link_data->owner = (WD_DATA *) owner_node->data;
+
+            if (link_data->owner->owned == NULL)
+                link_data->owner->owned = list_init();
+            list_link(link_data->owner->owned, &link_data->owned);
+        }
+    }
 
     return link_data;
 }
@@ -337,6 +542,81 @@ bool_t is_child_of(const char *child, const char *parent)
     return (strncmp(child, parent, strlen(parent)) == 0) ? TRUE : FALSE;
 }
 
+char *resolve_root(const char *directory)
+{
+    size_t len = strlen(directory);
+    char *path = (char *) malloc(len + 2);
+    strcpy(path, directory);
+
+    /* Check if the path has the ending slash */
+    if (len > 0 && path[len - 1] != '/')
+        strcat(path, "/");
+
+    /* Check if it is a valid directory */
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        free(path);
+        return NULL;
+    }
+    closedir(dir);
+
+    /* Check if the path is absolute or not */
+    if (path[0] != '/') {
+        char *real_path = resolve_real_path(path);
+        free(path);
+        path = real_path;
+    }
+
+    return path;
+}
+
+int add_root(const char *directory)
+{
+    char *path = resolve_root(directory);
+    if (path == NULL)
+        return -1;
+
+    if (is_root(path) == TRUE) {
+        free(path);
+        return 0;
+    }
+
+    root_paths = (char **) realloc(root_paths, (roots_qty + 1) * sizeof(char *));
+    root_paths[roots_qty++] = path;
+
+    return 0;
+}
+
+char *get_root_of(const char *path)
+{
+    char *root = NULL;
+    size_t root_len = 0;
+    unsigned int i;
+
+    /* The roots could be nested, the deepest one is taken */
+    for (i = 0; i < roots_qty; ++i) {
+        size_t len = strlen(root_paths[i]);
+        if (len > root_len && strncmp(path, root_paths[i], len) == 0) {
+            root = root_paths[i];
+            root_len = len;
+        }
+    }
+
+    return root;
+}
+
+bool_t is_root(const char *path)
+{
+    unsigned int i;
+
+    for (i = 0; i < roots_qty; ++i) {
+        if (strcmp(path, root_paths[i]) == 0)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
 bool_t exists(char* child_path, LIST *parents)
 {
     if (parents == NULL || parents->first == NULL)
@@ -355,13 +635,7 @@ bool_t exists(char* child_path, LIST *parents)
 
 bool_t excluded(char *str)
 {
-    if (NULL == exclude_regex)
-        return FALSE;
-    
-    if (regexec(exclude_regex, str, 0, NULL, 0) == 0)
-        return TRUE;
-
-    return FALSE;
+    return (exclude_match(exclude_patterns, str) == 1) ? TRUE : FALSE;
 }
 
 bool_t regex_catch(char *str)
@@ -369,54 +643,290 @@ bool_t regex_catch(char *str)
     if (NULL == user_catch_regex)
         return TRUE;
     
-    if (regexec(user_catch_regex, str, 2, p_match, 0) == 0)
+    /* The subexpression is only needed when the command uses %x (or a spec of --daemon) */
+    size_t nmatch = (NULL == command_template || command_template->uses_regex == TRUE) ? 2 : 0;
+
+    if (regexec(user_catch_regex, str, nmatch, p_match, 0) == 0)
         return TRUE;
 
     return FALSE;
 }
 
-char *get_regex_catch(char *str)
+TEMPLATE *compile_template(const char *str)
 {
-    if (p_match[1].rm_so == -1)
+    TEMPLATE *template = (TEMPLATE *) malloc(sizeof(TEMPLATE));
+    if (template == NULL)
         return NULL;
 
-    int length = p_match[1].rm_eo - p_match[1].rm_so;
-    char *substr = (char *) malloc(length + 1);
-    
-    strncpy(substr, str + p_match[1].rm_so, length);
-    substr[length] = '\0';
+    /* There are at most two segments for each special character, plus one */
+    template->segments = (SEGMENT *) malloc((strlen(str) + 1) * sizeof(SEGMENT));
+    if (template->segments == NULL) {
+        free(template);
+        return NULL;
+    }
+    template->qty = 0;
+    template->uses_regex = FALSE;
+
+    const char *literal = str;
+    const char *c;
     
-    return substr;
+    for (c = str; *c != '\0'; ++c) {
+        segment_t kind;
+        
+        if (*c != '%')
+            continue;
+
+        switch (c[1]) {
+        case 'r': kind = SEGMENT_ROOT;  break;
+        case 'p': kind = SEGMENT_PATH;  break;
+        case 'f': kind = SEGMENT_FILE;  break;
+        case 'e': kind = SEGMENT_EVENT; break;
+        case 'x': kind = SEGMENT_REGEX; break;
+        case 'n': kind = SEGMENT_COUNT; break;
+        case 'o': kind = SEGMENT_OLD;   break;
+        default:  continue;
+        }
+
+        if (c > literal) {
+            SEGMENT *segment = &template->segments[template->qty++];
+            segment->kind = SEGMENT_LITERAL;
+            segment->data = (char *) literal;
+            segment->length = c - literal;
+        }
+
+        SEGMENT *segment = &template->segments[template->qty++];
+        segment->kind = kind;
+        segment->data = NULL;
+        segment->length = 0;
+
+        if (kind == SEGMENT_REGEX)
+            template->uses_regex = TRUE;
+
+        literal = ++c + 1;
+    }
+
+    if (c > literal) {
+        SEGMENT *segment = &template->segments[template->qty++];
+        segment->kind = SEGMENT_LITERAL;
+        segment->data = (char *) literal;
+        segment->length = c - literal;
+    }
+
+    return template;
 }
 
-bstring format_command(char *command_format, char *event_p_path, char *file_name, char *event_name)
+bstring format_command(const TEMPLATE *template, char *event_p_path, char *file_name, char *event_name)
 {
-    tmp_command = bfromcstr(command_format);
-    bfindreplace(tmp_command, COMMAND_PATTERN_ROOT, bfromcstr(root_path), 0);
-    bfindreplace(tmp_command, COMMAND_PATTERN_PATH, bfromcstr(event_p_path), 0);
-    bfindreplace(tmp_command, COMMAND_PATTERN_FILE, bfromcstr(file_name), 0);
-    bfindreplace(tmp_command, COMMAND_PATTERN_EVENT, bfromcstr(event_name), 0);
-    bfindreplace(tmp_command, COMMAND_PATTERN_REGEX, bfromcstr(get_regex_catch(file_name)), 0);
-    bfindreplace(tmp_command, COMMAND_PATTERN_COUNT, bfromcstr(exec_cstr), 0);
+    if (NULL == tmp_command)
+        tmp_command = bfromcstralloc(MAXPATHLEN, "");
+    else
+        btrunc(tmp_command, 0);
+
+    int i;
+    for (i = 0; i < template->qty; ++i) {
+        const SEGMENT *segment = &template->segments[i];
+
+        switch (segment->kind) {
+        case SEGMENT_LITERAL:
+            bcatblk(tmp_command, segment->data, segment->length);
+            break;
+        case SEGMENT_ROOT:
+            if (event_root != NULL)
+                bcatcstr(tmp_command, event_root);
+            break;
+        case SEGMENT_PATH:
+            bcatcstr(tmp_command, event_p_path);
+            break;
+        case SEGMENT_FILE:
+            bcatcstr(tmp_command, file_name);
+            break;
+        case SEGMENT_EVENT:
+            bcatcstr(tmp_command, event_name);
+            break;
+        case SEGMENT_REGEX:
+            /* The subexpression matched by the last regex_catch() */
+            if (NULL != user_catch_regex && p_match[1].rm_so != -1)
+                bcatblk(tmp_command, file_name + p_match[1].rm_so, p_match[1].rm_eo - p_match[1].rm_so);
+            break;
+        case SEGMENT_COUNT:
+            bcatcstr(tmp_command, exec_cstr);
+            break;
+        case SEGMENT_OLD:
+            if (event_old_path != NULL)
+                bcatcstr(tmp_command, event_old_path);
+            break;
+        }
+    }
 
     return tmp_command;
 }
 
+/* Parse a size with an optional K or M suffix, 0 if it is not valid */
+static size_t parse_size(const char *str)
+{
+    char *end = NULL;
+    unsigned long size = strtoul(str, &end, 10);
+
+    if (end == str)
+        return 0;
+
+    if (*end == 'K' || *end == 'k') {
+        size *= 1024;
+        ++end;
+    } else if (*end == 'M' || *end == 'm') {
+        size *= 1024 * 1024;
+        ++end;
+    }
+
+    return (*end == '\0') ? (size_t) size : 0;
+}
+
+/* Add the root paths listed in a file (see --roots-file), -1 in case of error */
+static int parse_roots_file(const char *file)
+{
+    FILE *roots_file = fopen(file, "r");
+    if (roots_file == NULL)
+        return -1;
+
+    char line[MAXPATHLEN + 2];
+    int result = 0;
+
+    while (result == 0 && fgets(line, sizeof(line), roots_file) != NULL) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = '\0';
+
+        if (len == 0 || line[0] == '#')
+            continue;
+
+        result = add_root(line);
+    }
+
+    fclose(roots_file);
+
+    return result;
+}
+
+/*
+ * Split a command in its arguments if it can be executed without the shell,
+ * returns NULL if it uses some shell syntax.
+ */
+static struct bstrList *split_command(const_bstring cmd)
+{
+    /* Shell metacharacters */
+    if (strpbrk((char *) cmd->data, "|&;<>()$`\\\"'*?[]{}#~!\n") != NULL)
+        return NULL;
+
+    static struct tagbstring whitespaces = bsStatic(" \t");
+    struct bstrList *arguments = bsplits(cmd, &whitespaces);
+    if (arguments == NULL)
+        return NULL;
+
+    /* Drop the empty arguments left by consecutive whitespaces */
+    int i, qty = 0;
+    for (i = 0; i < arguments->qty; ++i) {
+        if (blength(arguments->entry[i]) == 0)
+            bdestroy(arguments->entry[i]);
+        else
+            arguments->entry[qty++] = arguments->entry[i];
+    }
+    arguments->qty = qty;
+
+    /* Variable assignments and builtins need the shell too */
+    static const char *builtins[] = {
+        "cd", "export", "exit", "exec", "eval", "source", ".", "set", "unset",
+        "alias", "if", "for", "while", "until", "case", "ulimit", "umask", NULL
+    };
+
+    bool_t shell = (qty == 0 || strchr((char *) arguments->entry[0]->data, '=') != NULL) ? TRUE : FALSE;
+    for (i = 0; shell == FALSE && builtins[i] != NULL; ++i) {
+        if (strcmp((char *) arguments->entry[0]->data, builtins[i]) == 0)
+            shell = TRUE;
+    }
+
+    if (shell == TRUE) {
+        bstrListDestroy(arguments);
+        return NULL;
+    }
+
+    return arguments;
+}
+
+uint32_t parse_events(const char *list)
+{
+    struct bstrList *events = bsplit(bfromcstr(list), ',');
+    uint32_t mask = 0;
+
+    if (events == NULL)
+        return 0;
+
+    int i;
+    for (i = 0; i < events->qty; ++i) {
+        if (bstrcmp(events->entry[i], bfromcstr("access")) == 0) {
+            mask |= IN_ACCESS;
+        } else if (bstrcmp(events->entry[i], bfromcstr("modify")) == 0) {
+            mask |= IN_MODIFY;
+        } else if (bstrcmp(events->entry[i], bfromcstr("attrib")) == 0) {
+            mask |= IN_ATTRIB;
+        } else if (bstrcmp(events->entry[i], bfromcstr("close_write")) == 0) {
+            mask |= IN_CLOSE_WRITE;
+        } else if (bstrcmp(events->entry[i], bfromcstr("close_nowrite")) == 0) {
+            mask |= IN_CLOSE_NOWRITE;
+        } else if (bstrcmp(events->entry[i], bfromcstr("close")) == 0) {
+            mask |= IN_CLOSE;
+        } else if (bstrcmp(events->entry[i], bfromcstr("open")) == 0) {
+            mask |= IN_OPEN;
+        } else if (bstrcmp(events->entry[i], bfromcstr("moved_from")) == 0) {
+            mask |= IN_MOVED_FROM;
+        } else if (bstrcmp(events->entry[i], bfromcstr("moved_to")) == 0) {
+            mask |= IN_MOVED_TO;
+        } else if (bstrcmp(events->entry[i], bfromcstr("move")) == 0) {
+            mask |= IN_MOVE;
+        } else if (bstrcmp(events->entry[i], bfromcstr("create")) == 0) {
+            mask |= IN_CREATE;
+        } else if (bstrcmp(events->entry[i], bfromcstr("delete")) == 0) {
+            mask |= IN_DELETE;
+        } else if (bstrcmp(events->entry[i], bfromcstr("delete_self")) == 0) {
+            mask |= IN_DELETE_SELF;
+        } else if (bstrcmp(events->entry[i], bfromcstr("unmount")) == 0) {
+            mask |= IN_UNMOUNT;
+        } else if (bstrcmp(events->entry[i], bfromcstr("q_overflow")) == 0) {
+            mask |= IN_Q_OVERFLOW;
+        } else if (bstrcmp(events->entry[i], bfromcstr("ignored")) == 0) {
+            mask |= IN_IGNORED;
+        } else if (bstrcmp(events->entry[i], bfromcstr("isdir")) == 0) {
+            mask |= IN_ISDIR;
+        } else if (bstrcmp(events->entry[i], bfromcstr("oneshot")) == 0) {
+            mask |= IN_ONESHOT;
+        } else if (bstrcmp(events->entry[i], bfromcstr("all_events")) == 0) {
+            mask |= IN_ALL_EVENTS;
+        } else if (bstrcmp(events->entry[i], bfromcstr("default")) == 0) {
+            mask |= IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVE;
+        } else {
+            mask = 0;
+            break;
+        }
+    }
+
+    bstrListDestroy(events);
+
+    return mask;
+}
+
 int parse_command_line(int argc, char *argv[])
 {
     if (argc == 1) {
         help(1);
     }
     
+    /* The patterns of -x and --exclude-glob options */
+    exclude_patterns = exclude_init();
+
     /* Handle command line options */
     /* TODO: Refactor the parse command line */
     int c;
     while ((c = getopt_long(argc, argv, "svnrVhe:c:F:d:x:X:", long_options, NULL)) != -1) {
         switch (c) {
         case 'c': /* --command */
-            if (NULL != format)
-                help(1);
-            
             if (optarg == NULL
                 || strcmp(optarg, "") == 0
                 || (command = bfromcstr(optarg)) == NULL)
@@ -433,9 +943,6 @@ int parse_command_line(int argc, char *argv[])
             break;
             
         case 'F': /* --format */
-            if (NULL != command)
-                help(1);
-
             format = bfromcstr(optarg);
 
             /* The command will be executed in embedded mode */
@@ -444,102 +951,38 @@ int parse_command_line(int argc, char *argv[])
             break;
             
         case 'd': /* --directory */
-            if (NULL == optarg || strcmp(optarg, "") == 0)
-                help(1);
-            
-            /* Check if the path has the ending slash */
-            if (optarg[strlen(optarg)-1] != '/') {
-                root_path = (char *) malloc(strlen(optarg) + 2);
-                strcpy(root_path, optarg);
-                strcat(root_path, "/");
-            } else {
-                root_path = (char *) malloc(strlen(optarg) + 1);
-                strcpy(root_path, optarg);
-            }
-            
-            /* Check if it is a valid directory */
-            DIR *dir = opendir(root_path);
-            if (dir == NULL) {
+            if (NULL == optarg || strcmp(optarg, "") == 0 || add_root(optarg) == -1)
                 help(1);
-            }
-            closedir(dir);
             
-            /* Check if the path is absolute or not */
-            /* TODO Dealloc after keyboard Ctrl+C interrupt */
-            if (root_path[0] != '/') {
-                char *real_path = resolve_real_path(root_path);
-                free(root_path);
-                root_path = real_path;
+            break;
+
+        case OPT_ROOTS_FILE: /* --roots-file */
+            if (parse_roots_file(optarg) == -1) {
+                help(0);
+                printf("\nUnable to monitor the directories listed in \"%s\".\n", optarg);
+                exit(1);
             }
-            
+
             break;
         
         case 'e': /* --events */
+        {
             /* Set inotify events mask */
-            split_event = bsplit(bfromcstr(optarg), ',');
-            
-            if (split_event != NULL) {
-                int i;
-                for (i = 0; i < split_event->qty; ++i) {
-                    if (bstrcmp(split_event->entry[i], bfromcstr("access")) == 0) {
-                        event_mask |= IN_ACCESS;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("modify")) == 0) {
-                        event_mask |= IN_MODIFY;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("attrib")) == 0) {
-                        event_mask |= IN_ATTRIB;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("close_write")) == 0) {
-                        event_mask |= IN_CLOSE_WRITE;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("close_nowrite")) == 0) {
-                        event_mask |= IN_CLOSE_NOWRITE;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("close")) == 0) {
-                        event_mask |= IN_CLOSE;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("open")) == 0) {
-                        event_mask |= IN_OPEN;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("moved_from")) == 0) {
-                        event_mask |= IN_MOVED_FROM;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("moved_to")) == 0) {
-                        event_mask |= IN_MOVED_TO;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("move")) == 0) {
-                        event_mask |= IN_MOVE;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("create")) == 0) {
-                        event_mask |= IN_CREATE;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("delete")) == 0) {
-                        event_mask |= IN_DELETE;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("delete_self")) == 0) {
-                        event_mask |= IN_DELETE_SELF;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("unmount")) == 0) {
-                        event_mask |= IN_UNMOUNT;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("q_overflow")) == 0) {
-                        event_mask |= IN_Q_OVERFLOW;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("ignored")) == 0) {
-                        event_mask |= IN_IGNORED;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("isdir")) == 0) {
-                        event_mask |= IN_ISDIR;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("oneshot")) == 0) {
-                        event_mask |= IN_ONESHOT;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("all_events")) == 0) {
-                        event_mask |= IN_ALL_EVENTS;
-                    } else if (bstrcmp(split_event->entry[i], bfromcstr("default")) == 0) {
-                        event_mask |= IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVE;
-                    } else {
-                        help(0);
-                        printf("\nUnrecognized event or malformed list of events! Please see the help.\n");
-                        exit(1);
-                    }
-                }
-
-                bstrListDestroy(split_event);
+            uint32_t mask = parse_events(optarg);
+            if (mask == 0) {
+                help(0);
+                printf("\nUnrecognized event or malformed list of events! Please see the help.\n");
+                exit(1);
             }
+            event_mask |= mask;
             break;
+        }
 
         case 'x': /* --exclude */
             if (optarg == NULL)
                 help(1);
             
-            exclude_regex = (regex_t *) malloc(sizeof(regex_t));
-            
-            if (regcomp(exclude_regex, optarg, REG_EXTENDED | REG_NOSUB) != 0) {
-                free(exclude_regex);
+            if (exclude_add_regex(exclude_patterns, optarg) == -1) {
                 help(0);
                 printf("\nThe specified regular expression provided for the -x --exclude option, is not valid.\n");
                 exit(1);
@@ -547,6 +990,39 @@ int parse_command_line(int argc, char *argv[])
             
             break;
             
+        case OPT_METRICS_SOCKET: /* --metrics-socket */
+            metrics_socket = optarg;
+            metrics_enabled = 1;
+            break;
+
+        case OPT_DAEMON: /* --daemon */
+            daemon_socket = optarg;
+            break;
+
+        case OPT_RULES: /* --rules */
+        {
+            int line = rules_load(optarg);
+            if (line != 0) {
+                help(0);
+                if (line == -1)
+                    printf("\nUnable to read the rules file \"%s\".\n", optarg);
+                else
+                    printf("\nThe rule at line %d of \"%s\", is not valid.\n", line, optarg);
+                exit(1);
+            }
+
+            break;
+        }
+
+        case OPT_EXCLUDE_GLOB: /* --exclude-glob */
+            if (exclude_add_glob(exclude_patterns, optarg) == -1) {
+                help(0);
+                printf("\nThe specified pattern provided for the --exclude-glob option, is not valid.\n");
+                exit(1);
+            }
+
+            break;
+            
         case 'X': /* --regex-catch */
             if (optarg == NULL)
                 help(1);
@@ -577,46 +1053,391 @@ int parse_command_line(int argc, char *argv[])
         case 's': /* --syslog */
             syslog_flag = TRUE;
             break;
+
+        case OPT_COALESCE: /* --coalesce */
+        {
+            char *end = NULL;
+            unsigned long ms = strtoul(optarg, &end, 10);
             
-        case 'V': /* --version */
-            print_version();
-            exit(0);
+            if (end == optarg || *end != '\0' || ms == 0 || ms > 3600000) {
+                help(0);
+                printf("\nThe window given to the --coalesce option, is not valid.\n");
+                exit(1);
+            }
+            coalesce_ms = (unsigned int) ms;
             
-        case 'h': /* --help */
-                
-        default:
-            help(0);
-            exit(0);
+            break;
         }
-    }
-    
-    if (root_path == NULL || command == format) {
-        help(1);
-    }
 
-    if (event_mask == 0) {
-        event_mask = IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVE;
-    }
-    
-    return 0;
-}
+        case OPT_COALESCE_BURST: /* --coalesce-burst */
+            coalesce_burst_flag = TRUE;
+            break;
 
-int watch(char *real_path, char *symlink)
-{   
-    /* Add initial path to the watch list */
-    LIST_NODE *node = add_to_watch_list(real_path, symlink);
-    if (node == NULL)
-        return -1;
-    
-    /* Temporary list to perform a BFS directory traversing */
-    LIST *list = list_init();
-    list_push(list, (void *) real_path);
-    
-    DIR *dir_stream;
-    struct dirent *dir;
-    
-    while (list->first != NULL) {
-        /* Directory to watch */
+        case OPT_MAX_JOBS: /* --max-jobs */
+        {
+            char *end = NULL;
+            unsigned long jobs = strtoul(optarg, &end, 10);
+            
+            if (end == optarg || *end != '\0' || jobs == 0 || jobs > 65536) {
+                help(0);
+                printf("\nThe number given to the --max-jobs option, is not valid.\n");
+                exit(1);
+            }
+            max_jobs = (unsigned int) jobs;
+            
+            break;
+        }
+
+        case OPT_SKIP_UNCHANGED: /* --skip-unchanged */
+            skip_unchanged_flag = TRUE;
+            break;
+
+        case OPT_FINGERPRINT_CACHE: /* --fingerprint-cache */
+        {
+            char *end = NULL;
+            unsigned long files = strtoul(optarg, &end, 10);
+
+            if (end == optarg || *end != '\0' || files == 0) {
+                help(0);
+                printf("\nThe number given to the --fingerprint-cache option, is not valid.\n");
+                exit(1);
+            }
+            fingerprint_cache_size = (size_t) files;
+
+            break;
+        }
+
+        case OPT_SCAN_THREADS: /* --scan-threads */
+        {
+            char *end = NULL;
+            unsigned long threads = strtoul(optarg, &end, 10);
+            
+            if (end == optarg || *end != '\0' || threads == 0 || threads > 256) {
+                help(0);
+                printf("\nThe number given to the --scan-threads option, is not valid.\n");
+                exit(1);
+            }
+            scan_threads = (unsigned int) threads;
+            
+            break;
+        }
+
+        case OPT_MAX_WATCHES: /* --max-watches */
+        {
+            char *end = NULL;
+            unsigned long watches = strtoul(optarg, &end, 10);
+            
+            if (end == optarg || *end != '\0' || watches == 0) {
+                help(0);
+                printf("\nThe number given to the --max-watches option, is not valid.\n");
+                exit(1);
+            }
+            max_watches = (size_t) watches;
+            
+            break;
+        }
+
+        case OPT_EAGER_DEPTH: /* --eager-depth */
+        {
+            char *end = NULL;
+            unsigned long depth = strtoul(optarg, &end, 10);
+            
+            if (end == optarg || *end != '\0' || depth > MAXPATHLEN / 2) {
+                help(0);
+                printf("\nThe number given to the --eager-depth option, is not valid.\n");
+                exit(1);
+            }
+            eager_depth = (unsigned int) depth;
+            eager_depth_set = TRUE;
+            
+            break;
+        }
+
+        case OPT_SWEEP_INTERVAL: /* --sweep-interval */
+        {
+            char *end = NULL;
+            unsigned long seconds = strtoul(optarg, &end, 10);
+            
+            if (end == optarg || *end != '\0' || seconds > 86400) {
+                help(0);
+                printf("\nThe number given to the --sweep-interval option, is not valid.\n");
+                exit(1);
+            }
+            sweep_interval = (unsigned int) seconds;
+            sweep_interval_set = TRUE;
+            
+            break;
+        }
+
+        case OPT_READ_BUFFER: /* --read-buffer */
+            read_buffer_len = parse_size(optarg);
+            
+            if (read_buffer_len < EVENT_READ_MIN || read_buffer_len > READ_BUFFER_MAX) {
+                help(0);
+                printf("\nThe size given to the --read-buffer option, is not valid.\n");
+                exit(1);
+            }
+            
+            break;
+
+        case OPT_READER_THREAD: /* --reader-thread */
+            reader_flag = TRUE;
+            break;
+
+        case OPT_IO_URING: /* --io-uring */
+            uring_flag = TRUE;
+            break;
+
+        case OPT_STATE_FILE: /* --state-file */
+            state_file = optarg;
+            break;
+
+        case OPT_STATE_INTERVAL: /* --state-interval */
+        {
+            char *end = NULL;
+            unsigned long seconds = strtoul(optarg, &end, 10);
+            
+            if (end == optarg || *end != '\0' || seconds > 86400) {
+                help(0);
+                printf("\nThe number given to the --state-interval option, is not valid.\n");
+                exit(1);
+            }
+            state_interval = (unsigned int) seconds;
+            state_interval_set = TRUE;
+            
+            break;
+        }
+
+        case OPT_OUTPUT: /* --output */
+        {
+            int mode = get_output_mode(optarg);
+            
+            if (mode == -1) {
+                help(0);
+                printf("\nUnrecognized output! Please see the help.\n");
+                exit(1);
+            }
+            output_mode = (output_mode_t) mode;
+            output_flag = TRUE;
+            
+            break;
+        }
+
+        case OPT_OUTPUT_FLUSH: /* --output-flush */
+        {
+            char *end = NULL;
+            unsigned long ms = strtoul(optarg, &end, 10);
+            
+            if (end == optarg || *end != '\0' || ms > 60000) {
+                help(0);
+                printf("\nThe number given to the --output-flush option, is not valid.\n");
+                exit(1);
+            }
+            output_flush_ms = (unsigned int) ms;
+            
+            break;
+        }
+
+        case OPT_LOG_RATE: /* --log-rate */
+        {
+            char *end = NULL;
+            unsigned long messages = strtoul(optarg, &end, 10);
+            
+            if (end == optarg || *end != '\0' || messages > 1000000000UL) {
+                help(0);
+                printf("\nThe number given to the --log-rate option, is not valid.\n");
+                exit(1);
+            }
+            log_rate = (unsigned int) messages;
+            log_rate_set = TRUE;
+            
+            break;
+        }
+
+        case OPT_BACKEND: /* --backend */
+            backend = get_backend(optarg);
+            
+            if (backend == NULL) {
+                help(0);
+                printf("\nUnrecognized backend! Please see the help.\n");
+                exit(1);
+            }
+            
+            break;
+
+        case OPT_BATCH: /* --batch */
+            batch_flag = TRUE;
+            break;
+
+        case OPT_BATCH_NULL: /* --batch-null */
+            batch_null_flag = TRUE;
+            break;
+            
+        case 'V': /* --version */
+            print_version();
+            exit(0);
+            
+        case 'h': /* --help */
+                
+        default:
+            help(0);
+            exit(0);
+        }
+    }
+    
+    /* The roots and the commands of the daemon are the ones of its specs */
+    if (daemon_socket != NULL) {
+        if (roots_qty > 0 || NULL != command || NULL != format || batch_flag == TRUE || state_file != NULL) {
+            help(0);
+            printf("\nThe --daemon option can not be used with the -d, -c, -F, --batch and --state-file options.\n");
+            exit(1);
+        }
+
+        execute_command = daemon_execute;
+    }
+
+    /* The records of --output need no format */
+    if (output_flag == TRUE && NULL == format && daemon_socket == NULL) {
+        if (NULL != command) {
+            help(0);
+            printf("\nThe --output option can not be used with the -c --command option.\n");
+            exit(1);
+        }
+
+        format = bfromcstr("%e %p%f");
+        execute_command = execute_command_embedded;
+    }
+
+    if (daemon_socket == NULL && (roots_qty == 0 || command == format)) {
+        help(1);
+    }
+
+    /* The -x and --exclude-glob regular expressions are matched at once */
+    if (exclude_compile(exclude_patterns) == -1) {
+        help(0);
+        printf("\nThe patterns provided for the -x --exclude and --exclude-glob options, can not be compiled.\n");
+        exit(1);
+    }
+
+    /* The -F option defines the records written to the COMMAND in batch mode */
+    if (batch_flag == TRUE) {
+        if (NULL == command) {
+            help(0);
+            printf("\nThe --batch option requires the -c --command option.\n");
+            exit(1);
+        }
+
+        if (NULL == format)
+            format = bfromcstr("%e %p%f");
+
+        execute_command = execute_command_batch;
+    } else if (NULL != command && NULL != format) {
+        help(1);
+    } else if (NULL != command) {
+        /* Check if the command can be executed without the shell */
+        command_argv = split_command(command);
+    } else if (batch_null_flag == TRUE) {
+        help(0);
+        printf("\nThe --batch-null option requires the --batch option.\n");
+        exit(1);
+    }
+
+    if (event_mask == 0) {
+        event_mask = IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVE;
+    }
+
+    if (backend == NULL)
+        backend = &inotify_backend;
+
+    if (log_rate_set == FALSE)
+        log_rate = LOG_RATE;
+
+    if (read_buffer_len == 0)
+        read_buffer_len = EVENT_BUF_LEN;
+
+    if (state_file == NULL && state_interval_set == TRUE) {
+        help(0);
+        printf("\nThe --state-interval option requires the --state-file option.\n");
+        exit(1);
+    } else if (state_interval_set == FALSE) {
+        state_interval = STATE_INTERVAL;
+    }
+
+    if ((max_watches > 0 || eager_depth_set == TRUE) && recursive_flag == FALSE) {
+        help(0);
+        printf("\nThe --max-watches and --eager-depth options require the -r option.\n");
+        exit(1);
+    }
+
+    if (sweep_interval_set == TRUE && max_watches == 0 && eager_depth_set == FALSE) {
+        help(0);
+        printf("\nThe --sweep-interval option requires the --max-watches or --eager-depth option.\n");
+        exit(1);
+    } else if (sweep_interval_set == FALSE) {
+        sweep_interval = SWEEP_INTERVAL;
+    }
+
+    /* Compile the command (or the format) and its arguments */
+    if (daemon_socket == NULL)
+        command_template = compile_template((char *) ((NULL != format) ? format->data : command->data));
+
+    if (NULL != command_argv) {
+        argv_templates = (TEMPLATE **) malloc(command_argv->qty * sizeof(TEMPLATE *));
+
+        int i;
+        for (i = 0; i < command_argv->qty; ++i) {
+            argv_templates[i] = compile_template((char *) command_argv->entry[i]->data);
+            if (argv_templates[i]->uses_regex == TRUE)
+                command_template->uses_regex = TRUE;
+        }
+    }
+
+    if (fingerprint_cache_size > 0 && skip_unchanged_flag == FALSE) {
+        help(0);
+        printf("\nThe --fingerprint-cache option requires the --skip-unchanged option.\n");
+        exit(1);
+    } else if (fingerprint_cache_size == 0) {
+        fingerprint_cache_size = FINGERPRINT_CACHE;
+    }
+
+    if (coalesce_burst_flag == TRUE && coalesce_ms == 0) {
+        help(0);
+        printf("\nThe --coalesce-burst option requires the --coalesce option.\n");
+        exit(1);
+    }
+    
+    return 0;
+}
+
+int watch(const char *real_path, char *symlink)
+{   
+    /* Add initial path to the watch list */
+    LIST_NODE *node = add_to_watch_list(real_path, symlink);
+    if (node == NULL)
+        return -1;
+
+    /* The subdirectories are watched by the backend, as their events are read */
+    if (backend->per_directory == 0)
+        return 0;
+
+    /* With --eager-depth, the deeper directories are frontiers (see budget_expand) */
+    unsigned int levels = budget_levels((symlink != NULL) ? symlink : real_path);
+    unsigned int depth = path_depth(real_path);
+    bool_t lazy = budget_enabled() ? TRUE : FALSE;
+    if (levels == 0) {
+        ((WD_DATA *) node->data)->flags |= WD_FRONTIER;
+        return 0;
+    }
+    
+    /* Temporary list to perform a BFS directory traversing */
+    LIST *list = list_init();
+    list_push(list, (void *) strdup(real_path));
+    
+    DIR *dir_stream;
+    struct dirent *dir;
+    
+    while (list->first != NULL) {
+        /* Directory to watch */
         char *p = (char*) list_pop(list);
         
         dir_stream = opendir(p);
@@ -626,411 +1447,1480 @@ int watch(char *real_path, char *symlink)
             exit(1);
         }
         
+        /* The names excluded by the rule of the directory */
+        RULE *rule = get_rule(p);
+
+        /* The subdirectories are the last level watched at once */
+        LIST_NODE *p_node = get_node_from_path(p);
+        bool_t last_level = (path_depth(p) - depth + 1 >= levels) ? TRUE : FALSE;
+
+        /* With --io-uring, the entries are probed in batches (see uring_read_dir) */
+        unsigned int probes_qty = 0, probe_i = 0;
+        PROBE *probes = uring_enabled() ? uring_read_dir(dir_stream, &probes_qty) : NULL;
+
         /* Traverse directory */
-        while ((dir = readdir(dir_stream))) {
+        while ((probes != NULL) ? probe_i < probes_qty : (dir = readdir(dir_stream)) != NULL) {
+            PROBE *probe = (probes != NULL) ? &probes[probe_i++] : NULL;
+            const char *d_name = (probe != NULL) ? probe->name : dir->d_name;
+            unsigned char d_type = (probe != NULL) ? probe->type : dir->d_type;
 
             /* Discard all filename that matches regular expression (-x option) */
-            if ((dir->d_type == DT_DIR) && excluded(dir->d_name)) {
+            if ((d_type == DT_DIR) && (excluded((char *) d_name) || rule_excludes(rule, d_name))) {
                 continue;
             }
             
-            if ((dir->d_type == DT_DIR)
-                && strcmp(dir->d_name, ".") != 0
-                && strcmp(dir->d_name, "..") != 0)
+            if ((d_type == DT_DIR)
+                && strcmp(d_name, ".") != 0
+                && strcmp(d_name, "..") != 0)
             {
                 /* Absolute path to watch */
-                char *path_to_watch = (char *) malloc(strlen(p) + strlen(dir->d_name) + 2);
+                char *path_to_watch = (char *) malloc(strlen(p) + strlen(d_name) + 2);
                 strcpy(path_to_watch, p);
-                strcat(path_to_watch, dir->d_name);
+                strcat(path_to_watch, d_name);
                 strcat(path_to_watch, "/");
                 		                
+                LIST_NODE *child = NULL;
+
                 /* Continue directory traversing */
-                if (recursive_flag == TRUE) {
-                    add_to_watch_list(path_to_watch, NULL);
-                    list_push(list, (void*) path_to_watch);
+                if (recursive_flag == TRUE && (child = add_to_watch_list(path_to_watch, NULL)) != NULL) {
+                    if (last_level == TRUE) {
+                        ((WD_DATA *) child->data)->flags |= WD_FRONTIER;
+                        free(path_to_watch);
+                    } else {
+                        list_push(list, (void*) path_to_watch);
+                    }
+                } else {
+                    /* Out of budget, it is watched by the activity of its parent */
+                    if (child == NULL && lazy == TRUE && p_node != NULL)
+                        ((WD_DATA *) p_node->data)->flags |= WD_FRONTIER;
+                    free(path_to_watch);
                 }
-            } else if (dir->d_type == DT_LNK && nosymlink_flag == FALSE) {
+            } else if (d_type == DT_LNK && nosymlink_flag == FALSE) {
                 /* Resolve symbolic link */
-                char *symlink = (char *) malloc(strlen(p) + strlen(dir->d_name) + 1);
+                char *symlink = (char *) malloc(strlen(p) + strlen(d_name) + 1);
                 strcpy(symlink, p);
-                strcat(symlink, dir->d_name);
+                strcat(symlink, d_name);
 
                 /* Check if the symbolic link is already watched */
                 if (get_link_data_from_path(symlink) != NULL) {
+                    free(symlink);
                     continue;
                 }
                 
-                char *real_path = resolve_real_path(symlink);
+                /* The target was opened by the probe, relative to the directory */
+                char *real_path = NULL;
+                if (probe != NULL) {
+                    real_path = probe->target;
+                    probe->target = NULL;
+                } else if ((real_path = resolve_real_path(symlink)) != NULL) {
+                    DIR *is_a_dir = opendir(real_path);
+                    if (is_a_dir != NULL) {
+                        closedir(is_a_dir);
+                    } else {
+                        free(real_path);
+                        real_path = NULL;
+                    }
+                }
+
+                if (real_path != NULL) {
+                    /* Continue directory traversing, or expand it lazily */
+                    LIST_NODE *target = NULL;
+                    bool_t watched = (lazy == TRUE && get_node_from_path(real_path) != NULL) ? TRUE : FALSE;
+                    if (recursive_flag == TRUE && (target = add_to_watch_list(real_path, symlink)) != NULL) {
+                        if (lazy == TRUE && watched == FALSE) {
+                            ((WD_DATA *) target->data)->flags |= WD_FRONTIER;
+                        } else if (lazy == FALSE) {
+                            list_push(list, (void*) real_path);
+                            real_path = NULL;
+                        }
+                    } else if (lazy == TRUE && p_node != NULL) {
+                        ((WD_DATA *) p_node->data)->flags |= WD_FRONTIER;
+                    }
+
+                    /* Kept by the link data, once added */
+                    if (target == NULL)
+                        free(symlink);
+                } else {
+                    free(symlink);
+                }
+                free(real_path);
+            }
+        }
+        uring_free(probes, probes_qty);
+        closedir(dir_stream);
+        free(p);
+    }
+    
+    list_free(list);
+    
+    return 0;
+}
+
+/* The targets of the links released, checked by release_targets() (their paths) */
+static LIST *released_targets;
+
+/* Remove a symbolic link from the graph: from link_index, its target and its owner */
+static void release_link(LINK_DATA *link_data)
+{
+    WD_DATA *wd_data = link_data->wd_data;
+    WD_DATA *owner = link_data->owner;
+
+    if (hash_get(link_index, link_data->path) == (void *) link_data->node)
+        hash_remove(link_index, link_data->path);
+
+    if (owner != NULL) {
+        list_unlink(owner->owned, &link_data->owned);
+        if (owner->owned->first == NULL) {
+            list_free(owner->owned);
+            owner->owned = NULL;
+        }
+    }
+
+    list_remove(wd_data->links, link_data->node);
+    if (--wd_data->refs == 0) {
+        list_free(wd_data->links);
+        wd_data->links = NULL;
+
+        /* It could be no longer reached */
+        char path[MAXPATHLEN + 1];
+        if (released_targets == NULL)
+            released_targets = list_init();
+        list_push(released_targets, (void *) strdup(get_wd_path(wd_data, path)));
+    }
+
+    free(link_data->path);
+    free(link_data);
+}
+
+static void release_targets();
+
+/* Add a watched directory into the watch list and every index */
+static LIST_NODE *register_watch(const char *real_path, int wd, RULE *rule, uint32_t mask, const char *symlink)
+{
+    /* Create wd_data entry */
+    WD_DATA *wd_data = create_wd_data(real_path, wd);
+    if (wd_data == NULL)
+        return NULL;
+
+    wd_data->rule = rule;
+    wd_data->mask = mask;
+
+    /* Outside of the roots, it belongs to the root of the symbolic link (or of its parent) */
+    if (wd_data->root == NULL) {
+        TRIE_NODE *ancestor = trie_find_prefix(wd_tree, (symlink != NULL) ? symlink : real_path);
+        wd_data->root = (ancestor != NULL)
+            ? ((WD_DATA *) ((LIST_NODE *) ancestor->data)->data)->root
+            : root_paths[0];
+    }
+
+    LIST_NODE *node = &wd_data->node;
+    list_link(list_wd, node);
+    hash_put(wd_index, &wd_data->wd, (void*) node);
+    wd_data->entry = trie_insert(wd_tree, real_path, (void*) node);
+
+    /* Log Message */
+    log_message("WATCHING: (fd:%d,wd:%d)\t\t\"%s\"", fd, wd_data->wd, real_path);
+    metrics_count(METRIC_WATCHES_ADDED);
+
+    return node;
+}
+
+LIST_NODE *add_watched_to_watch_list(const char *real_path, int wd)
+{
+    LIST_NODE *node = get_node_from_path(real_path);
+    if (node != NULL)
+        return node;
+
+    RULE *rule = get_rule(real_path);
+    uint32_t mask = (rule != NULL && rule->mask != 0) ? rule->mask : event_mask;
+
+    return register_watch(real_path, wd, rule, mask, NULL);
+}
+
+LIST_NODE *add_to_watch_list(const char *real_path, char *symlink)
+{   
+    /* Check if the resource is already in the watch_list */
+    LIST_NODE *node = get_node_from_path(real_path);
+    
+    /* If the resource is not watched yet, then add it into the watch_list */
+    if (NULL == node) {
+        /* The narrowest mask, the events that are not handled are not even queued */
+        RULE *rule = get_rule(real_path);
+        if (rule != NULL && rule->skip == 1)
+            return NULL;
+
+        uint32_t mask = (rule != NULL && rule->mask != 0) ? rule->mask : event_mask;
+
+        /* With --max-watches, the least recently active directory makes room */
+        if (budget_reserve(real_path) == -1) {
+            log_message("OUT OF BUDGET:\t\t\"%s\"", real_path);
+            return NULL;
+        }
+
+        /* Append directory to watch_list */
+        int wd = backend->add_watch(real_path, mask);
+        if (wd == -1 && errno == ENOSPC && budget_evict(real_path) == 0)
+            wd = backend->add_watch(real_path, mask);
+
+        /* INFO Check limit in: /proc/sys/fs/inotify/max_user_watches */
+        if (wd == -1 && budget_enabled()) {
+            log_message("UNABLE TO WATCH:\t\"%s\" (%s)", real_path, strerror(errno));
+            return NULL;
+        } else if (wd == -1) {
+            printf("AN ERROR OCCURRED WHILE ADDING PATH %s:\n", real_path);
+            printf("Please consider these possibilities:\n");
+            printf(" - Max number of watched resources reached! See /proc/sys/fs/inotify/max_user_watches\n");
+            printf(" - Resource is no more available!?\n");
+            return NULL;
+        }
+        
+        node = register_watch(real_path, wd, rule, mask, symlink);
+    }
+
+    /* Append symbolic link to watched resource */
+    if (node != NULL && symlink != NULL) {
+        WD_DATA *wd_data = (WD_DATA*) node->data;
+
+        /* A link overwritten by a rename has no delete event, the new one replaces it */
+        LINK_DATA *link_data = get_link_data_from_path(symlink);
+        if (link_data != NULL)
+            release_link(link_data);
+
+        link_data = create_link_data(symlink, wd_data);
+
+        /* The list is only allocated for the directories pointed by a symbolic link */
+        if (link_data != NULL && wd_data->links == NULL)
+            wd_data->links = list_init();
+            
+        if (link_data != NULL) {
+            link_data->node = list_push(wd_data->links, (void *) link_data);
+            ++wd_data->refs;
+            hash_put(link_index, link_data->path, (void *) link_data->node);
+            
+            /* Log Message */
+            log_message("ADDED SYMBOLIC LINK:\t\t\"%s\" -> \"%s\"", symlink, real_path);
+        }
+
+        /* The target of the replaced link could be no longer reached */
+        release_targets();
+    }
+    
+    return node;
+}
+
+/* Remove a watched resource from the watch list and from every index */
+static void remove_from_watch_list(LIST_NODE *node)
+{
+    WD_DATA *wd_data = (WD_DATA *) node->data;
+    char path[MAXPATHLEN + 1];
+    
+    /* Log Message */
+    log_message("UNWATCHING: (fd:%d,wd:%d)\t\t\"%s\"", fd, wd_data->wd, get_wd_path(wd_data, path));
+    
+    backend->rm_watch(wd_data->wd);
+    metrics_count(METRIC_WATCHES_REMOVED);
+
+    /* The links pointing to it, and the ones it contains, whose targets are checked after */
+    while (wd_data->links != NULL)
+        release_link((LINK_DATA *) wd_data->links->first->data);
+
+    while (wd_data->owned != NULL)
+        release_link((LINK_DATA *) wd_data->owned->first->data);
+    
+    hash_remove(wd_index, &wd_data->wd);
+    trie_remove_node(wd_data->entry);
+    list_unlink(list_wd, node);
+    slab_release(wd_slab, wd_data);
+}
+
+/* Collect the list_wd nodes of a subtree (see trie_walk) */
+static int collect_subtree(TRIE_NODE *trie_node, void *list)
+{
+    if (trie_node->data != NULL)
+        list_push((LIST *) list, trie_node->data);
+
+    return 0;
+}
+
+/* Collect the orphans of a subtree, skipping the referenced ones and the root paths */
+static int collect_orphans(TRIE_NODE *trie_node, void *list)
+{
+    if (trie_node->data == NULL)
+        return 0;
+
+    WD_DATA *wd_data = (WD_DATA *) ((LIST_NODE *) trie_node->data)->data;
+    char path[MAXPATHLEN + 1];
+    if (wd_data->refs > 0
+        || is_root(get_wd_path(wd_data, path)) == TRUE)
+    {
+        return 1;
+    }
+
+    list_push((LIST *) list, trie_node->data);
+
+    return 0;
+}
+
+/*
+ * Unwatch the targets of the released links that are no longer reached: outside
+ * of the roots and without a referenced ancestor. Their subtrees are unwatched,
+ * but for the directories referenced by other links, and the links they contain
+ * are released in turn.
+ */
+static void release_targets()
+{
+    char *path;
+
+    while (released_targets != NULL && (path = (char *) list_pop(released_targets)) != NULL) {
+        LIST_NODE *node = get_node_from_path(path);
+        WD_DATA *wd_data = (node != NULL) ? (WD_DATA *) node->data : NULL;
+
+        if (wd_data != NULL && wd_data->refs == 0 && get_root_of(path) == NULL) {
+            TRIE_NODE *ancestor;
+            for (ancestor = wd_data->entry->parent; ancestor != NULL; ancestor = ancestor->parent) {
+                if (ancestor->data != NULL && ((WD_DATA *) ((LIST_NODE *) ancestor->data)->data)->refs > 0)
+                    break;
+            }
+
+            if (ancestor == NULL) {
+                LIST *orphans = list_init();
+                trie_walk(wd_data->entry, collect_orphans, (void *) orphans);
+
+                while (orphans->first != NULL) {
+                    remove_from_watch_list((LIST_NODE *) list_pop(orphans));
+                }
+                list_free(orphans);
+            }
+        }
+
+        free(path);
+    }
+}
+
+void unwatch(char *path, bool_t is_link)
+{
+    /* Remove the resource and its subdirectories from watched resources */
+    if (is_link == FALSE) {
+        TRIE_NODE *trie_node = trie_find(wd_tree, path);
+        if (trie_node != NULL) {
+            LIST *list = list_init();
+            trie_walk(trie_node, collect_subtree, (void *) list);
+
+            while (list->first != NULL) {
+                remove_from_watch_list((LIST_NODE *) list_pop(list));
+            }
+            list_free(list);
+
+            release_targets();
+        }
+    } else {
+        /* A file that is not a symbolic link is not in link_index */
+        LIST_NODE *link_node = get_link_node_from_path(path);
+        if (link_node != NULL)
+            unwatch_symbolic_link(link_node);
+    }
+}
+
+void unwatch_root(const char *path)
+{
+    TRIE_NODE *trie_node = trie_find(wd_tree, path);
+    if (trie_node == NULL)
+        return;
+
+    LIST *list = list_init();
+    trie_walk(trie_node, collect_orphans, (void *) list);
+
+    while (list->first != NULL) {
+        remove_from_watch_list((LIST_NODE *) list_pop(list));
+    }
+    list_free(list);
+
+    release_targets();
+}
+
+/* The symbolic links of a renamed directory are indexed again by their new path */
+static void rename_owned_links(WD_DATA *wd_data, const char *path)
+{
+    if (wd_data->owned == NULL)
+        return;
+
+    size_t len = strlen(path);
+    LIST_NODE *node;
+
+    for (node = wd_data->owned->first; node != NULL; node = node->next) {
+        LINK_DATA *link_data = (LINK_DATA *) node->data;
+        const char *name = strrchr(link_data->path, '/') + 1;
+        char *link_path = (char *) malloc(len + strlen(name) + 1);
+        if (link_path == NULL)
+            continue;
+
+        strcpy(link_path, path);
+        strcat(link_path, name);
+
+        LIST_NODE *link_node = (LIST_NODE *) hash_remove(link_index, link_data->path);
+        free(link_data->path);
+        link_data->path = link_path;
+        if (link_node != NULL)
+            hash_put(link_index, link_data->path, (void *) link_node);
+    }
+}
+
+/* Update the root, the rule and the links of the directories of a renamed subtree (see trie_walk) */
+static int refresh_renamed(TRIE_NODE *trie_node, void *list)
+{
+    if (trie_node->data == NULL)
+        return 0;
+
+    WD_DATA *wd_data = (WD_DATA *) ((LIST_NODE *) trie_node->data)->data;
+    LIST_NODE *parent = (LIST_NODE *) trie_node->parent->data;
+    char path[MAXPATHLEN + 1];
+    get_wd_path(wd_data, path);
+    rename_owned_links(wd_data, path);
+
+    /* Skipped or excluded at the new place, it is unwatched once the walk is over */
+    RULE *rule = get_rule(path);
+    if ((rule != NULL && rule->skip == 1)
+        || (parent != NULL && rule_excludes(((WD_DATA *) parent->data)->rule, trie_node->name)))
+    {
+        list_push((LIST *) list, (void *) strdup(path));
+        return 1;
+    }
+
+    uint32_t mask = (rule != NULL && rule->mask != 0) ? rule->mask : event_mask;
+    if (mask != wd_data->mask && backend->per_directory)
+        backend->add_watch(path, mask);
+
+    wd_data->root = get_root_of(path);
+    wd_data->rule = rule;
+    wd_data->mask = mask;
+
+    return 0;
+}
+
+int rename_watched(const char *old_path, const char *new_path)
+{
+    TRIE_NODE *trie_node = trie_find(wd_tree, old_path);
+    if (trie_node == NULL || trie_node->data == NULL)
+        return -1;
+
+    /* Only the directories of the roots, the roots themselves are not moved */
+    if (get_root_of(old_path) == NULL || get_root_of(new_path) == NULL)
+        return -1;
+
+    unsigned int i;
+    for (i = 0; i < roots_qty; ++i) {
+        if (is_child_of(root_paths[i], old_path) == TRUE)
+            return -1;
+    }
+
+    if (trie_move(wd_tree, trie_node, new_path) == NULL)
+        return -1;
+
+    log_message("RENAMED:\t\t\"%s\" -> \"%s\"", old_path, new_path);
+
+    /* The symbolic links below it are renamed, and its directories no longer watched are collected */
+    LIST *list = list_init();
+    trie_walk(trie_node, refresh_renamed, (void *) list);
+
+    char *path;
+    while ((path = (char *) list_pop(list)) != NULL) {
+        unwatch(path, FALSE);
+        free(path);
+    }
+    list_free(list);
+
+    return 0;
+}
+
+void unwatch_symbolic_link(LIST_NODE *link_node)
+{   
+    LINK_DATA *link_data = (LINK_DATA*) link_node->data;
+    char path[MAXPATHLEN + 1];
+    
+    /* Log Message */
+    log_message("UNWATCHING SYMBOLIC LINK: \t\"%s\" -> \"%s\"", link_data->path, get_wd_path(link_data->wd_data, path));
+    
+    release_link(link_data);
+    release_targets();
+}
+
+/* Execute (or coalesce) the command for an event */
+static void trigger_event(char *event_name, char *file_name, char *event_p_path)
+{
+    if (coalesce_ms > 0) {
+        if (coalesce_event(event_name, file_name, event_p_path) == -1) {
+            printf("ERROR OCCURED: Unable to coalesce the event!\n");
+            exit(1);
+        }
+    } else if (fingerprint_unchanged(event_name, event_p_path, file_name) == 0
+               && execute_command(event_name, file_name, event_p_path) == -1)
+    {
+        printf("ERROR OCCURED: Unable to execute the specified command!\n");
+        exit(1);
+    }
+}
+
+/* The pending moves are handled again by dispatch_events, they must not be kept again */
+static bool_t moves_expiring;
+
+/* The pending moves, released once paired or expired */
+static SLAB *move_slab;
+
+/* Keep an IN_MOVED_FROM until its IN_MOVED_TO is read (or until MOVE_PAIR_MS) */
+static void keep_move(const struct inotify_event *event)
+{
+    if (moves_index == NULL)
+        moves_index = hash_init(hash_int, hash_int_compare);
+    if (move_slab == NULL)
+        move_slab = slab_init(sizeof(PENDING_MOVE), MOVE_SLAB_CHUNK);
+
+    PENDING_MOVE *move = (move_slab != NULL) ? (PENDING_MOVE *) slab_alloc(move_slab) : NULL;
+    if (moves_index == NULL || move == NULL) {
+        printf("ERROR OCCURED: Unable to pair the moved events!\n");
+        exit(1);
+    }
+
+    move->wd = event->wd;
+    move->mask = event->mask;
+    move->cookie = event->cookie;
+    clock_gettime(CLOCK_MONOTONIC, &move->time);
+
+    size_t name_len = (event->len > 0) ? strnlen(event->name, event->len) : 0;
+    if (name_len > NAME_MAX)
+        name_len = NAME_MAX;
+    memcpy(move->name, event->name, name_len);
+    move->name[name_len] = '\0';
+
+    /* The oldest pending move arms the timer */
+    if (moves_first == NULL && move_timer != NULL)
+        loop_set_timer(move_timer, MOVE_PAIR_MS, 0);
+
+    move->prev = moves_last;
+    move->next = NULL;
+    if (moves_last != NULL)
+        moves_last->next = move;
+    else
+        moves_first = move;
+    moves_last = move;
+
+    /* The cookie is an unsigned int: it is hashed as an int */
+    if (hash_put(moves_index, &move->cookie, (void *) move) == -1) {
+        printf("ERROR OCCURED: Unable to pair the moved events!\n");
+        exit(1);
+    }
+}
+
+/* Unlink a pending move from the pending ones and from their index */
+static void drop_move(PENDING_MOVE *move)
+{
+    if (move->prev != NULL)
+        move->prev->next = move->next;
+    else
+        moves_first = move->next;
+
+    if (move->next != NULL)
+        move->next->prev = move->prev;
+    else
+        moves_last = move->prev;
+
+    /* A cookie seen twice is indexed by its most recent move */
+    if (hash_get(moves_index, &move->cookie) == move)
+        hash_remove(moves_index, &move->cookie);
+}
+
+/* Take the pending move of a cookie, NULL if there is none (release it with slab_release) */
+static PENDING_MOVE *take_move(uint32_t cookie)
+{
+    if (moves_index == NULL)
+        return NULL;
+
+    PENDING_MOVE *move = (PENDING_MOVE *) hash_get(moves_index, &cookie);
+    if (move != NULL)
+        drop_move(move);
+
+    return move;
+}
+
+/*
+ * A pending move paired with its IN_MOVED_TO: the renamed directory keeps
+ * its watch descriptors, and a single rename event is executed.
+ * Returns -1 if the directory moved from is no longer watched.
+ */
+static int pair_move(PENDING_MOVE *move, struct inotify_event *event, WD_DATA *wd_data,
+                     char *path, char *dir_path)
+{
+    LIST_NODE *node = get_node_from_wd(move->wd);
+    if (node == NULL)
+        return -1;
+
+    char old_path[MAXPATHLEN + NAME_MAX + 2];
+    get_wd_path((WD_DATA *) node->data, old_path);
+    strcat(old_path, move->name);
+    if (move->mask & IN_ISDIR)
+        strcat(old_path, "/");
+
+    /* The IN_MOVED_FROM is handled as it was read, if the rename can not be done in place */
+    struct inotify_event moved_from = *event;
+    moved_from.mask = move->mask;
+
+    if ((event->mask & IN_ISDIR) == 0 || rename_watched(old_path, path) == -1) {
+        event_handler_moved_from(&moved_from, old_path);
+        event_handler_moved_to(event, path);
+    }
+
+    /* As %p%f, the old path of a directory has no ending slash */
+    if (move->mask & IN_ISDIR)
+        old_path[strlen(old_path) - 1] = '\0';
+
+    if (event->mask & wd_data->mask && regex_catch(event->name)) {
+        event_old_path = old_path;
+        trigger_event("rename", event->name, dir_path);
+        event_old_path = NULL;
+    }
+
+    return 0;
+}
+
+void expire_moves(bool_t all)
+{
+    if (moves_first == NULL)
+        return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    union
+    {
+        struct inotify_event event;
+        char data[EVENT_SIZE + NAME_MAX + 1];
+    } record;
+    PENDING_MOVE *move;
+
+    while ((move = moves_first) != NULL) {
+        long age_ms = (now.tv_sec - move->time.tv_sec) * 1000 + (now.tv_nsec - move->time.tv_nsec) / 1000000;
+        if (all == FALSE && age_ms < MOVE_PAIR_MS) {
+            loop_set_timer(move_timer, MOVE_PAIR_MS - age_ms, 0);
+            break;
+        }
+
+        /* Moved out of the watched tree: dispatched as it was read */
+        size_t len = put_event(record.data, move->wd, move->mask, move->name);
+        record.event.cookie = move->cookie;
+
+        drop_move(move);
+        slab_release(move_slab, move);
+
+        moves_expiring = TRUE;
+        dispatch_events(record.data, len);
+        moves_expiring = FALSE;
+    }
+}
+
+void dispatch_events(char *buffer, ssize_t len)
+{
+    /* inotify_event */
+    struct inotify_event *event = NULL;
+    struct event_t *triggered_event = NULL;
+
+    /* The real path of the directory, and of touched directory or file */
+    char dir_path[MAXPATHLEN + 1];
+    char path[MAXPATHLEN + NAME_MAX + 2];
+    size_t path_len;
+    ssize_t i = 0;
+    uint64_t lookup_start;
+    
+    /* Temporary node information */
+    LIST_NODE *node = NULL;
+    WD_DATA *wd_data = NULL;
+
+    /* index of the event into buffer */
+    while (i < len) {
+        /* inotify_event */
+        event = (struct inotify_event*) &buffer[i];
+        metrics_event(event->mask);
+
+        /* Some events were lost, the watched directories will be resynchronized */
+        if (event->mask & IN_Q_OVERFLOW) {
+            log_message("THE EVENTS QUEUE OVERFLOWED");
+            metrics_count(METRIC_OVERFLOWS);
+            resync_pending = TRUE;
+
+            /* Next event */
+            i += EVENT_SIZE + event->len;
+            continue;
+        }
+
+        /* Discard all filename that matches regular expression (-x option) */
+        if (excluded(event->name)) {
+            metrics_count(METRIC_EVENTS_EXCLUDED);
+
+            /* Next event */
+            i += EVENT_SIZE + event->len;
+            continue;
+        }
+        
+        /* Build the full path of the directory or symbolic link */
+        lookup_start = metrics_now();
+        node = get_node_from_wd(event->wd);
+        metrics_observe(METRIC_LOOKUP_TIME, lookup_start);
+
+        if (node != NULL && rule_excludes(((WD_DATA *) node->data)->rule, event->name) == 0) {
+            wd_data = (WD_DATA *) node->data;
+            event_root = wd_data->root;
+            event_cookie = event->cookie;
+
+            /* The directory can be unwatched by the handler, its path is kept */
+            path_len = strlen(get_wd_path(wd_data, dir_path));
+            memcpy(path, dir_path, path_len);
+
+            /* event->name is NUL padded to event->len */
+            size_t name_len = (event->len > 0) ? strnlen(event->name, event->len) : 0;
+            if (name_len > NAME_MAX)
+                name_len = NAME_MAX;
+            memcpy(path + path_len, event->name, name_len);
+            path_len += name_len;
+            
+            if (event->mask & IN_ISDIR)
+                path[path_len++] = '/';
+            path[path_len] = '\0';
+        } else {
+            metrics_count((node == NULL) ? METRIC_EVENTS_DROPPED : METRIC_EVENTS_EXCLUDED);
+
+            /* Next event */
+            i += EVENT_SIZE + event->len;
+            continue;
+        }
+
+        metrics_observe(METRIC_DISPATCH_LATENCY, read_time);
+
+        /* The directory shows activity, it is the most recently active now */
+        if (budget_enabled())
+            budget_touch(wd_data);
+
+        /* The two halves of a rename are paired by their cookie */
+        if ((event->mask & IN_MOVE) && event->cookie != 0 && moves_expiring == FALSE) {
+            PENDING_MOVE *move = NULL;
+
+            if (event->mask & IN_MOVED_FROM) {
+                keep_move(event);
+
+                /* Next event */
+                i += EVENT_SIZE + event->len;
+                continue;
+            }
+
+            /* Moved from outside of the watched tree otherwise */
+            if ((move = take_move(event->cookie)) != NULL) {
+                int paired = pair_move(move, event, wd_data, path, dir_path);
+                slab_release(move_slab, move);
+
+                if (paired == 0) {
+                    /* Next event */
+                    i += EVENT_SIZE + event->len;
+                    continue;
+                }
+            }
+        }
+        
+        /* Call the specific event handler */
+        if (event->mask & wd_data->mask
+            && (triggered_event = get_inotify_event(event->mask & wd_data->mask)) != NULL
+            && triggered_event->name != NULL
+            && regex_catch(event->name)
+            && triggered_event->handler(event, path) == 0)
+        {
+            trigger_event(triggered_event->name, event->name, dir_path);
+        }
+        
+        /* Next event */
+        i += EVENT_SIZE + event->len;
+    }
+}
+
+void end_batch()
+{
+    if (batch_flag == TRUE && batch_flush() == -1) {
+        printf("ERROR OCCURED: Unable to write the events to the specified command!\n");
+        exit(1);
+    }
+
+    if ((execute_command == execute_command_embedded || execute_command == daemon_execute)
+        && output_end_batch() == -1)
+    {
+        printf("ERROR OCCURED: Unable to write the events to the standard output!\n");
+        exit(1);
+    }
+}
+
+/*
+ * Read the events of the backend until there are no more (see loop_add),
+ * the events read are handled at once, unless the buffer gets full
+ */
+static void read_events(void *arg)
+{
+    char *buffer = (char *) arg;
+    size_t used = 0;
+    ssize_t len;
+    bool_t drained = FALSE;
+
+    while (drained == FALSE) {
+        while (read_buffer_len - used >= EVENT_READ_MIN) {
+            len = backend->read(buffer + used, read_buffer_len - used);
+
+            if (len == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    drained = TRUE;
+                    break;
+                }
+                if (errno == EINTR)
+                    continue;
+
+                printf("ERROR: UNABLE TO READ INOTIFY QUEUE EVENTS!!!\n");
+                exit(1);
+            }
+
+            if (used == 0)
+                read_time = metrics_now();
+
+            /* The records are kept aligned, the next read follows the previous one */
+            used += len;
+        }
+
+        if (used == 0)
+            continue;
+
+        dispatch_events(buffer, used);
+        read_time = 0;
+        used = 0;
+
+        if (resync_pending == TRUE)
+            resync();
+
+        /* Write all the records of this batch at once */
+        end_batch();
+    }
+}
+
+/*
+ * Dispatch the chunks read by the reader thread (see reader_start),
+ * a bounded number at each turn so that the other sources are handled too
+ */
+static void dispatch_ring(void *arg)
+{
+    char *chunk;
+    size_t len;
+    uint64_t read_at;
+    int chunks = 0;
+
+    reader_clear();
+
+    while (chunks < READER_CHUNKS && (chunk = reader_next(&len, &read_at)) != NULL) {
+        read_time = read_at;
+        dispatch_events(chunk, (ssize_t) len);
+        read_time = 0;
+        reader_release();
+        ++chunks;
+
+        if (resync_pending == TRUE)
+            resync();
+
+        /* Write all the records of this chunk at once */
+        end_batch();
+    }
+
+    if (chunks == READER_CHUNKS) {
+        reader_wakeup();
+    } else if (reader_error() != 0) {
+        printf("ERROR: UNABLE TO READ INOTIFY QUEUE EVENTS!!!\n");
+        exit(1);
+    }
+}
+
+/* SIGCHLD: reap the terminated commands */
+static void child_terminated(void *arg)
+{
+    reap_jobs();
+}
+
+/* SIGINT, SIGTERM: stop monitoring */
+static void terminate(void *arg)
+{
+    log_message("TERMINATING...");
+    loop_stop();
+}
+
+/* Save the watch state periodically (--state-interval) */
+static void state_checkpoint(void *arg)
+{
+    if (state_save(state_file) == -1)
+        log_message("UNABLE TO SAVE THE STATE FILE:\t\"%s\" -> %d", state_file, errno);
+}
+
+/* The coalescing window is over */
+static void coalesce_expired(void *arg)
+{
+    coalesce_flush();
+}
+
+/* The oldest pending move is not paired in time */
+static void moves_expired(void *arg)
+{
+    expire_moves(FALSE);
+    end_batch();
+}
+
+static void sweep_expired(void *arg)
+{
+    budget_sweep();
+    end_batch();
+}
+
+int monitor()
+{
+    /* Initialize the exec count */
+    exec_c = 0;
+
+    job_queue = list_init();
+    
+    if (loop_init() == -1) {
+        printf("ERROR: UNABLE TO START THE EVENT LOOP!\n");
+        exit(1);
+    }
+
+    /* The events are read until EAGAIN */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    /* The signals are blocked before the reader thread is started, it inherits them */
+    if (loop_add_signal(SIGCHLD, child_terminated, NULL) == -1
+        || loop_add_signal(SIGINT, terminate, NULL) == -1
+        || loop_add_signal(SIGTERM, terminate, NULL) == -1)
+    {
+        printf("ERROR: UNABLE TO START THE EVENT LOOP!\n");
+        exit(1);
+    }
+
+    /* The kernel queue is read by a thread, or by the event loop */
+    int ready_fd = -1;
+    if (reader_flag == TRUE && backend != &inotify_backend) {
+        log_message("THE READER THREAD REQUIRES THE INOTIFY BACKEND, READING FROM THE EVENT LOOP");
+    } else if (reader_flag == TRUE && (ready_fd = reader_start(fd, read_buffer_len)) == -1) {
+        log_message("UNABLE TO START THE READER THREAD (%s), READING FROM THE EVENT LOOP", strerror(errno));
+    }
+
+    /* Buffer for File Descriptor */
+    char *buffer = (ready_fd == -1) ? (char *) malloc(read_buffer_len) : NULL;
+
+    if ((ready_fd == -1 && (buffer == NULL || loop_add(fd, read_events, (void *) buffer) == NULL))
+        || (ready_fd != -1 && loop_add(ready_fd, dispatch_ring, NULL) == NULL)
+        || (move_timer = loop_add_timer(moves_expired, NULL)) == NULL)
+    {
+        printf("ERROR: UNABLE TO START THE EVENT LOOP!\n");
+        exit(1);
+    }
+    
+    if (coalesce_ms > 0) {
+        coalesce_index = hash_init(hash_string, hash_string_compare);
+        coalesce_timer = loop_add_timer(coalesce_expired, NULL);
 
-                DIR *is_a_dir;
-                is_a_dir = opendir(real_path);
-                if (real_path != NULL && is_a_dir != NULL) {
-                    closedir(is_a_dir);
-                    
-                    /* Continue directory traversing */
-                    if (recursive_flag == TRUE) {
-                        add_to_watch_list(real_path, symlink);
-                        list_push(list, (void*) real_path);
-                    }
-                }
-            }
+        if (coalesce_timer == NULL) {
+            printf("ERROR: UNABLE TO START THE EVENT LOOP!\n");
+            exit(1);
         }
-        closedir(dir_stream);
     }
-    
-    list_free(list);
-    
-    return 0;
-}
 
-LIST_NODE *add_to_watch_list(char *real_path, char *symlink)
-{   
-    /* Check if the resource is already in the watch_list */
-    LIST_NODE *node = get_node_from_path(real_path);
+    if (skip_unchanged_flag == TRUE && fingerprint_init(fingerprint_cache_size) == -1) {
+        printf("ERROR: UNABLE TO ALLOCATE THE FINGERPRINTS OF THE FILES!\n");
+        exit(1);
+    }
+
+    /* The new subtrees are adopted in the background, from now on */
+    if (adopt_start() == -1)
+        log_message("UNABLE TO ADOPT THE NEW DIRECTORIES IN THE BACKGROUND (%s)", strerror(errno));
+
+    if (batch_flag == TRUE && batch_start() == -1) {
+        printf("ERROR OCCURED: Unable to start the specified command!\n");
+        exit(1);
+    }
     
-    /* If the resource is not watched yet, then add it into the watch_list */
-    if (NULL == node) {
-        /* Append directory to watch_list */
-        int wd = inotify_add_watch(fd, real_path, event_mask);
-        
-        /* INFO Check limit in: /proc/sys/fs/inotify/max_user_watches */
-        if (wd == -1) {
-            printf("AN ERROR OCCURRED WHILE ADDING PATH %s:\n", real_path);
-            printf("Please consider these possibilities:\n");
-            printf(" - Max number of watched resources reached! See /proc/sys/fs/inotify/max_user_watches\n");
-            printf(" - Resource is no more available!?\n");
-            return NULL;
-        }
-        
-        /* Create wd_data entry */
-        WD_DATA *wd_data = create_wd_data(real_path, wd);
-        if (wd_data != NULL) {
-            node = list_push(list_wd, (void*) wd_data);
-        
-            /* Log Message */
-            char *message = (char *) malloc(MAXPATHLEN);
-            sprintf(message, "WATCHING: (fd:%d,wd:%d)\t\t\"%s\"", fd, wd_data->wd, real_path);
-            log_message(message);
+    if (metrics_socket != NULL && metrics_start(metrics_socket) == -1) {
+        printf("ERROR: UNABLE TO LISTEN ON THE METRICS SOCKET \"%s\" (%s)!\n", metrics_socket, strerror(errno));
+        exit(1);
+    }
+
+    if (daemon_socket != NULL && daemon_start(daemon_socket) == -1) {
+        printf("ERROR: UNABLE TO LISTEN ON THE CONTROL SOCKET \"%s\" (%s)!\n", daemon_socket, strerror(errno));
+        exit(1);
+    }
+
+    if (state_file != NULL) {
+        /* Report the changes made while cwatch was not running */
+        state_replay();
+        end_batch();
+
+        LOOP_SOURCE *state_timer = NULL;
+        if (state_interval > 0
+            && ((state_timer = loop_add_timer(state_checkpoint, NULL)) == NULL
+                || loop_set_timer(state_timer, state_interval * 1000, state_interval * 1000) == -1))
+        {
+            printf("ERROR: UNABLE TO START THE EVENT LOOP!\n");
+            exit(1);
         }
     }
 
-    /* Append symbolic link to watched resource */
-    if (node != NULL && symlink != NULL) {
-        WD_DATA *wd_data = (WD_DATA*) node->data;
-        LINK_DATA *link_data = create_link_data(symlink, wd_data);
-            
-        if (link_data != NULL) {
-            list_push(wd_data->links, (void *) link_data);
-            
-            /* Log Message */
-            char *message = (char *) malloc(MAXPATHLEN);
-            sprintf(message, "ADDED SYMBOLIC LINK:\t\t\"%s\" -> \"%s\"", symlink, real_path);
-            log_message(message);   
+    if (budget_enabled()) {
+        /* The directories can be evicted from now on, the ones not watched are swept */
+        budget_start();
+
+        LOOP_SOURCE *sweep_timer = NULL;
+        if (sweep_interval > 0
+            && ((sweep_timer = loop_add_timer(sweep_expired, NULL)) == NULL
+                || loop_set_timer(sweep_timer, sweep_interval * 1000, sweep_interval * 1000) == -1))
+        {
+            printf("ERROR: UNABLE TO START THE EVENT LOOP!\n");
+            exit(1);
         }
     }
     
-    return node;
+    /* Wait for events */
+    int result = loop_run();
+
+    /* The chunks already read are dispatched */
+    READER_STATS stats;
+    if (ready_fd != -1) {
+        reader_stop();
+        dispatch_ring(NULL);
+
+        reader_stats(&stats);
+        log_message("READER STOPPED:\t%lu reads (%lu bytes), %lu stalls, at most %u of %u buffers used",
+                    stats.reads, stats.bytes, stats.stalls, stats.high_water, stats.chunks);
+    }
+
+    /* Execute the pending moves and the events of the coalescing window, and close the batch command input */
+    expire_moves(TRUE);
+
+    if (coalesce_first != NULL)
+        coalesce_flush();
+
+    if (batch_flag == TRUE && batch_fd != -1)
+        close(batch_fd);
+
+    if (execute_command == execute_command_embedded || execute_command == daemon_execute)
+        output_flush();
+
+    if (state_file != NULL)
+        state_checkpoint(NULL);
+
+    daemon_stop();
+    metrics_stop();
+    free(buffer);
+
+    return result;
 }
 
-void unwatch(char *path, bool_t is_link)
+int coalesce_event(char *event_name, char *file_name, char *event_p_path)
 {
-    /* REFACTOR HERE */
+    /* The coalescing key: "<event>:<path><file>" */
+    if (NULL == coalesce_key)
+        coalesce_key = bfromcstralloc(MAXPATHLEN, "");
     
-    /* Remove the resource from watched resources */
-    if (is_link == FALSE) {
-        /* Retrieve the watch descriptor from path */
-        LIST_NODE *node = get_node_from_path(path);
-        if (node != NULL) {   
-            WD_DATA *wd_data = (WD_DATA *) node->data;
-            
-            /* Log Message */
-            char *message = (char *) malloc(MAXPATHLEN);
-            sprintf(message, "UNWATCHING: (fd:%d,wd:%d)\t\t\"%s\"", fd, wd_data->wd, path);
-            log_message(message);
-            
-            inotify_rm_watch(fd, wd_data->wd);
+    bassigncstr(coalesce_key, event_name);
+    bconchar(coalesce_key, ':');
+    bcatcstr(coalesce_key, event_p_path);
+    bcatcstr(coalesce_key, file_name);
 
-            if (wd_data->links->first != NULL)
-                list_free(wd_data->links);
-            
-            list_remove(list_wd, node);
-        }
+    /* The first event of the window */
+    if (coalesce_first == NULL && loop_set_timer(coalesce_timer, coalesce_ms, 0) == -1)
+        return -1;
+
+    COALESCED_EVENT *coalesced = (COALESCED_EVENT *) hash_get(coalesce_index, coalesce_key->data);
+    if (coalesced != NULL) {
+        ++coalesced->count;
+        return 0;
+    }
+
+    /* Reuse an executed event, if any */
+    if (coalesce_pool != NULL) {
+        coalesced = coalesce_pool;
+        coalesce_pool = coalesced->next;
     } else {
-        /* BFS to discover other symbolic links */
-        LIST *list = list_init();
-        list_push(list, (void *) path);
+        coalesced = (COALESCED_EVENT *) malloc(sizeof(COALESCED_EVENT));
+        if (coalesced == NULL)
+            return -1;
+        
+        coalesced->key = bfromcstr("");
+        coalesced->file_name = bfromcstr("");
+        coalesced->event_p_path = bfromcstr("");
+        coalesced->old_path = bfromcstr("");
+    }
     
-        DIR *dir_stream;
-        struct dirent *dir;
+    bassign(coalesced->key, coalesce_key);
+    bassigncstr(coalesced->file_name, file_name);
+    bassigncstr(coalesced->event_p_path, event_p_path);
+    bassigncstr(coalesced->old_path, (event_old_path != NULL) ? event_old_path : "");
+    coalesced->event_name = event_name;
+    coalesced->root = event_root;
+    coalesced->cookie = event_cookie;
+    coalesced->count = 1;
+    coalesced->next = NULL;
+
+    if (coalesce_last != NULL)
+        coalesce_last->next = coalesced;
+    else
+        coalesce_first = coalesced;
+    coalesce_last = coalesced;
+    
+    hash_put(coalesce_index, coalesced->key->data, (void *) coalesced);
+    
+    return 0;
+}
 
-        while (list->first != NULL) {
-            char *symlink = (char*) list_pop(list);
-            
-            LIST_NODE *link_node = get_link_node_from_path(symlink);
-            if (link_node == NULL)
-                continue;
-            
-            LINK_DATA *link_data = (LINK_DATA*) link_node->data;
-            char *resolved_path = (char*) link_data->wd_data->path;
-            
-            dir_stream = opendir(resolved_path);
-        
-            if (dir_stream == NULL)
-                continue;
+void coalesce_flush()
+{
+    COALESCED_EVENT *coalesced = coalesce_first;
+    unsigned int total = 0;
+    bool_t changed = FALSE;
+
+    while (coalesced != NULL) {
+        COALESCED_EVENT *next = coalesced->next;
+        total += coalesced->count;
+
+        /* With --skip-unchanged, a burst is executed if one of its events changed a file */
+        event_old_path = (blength(coalesced->old_path) > 0) ? (char *) coalesced->old_path->data : NULL;
+        int unchanged = fingerprint_unchanged(coalesced->event_name,
+                                              (char *) coalesced->event_p_path->data,
+                                              (char *) coalesced->file_name->data);
+        if (unchanged == 0)
+            changed = TRUE;
+
+        /* With --coalesce-burst only the last event of the window is executed */
+        if ((coalesce_burst_flag == FALSE && unchanged == 0)
+            || (coalesce_burst_flag == TRUE && next == NULL && changed == TRUE))
+        {
+            coalesce_c = (coalesce_burst_flag == TRUE) ? total : coalesced->count;
+
+            /* The regex catch (%x) have to match the name of this event */
+            regex_catch((char *) coalesced->file_name->data);
+            event_root = coalesced->root;
+            event_cookie = coalesced->cookie;
             
-            /* Traverse directory */
-            while ((dir = readdir(dir_stream))) {
-                if (dir->d_type == DT_LNK) {
-                    /* Retrieve absolute symlink path */
-                    char *link_path = (char *) malloc(strlen(resolved_path) + strlen(dir->d_name) + 1);
-                    strcpy(link_path, resolved_path);
-                    strcat(link_path, dir->d_name);
-                
-                    list_push(list, (void*) link_path);
-                }
+            if (execute_command(coalesced->event_name,
+                                (char *) coalesced->file_name->data,
+                                (char *) coalesced->event_p_path->data) == -1)
+            {
+                printf("ERROR OCCURED: Unable to execute the specified command!\n");
+                exit(1);
             }
-            closedir(dir_stream);
-            
-            if (link_node != NULL)
-                unwatch_symbolic_link(link_node);
         }
-    
-        list_free(list);
+
+        /* Keep it for the next windows */
+        coalesced->next = coalesce_pool;
+        coalesce_pool = coalesced;
+        
+        coalesced = next;
     }
+
+    event_old_path = NULL;
+    coalesce_first = coalesce_last = NULL;
+    hash_clear(coalesce_index);
+
+    end_batch();
 }
 
-// TODO push into cwatch.h
-LIST *list_of_referenced_path(const char *path)
-{
-    LIST *tmp_references_list = list_init();
-    LIST_NODE *node;
-    WD_DATA *wd_data;
+int execute_command_inline(char *event_name, char *file_name, char *event_p_path)
+{   
+    /* The job reused by each execution */
+    static JOB *job = NULL;
+    
+    log_message("EVENT TRIGGERED [%s] IN %s%s", event_name, event_p_path, file_name);
 
-    node = list_wd->first;
-    while (node) {
-        wd_data = (WD_DATA*) node->data;
+    /* Increase the exec counter */
+    ++exec_c;
+
+    /* Wait for a running command to terminate */
+    if (max_jobs > 0 && running_jobs >= max_jobs) {
+        JOB *queued = create_job();
+        if (queued == NULL || render_job(queued, event_name, file_name, event_p_path) == -1)
+            return -1;
         
-        if (wd_data->links->first != NULL
-            && (strncmp(path, wd_data->path, strlen(path)) == 0
-                || strncmp(path, wd_data->path, strlen(wd_data->path)) == 0)
-            && exists(wd_data->path, tmp_references_list) == FALSE)
-        {
-            list_push(tmp_references_list, (void*) wd_data->path);
-        }
-        node = node->next;
+        list_push(job_queue, (void *) queued);
+        return 0;
     }
+
+    if (job == NULL && (job = create_job()) == NULL)
+        return -1;
+
+    if (render_job(job, event_name, file_name, event_p_path) == -1)
+        return -1;
     
-    return tmp_references_list;
+    spawn_job(job);
+
+    return 0;
 }
 
-// TODO push into cwatch.h
-void remove_orphan_watched_resources(const char *path, LIST *references_list)
+JOB *create_job()
 {
-    LIST_NODE *node;
-    WD_DATA *wd_data;
-    
-    node = list_wd->first;
-    while (node) {
-        wd_data = (WD_DATA*) node->data;
-        
-        if (strcmp(root_path, wd_data->path) != 0
-            && wd_data->links->first == NULL
-            && is_child_of(wd_data->path, path) == TRUE
-            // && is_listed_as_orphan(wd_data->path, references_list) == TRUE) // REFACTOR OF exists(str, [])
-            && exists(wd_data->path, references_list) == FALSE)
-        {
-            /* Log Message */
-            char *message = (char *) malloc(MAXPATHLEN);
-            sprintf(message, "UNWATCHING: (fd:%d,wd:%d)\t\t\"%s\"", fd, wd_data->wd, wd_data->path);
-            log_message(message);
-                                
-            inotify_rm_watch(fd, wd_data->wd);
-            list_remove(list_wd, node);
-        }
-        node = node->next;
-    }
-}
+    JOB *job = (JOB *) malloc(sizeof(JOB));
+    if (job == NULL)
+        return NULL;
 
-void unwatch_symbolic_link(LIST_NODE *link_node)
-{   
-    LINK_DATA *link_data = (LINK_DATA*) link_node->data;
-    char *link_path = (char*) link_data->path;
-    WD_DATA *wd_data = (WD_DATA*) link_data->wd_data;
-    
-    /* Log Message */
-    char *message = (char *) malloc(MAXPATHLEN);
-    sprintf(message, "UNWATCHING SYMBOLIC LINK: \t\"%s\" -> \"%s\"", link_path, wd_data->path);
-    log_message(message);
+    int argc = (NULL != command_argv) ? command_argv->qty : 3;
     
-    list_remove(wd_data->links, link_node);
+    job->argv = (char **) malloc((argc + 1) * sizeof(char *));
+    job->args = bfromcstralloc(MAXPATHLEN, "");
     
-    /*
-     * if there is no other symbolic links that point to the
-     * watched resource and the watched resource is not a child
-     * of the the root path then unwatch it and relative orphan
-     * directories (no longer reached by any symbolic links within root_path)
-     */
-    if (wd_data->links->first == NULL
-        && is_child_of(wd_data->path, root_path) == FALSE)
-    {
-        LIST *references_list = list_of_referenced_path(wd_data->path);
-        if (NULL != references_list) {
-            remove_orphan_watched_resources(wd_data->path, references_list);
-        }
-        list_free(references_list);
+    if (job->argv == NULL || job->args == NULL) {
+        free(job->argv);
+        bdestroy(job->args);
+        free(job);
+        return NULL;
     }
+
+    job->number = 0;
+
+    return job;
 }
 
-int monitor()
+int render_job(JOB *job, char *event_name, char *file_name, char *event_p_path)
 {
-    /* Initialize patterns that will be replaced */
-    COMMAND_PATTERN_ROOT = bfromcstr("%r");
-    COMMAND_PATTERN_PATH = bfromcstr("%p");
-    COMMAND_PATTERN_FILE = bfromcstr("%f");
-    COMMAND_PATTERN_EVENT = bfromcstr("%e");
-    COMMAND_PATTERN_REGEX = bfromcstr("%x");
-    COMMAND_PATTERN_COUNT = bfromcstr("%n");
+    job->number = exec_c;
 
-    /* Initialize the exec count */
-    exec_c = 0;
+    /* cast exec_c (or the coalesced events count) to cstring */
+    sprintf(exec_cstr, "%u", (coalesce_ms > 0) ? coalesce_c : exec_c);
 
-    /* Buffer for File Descriptor */
-    char buffer[EVENT_BUF_LEN];
+    btrunc(job->args, 0);
 
-    /* inotify_event */
-    struct inotify_event *event = NULL;
-    struct event_t *triggered_event = NULL;
+    if (NULL == command_argv) {
+        format_command(command_template, event_p_path, file_name, event_name);
+        
+        if (bcatblk(job->args, tmp_command->data, blength(tmp_command) + 1) != BSTR_OK)
+            return -1;
+        
+        job->argv[0] = "sh";
+        job->argv[1] = "-c";
+        job->argv[2] = (char *) job->args->data;
+        job->argv[3] = NULL;
 
-    /* The real path of touched directory or file */
-    char *path = NULL;
-    size_t len;
-    int i;
-    
-    /* Temporary node information */
-    LIST_NODE *node = NULL;
-    WD_DATA *wd_data = NULL;
+        return 0;
+    }
     
-    /* Wait for events */
-    while ((len = read(fd, buffer, EVENT_BUF_LEN))) {
-        if (len < 0) {
-            printf("ERROR: UNABLE TO READ INOTIFY QUEUE EVENTS!!!\n");
-            exit(1);
-        }
+    /* Command token replacement, argument by argument (NUL terminated) */
+    int i, offset[command_argv->qty];
+    for (i = 0; i < command_argv->qty; ++i) {
+        format_command(argv_templates[i], event_p_path, file_name, event_name);
         
-        /* index of the event into file descriptor */
-        i = 0;
-        while (i < len) {
-            /* inotify_event */
-            event = (struct inotify_event*) &buffer[i];
+        offset[i] = blength(job->args);
+        if (bcatblk(job->args, tmp_command->data, blength(tmp_command) + 1) != BSTR_OK)
+            return -1;
+    }
 
-            /* Discard all filename that matches regular expression (-x option) */
-            if (excluded(event->name)) {
-                /* Next event */
-                i += EVENT_SIZE + event->len;
-                continue;
-            }
-            
-            /* Build the full path of the directory or symbolic link */
-            node = get_node_from_wd(event->wd);
-            if (node != NULL) {
-                wd_data = (WD_DATA *) node->data;
-                path = malloc(strlen(wd_data->path) + strlen(event->name) + 2);
-                strcpy(path, wd_data->path);
-                strcat(path, event->name);
-                if (event->mask & IN_ISDIR)
-                    strcat(path, "/");
-            } else {
-                /* Next event */
-                i += EVENT_SIZE + event->len;
-                continue;
-            }
-            
-            /* Call the specific event handler */
-            if (event->mask & event_mask
-                && (triggered_event = get_inotify_event(event->mask & event_mask)) != NULL
-                && triggered_event->name != NULL
-                && regex_catch(event->name)
-                && triggered_event->handler(event, path) == 0)
-            {
-                if (execute_command(triggered_event->name, event->name, wd_data->path) == -1) {
-                    printf("ERROR OCCURED: Unable to execute the specified command!\n");
-                    exit(1);
-                }
-            } else {
-                free(path);
-            }
-            
-            /* Next event */
-            i += EVENT_SIZE + event->len;
-        }
+    /* The arguments are no longer moved */
+    for (i = 0; i < command_argv->qty; ++i) {
+        job->argv[i] = (char *) job->args->data + offset[i];
     }
+    job->argv[command_argv->qty] = NULL;
 
     return 0;
 }
 
-int execute_command_inline(char *event_name, char *file_name, char *event_p_path)
-{   
-    /* For log purpose */
-    char *message = (char *) malloc(MAXPATHLEN);
-
-    /* Increase the exec counter */
-    ++exec_c;
+void free_job(JOB *job)
+{
+    bdestroy(job->args);
+    free(job->argv);
+    free(job);
+}
 
-    /* Execute the command */
-    pid_t pid = fork();
-    if (pid > 0) {
-        /* parent process */
-
-        sprintf(message, "EVENT TRIGGERED [%s] IN %s%s\n%u) PROCESS EXECUTED [pid: %d command: %s]",
-                event_name, event_p_path, file_name, exec_c, pid, command->data);
-        log_message(message);
-    } else if (pid == 0) {
-        /* child process */
-       
-        /* cast exec_c to cstring */
-        sprintf(exec_cstr, "%u", exec_c);
-
-        /* Command token replacement */
-        tmp_command = format_command((char *) command->data, event_p_path, file_name, event_name);
-
-        int exit = 0;
-        exit = system((const char*) tmp_command->data);
-
-        if (exit == -1 || exit == 127) {
-            sprintf(message, "Unable to execute the specified command!");
-            log_message(message);
-        }
+int spawn_job(JOB *job)
+{
+    /* Initialized once, see below */
+    static posix_spawn_file_actions_t actions;
+    static posix_spawnattr_t attributes;
+    static bool_t initialized = FALSE;
+    pid_t pid;
+
+    /* The command does not inherit the inotify fd, the blocked SIGCHLD and the ignored SIGPIPE */
+    if (initialized == FALSE) {
+        sigset_t mask;
         
-    	bdestroy(tmp_command);
-    } else {
-        /* error occured */
-        sprintf(message, "ERROR during the fork() !!!");
-        log_message(message);
-        exit(1);
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_addclose(&actions, fd);
+
+        posix_spawnattr_init(&attributes);
+        posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+        sigemptyset(&mask);
+        posix_spawnattr_setsigmask(&attributes, &mask);
+        sigaddset(&mask, SIGPIPE);
+        posix_spawnattr_setsigdefault(&attributes, &mask);
+
+        initialized = TRUE;
+    }
+
+    uint64_t spawn_start = metrics_now();
+    int error = (NULL != command_argv)
+        ? posix_spawnp(&pid, job->argv[0], &actions, &attributes, job->argv, environ)
+        : posix_spawn(&pid, "/bin/sh", &actions, &attributes, job->argv, environ);
+    metrics_observe(METRIC_SPAWN_LATENCY, spawn_start);
+
+    if (error != 0) {
+        log_message("Unable to execute the specified command! (%s)", strerror(error));
+        metrics_count(METRIC_COMMAND_FAILURES);
+        return -1;
     }
 
+    metrics_count(METRIC_COMMANDS_SPAWNED);
+
+    ++running_jobs;
+
+    /* With --daemon, a queued job is not the one of a spec, it is executed through /bin/sh */
+    log_message("%u) PROCESS EXECUTED [pid: %d command: %s]", job->number, pid,
+                (NULL != command) ? (char *) command->data : job->argv[2]);
+
     return 0;
 }
 
+void reap_jobs()
+{
+    pid_t pid;
+    int status;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        /* The batch process is restarted by batch_flush() */
+        if (batch_flag == TRUE && pid == batch_pid)
+            continue;
+
+        --running_jobs;
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            metrics_count(METRIC_COMMAND_FAILURES);
+
+        if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+            /* Log Message */
+            if (WEXITSTATUS(status) == 127)
+                log_message("Unable to execute the specified command! [pid: %d]", pid);
+            else
+                log_message("PROCESS TERMINATED [pid: %d status: %d]", pid, WEXITSTATUS(status));
+        }
+    }
+
+    /* Execute the queued commands */
+    while (job_queue->first != NULL && (max_jobs == 0 || running_jobs < max_jobs)) {
+        JOB *job = (JOB *) list_pop(job_queue);
+        spawn_job(job);
+        free_job(job);
+    }
+}
+
 int execute_command_embedded(char *event_name, char *file_name, char *event_p_path)
 {
-    /* For log purpose */
-    char *message = (char *) malloc(MAXPATHLEN);
     
-    sprintf(message, "EVENT TRIGGERED [%s] IN %s%s", event_name, event_p_path, file_name);
-    log_message(message);
+    log_message("EVENT TRIGGERED [%s] IN %s%s", event_name, event_p_path, file_name);
+
+    /* Incrementate and convert exec_c (or the coalesced events count) to cstring */
+    ++exec_c;
+    sprintf (exec_cstr, "%u", (coalesce_ms > 0) ? coalesce_c : exec_c);
+
+    /* Buffer the record, the records of the events read are written at once */
+    return output_event(event_name, file_name, event_p_path);
+}
+
+int execute_command_batch(char *event_name, char *file_name, char *event_p_path)
+{
+    
+    log_message("EVENT TRIGGERED [%s] IN %s%s", event_name, event_p_path, file_name);
 
-    /* Incrementate and convert exec_c to cstring */
+    /* Incrementate and convert exec_c (or the coalesced events count) to cstring */
     ++exec_c;
-    sprintf (exec_cstr, "%u", exec_c);
+    sprintf (exec_cstr, "%u", (coalesce_ms > 0) ? coalesce_c : exec_c);
+
+    /* Append the record, it will be written by batch_flush() */
+    format_command(command_template, event_p_path, file_name, event_name);
+
+    bconcat(batch_buffer, tmp_command);
+    bconchar(batch_buffer, (batch_null_flag == TRUE) ? '\0' : '\n');
+
+    return 0;
+}
+
+int batch_start()
+{
+    int pipe_fd[2];
+
+    if (pipe(pipe_fd) == -1)
+        return -1;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        /* child process: read the records from the standard input */
+        dup2(pipe_fd[0], STDIN_FILENO);
+        close(pipe_fd[0]);
+        close(pipe_fd[1]);
+        close(fd);
+
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+        signal(SIGPIPE, SIG_DFL);
+
+        execl("/bin/sh", "sh", "-c", (char *) command->data, (char *) NULL);
+        _exit(127);
+    } else if (pid == -1) {
+        close(pipe_fd[0]);
+        close(pipe_fd[1]);
+        return -1;
+    }
+
+    close(pipe_fd[0]);
+    batch_pid = pid;
+    batch_fd = pipe_fd[1];
+
+    if (NULL == batch_buffer)
+        batch_buffer = bfromcstr("");
+
+    /* A terminated batch process is detected by write() */
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Log Message */
+    log_message("BATCH PROCESS EXECUTED [pid: %d command: %s]", batch_pid, command->data);
+
+    return 0;
+}
+
+int batch_flush()
+{
+    int written = 0;
+    bool_t restarted = FALSE;
+
+    while (written < blength(batch_buffer)) {
+        ssize_t n = write(batch_fd, batch_buffer->data + written, blength(batch_buffer) - written);
+
+        if (n == -1 && errno == EINTR)
+            continue;
+
+        /*
+         * The batch process is terminated: restart it (only once per flush)
+         * and write it the records that it have not received
+         */
+        if (n == -1 && errno == EPIPE && restarted == FALSE) {
+            /* Log Message */
+            log_message("BATCH PROCESS TERMINATED [pid: %d], restarting it", batch_pid);
+
+            close(batch_fd);
+            waitpid(batch_pid, NULL, 0);
+
+            if (batch_start() == -1)
+                return -1;
+
+            restarted = TRUE;
+            continue;
+        }
+
+        if (n == -1)
+            return -1;
 
-    /* Output the formatted string */
-    tmp_command = format_command((char *) format->data, event_p_path, file_name, event_name);
+        written += n;
+    }
 
-    fprintf(stdout, "%s\n", (char *) tmp_command->data);
-    fflush(stdout);
+    btrunc(batch_buffer, 0);
 
-    bdestroy(tmp_command);
     return 0;
 }
 
@@ -1061,7 +2951,18 @@ int event_handler_create(struct inotify_event *event, char *path)
     
     /* Check for a directory */
     if (event->mask & IN_ISDIR) {
-        watch(path, NULL);
+        adopt(path, NULL);
+    } else if (nosymlink_flag == FALSE && uring_enabled()) {
+        /* Check for a symbolic link, its target is resolved from the descriptor opened */
+        int target_fd = open(path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (target_fd != -1) {
+            char *real_path = fd_real_path(target_fd);
+            close(target_fd);
+
+            if (real_path != NULL)
+                adopt(real_path, strdup(path));
+            free(real_path);
+        }
     } else if (nosymlink_flag == FALSE) {
         /* Check for a symbolic link */
         bool_t is_dir = FALSE;
@@ -1073,7 +2974,9 @@ int event_handler_create(struct inotify_event *event, char *path)
         if (is_dir == TRUE) {
             /* resolve symbolic link */
             char *real_path = resolve_real_path(path);
-            watch(real_path, path);
+            if (real_path != NULL)
+                adopt(real_path, strdup(path));
+            free(real_path);
         }
     }
 
@@ -1087,12 +2990,9 @@ int event_handler_delete(struct inotify_event *event, char *path)
         unwatch(path, FALSE);
     } else if (nosymlink_flag == FALSE) {
         /*
-         * XXX Since it is not possible to know if the
-         *     inotify event belongs to a file or a symbolic link,
-         *     the unwatch function will be called for each file.
-         *     That is because the file is deleted from filesystem,
-         *     so there is no way to stat it.
-         *     This is a big computational issue to be treated.
+         * Since it is not possible to know if the inotify event
+         * belongs to a file or a symbolic link (it is deleted, there
+         * is no way to stat it), the path is searched in link_index.
          */
         unwatch(path, TRUE);
     }
@@ -1107,7 +3007,7 @@ int event_handler_moved_from(struct inotify_event *event, char *path)
 
 int event_handler_moved_to(struct inotify_event *event, char *path)
 {
-    if (strncmp(path, root_path, strlen(root_path)) == 0)
+    if (get_root_of(path) != NULL)
         return event_handler_create(event, path);
     
     return 0; /* do nothing */
@@ -25,7 +25,13 @@
 #ifndef __CWATCH_H
 #define __CWATCH_H
 
+/* pipe2(), ... */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <strings.h>
 #include <stdlib.h>
@@ -35,25 +41,58 @@
 #include <getopt.h>
 #include <dirent.h>
 #include <regex.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <spawn.h>
 #include <sys/inotify.h>
 #include <sys/param.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
 
 #include "bstrlib.h"
 #include "list.h"
+#include "slab.h"
+#include "hash.h"
+#include "trie.h"
+#include "scan.h"
+#include "backend.h"
+#include "loop.h"
+#include "resync.h"
+#include "budget.h"
+#include "state.h"
+#include "exclude.h"
+#include "rules.h"
+#include "metrics.h"
+#include "logger.h"
+#include "reader.h"
+#include "uring.h"
+#include "adopt.h"
+#include "daemon.h"
+#include "fingerprint.h"
+#include "output.h"
 
 #define PROGRAM_NAME    "cwatch"
 #define PROGRAM_VERSION "1.2.3"
 #define PROGRAM_STAGE   "experimental"
 
 #define EVENT_SIZE      (sizeof (struct inotify_event))
-#define EVENT_BUF_LEN   (1024 * ( EVENT_SIZE + 16 ))
+#define EVENT_BUF_LEN   (1024 * ( EVENT_SIZE + 16 ))  /* default size of the read buffer */
+#define EVENT_READ_MIN  4096                          /* the buffer left to read more events */
+#define READ_BUFFER_MAX (256 * 1024 * 1024)
+#define LOG_MESSAGE_LEN (2 * MAXPATHLEN + 128)
+#define WD_SLAB_CHUNK   1024                          /* the wd_data allocated at once */
+#define MOVE_PAIR_MS    20                            /* the wait of an IN_MOVED_FROM for its IN_MOVED_TO */
+#define MOVE_SLAB_CHUNK 64                            /* the pending moves allocated at once */
+
+typedef enum {FALSE,TRUE} bool_t;
 
 /*
  * List of pattern that will be replaced during the command execution
- * Note: See their initialization in the monitor() function
+ * Note: the command/format is compiled once by compile_template()
  *
  * _ROOT  (%r) when cwatch execute the command, will be replaced with the
- *             root monitored directory
+ *             root monitored directory the event belongs to
  * _PATH  (%p) when cwatch execute the command, will be replaced with the
  *             absolute full path of the file or directory where the
  *             event occurs
@@ -67,22 +106,68 @@
  *             suited by -X --regex-catch option
  * _COUNT (%n) when cwatch execute the command, will be replaced with the
  *             count of the events
+ * _OLD   (%o) when cwatch execute the command, will be replaced with the
+ *             full path the file or directory had before a rename
  */
-const_bstring COMMAND_PATTERN_ROOT;
-const_bstring COMMAND_PATTERN_PATH;
-const_bstring COMMAND_PATTERN_FILE;
-const_bstring COMMAND_PATTERN_EVENT;
-const_bstring COMMAND_PATTERN_REGEX;
-const_bstring COMMAND_PATTERN_COUNT;
+typedef enum
+{
+    SEGMENT_LITERAL,      /* text copied as it is */
+    SEGMENT_ROOT,         /* %r */
+    SEGMENT_PATH,         /* %p */
+    SEGMENT_FILE,         /* %f */
+    SEGMENT_EVENT,        /* %e */
+    SEGMENT_REGEX,        /* %x */
+    SEGMENT_COUNT,        /* %n */
+    SEGMENT_OLD           /* %o */
+} segment_t;
+
+/* A piece of a compiled command/format */
+typedef struct segment_s
+{
+    segment_t kind;
+    char      *data;      /* the text of a SEGMENT_LITERAL */
+    int       length;     /* the length of the text */
+} SEGMENT;
 
-typedef enum {FALSE,TRUE} bool_t;
+/* A command/format compiled in its literal and special characters segments */
+typedef struct template_s
+{
+    SEGMENT *segments;
+    int     qty;
+    bool_t  uses_regex;   /* TRUE if %x have to be computed */
+} TEMPLATE;
+
+
+/*
+ * Used to store information about watched resource
+ * They are allocated from a slab, and the path is not stored: it is
+ * the chain of the names of its wd_tree node (see get_wd_path).
+ *
+ * The symbolic links are the edges of a graph between the directories:
+ * each one is in the links of its target and in the owned links of the
+ * directory containing it. A directory outside of the roots is watched
+ * as long as it, or one of its ancestors, is referenced by a link.
+ */
+#define WD_FRONTIER 0x1    /* some subdirectories are not watched (see budget.h) */
 
-/* Used to store information about watched resource */
 typedef struct wd_data_s
 {
+    LIST_NODE node;       /* its node of list_wd (the data points to the wd_data itself) */
     int    wd;            /* watch descriptor */
-    char   *path;         /* absolute real path of the directory */
-    LIST   *links;        /* list of symlinks that point to this resource */
+    uint32_t flags;       /* WD_FRONTIER */
+    TRIE_NODE *entry;     /* its node of wd_tree */
+    LIST   *links;        /* list of symlinks that point to this resource, NULL when there is none */
+    LIST   *owned;        /* list of symlinks in this directory, NULL when there is none */
+    char   *root;         /* the root directory it belongs to (one of root_paths) */
+    RULE   *rule;         /* the rule of the directory (--rules option), NULL if there is none */
+    uint32_t mask;        /* the events watched, the ones of the rule or event_mask */
+    uint32_t refs;        /* the number of links, the directory is kept watched while it is not 0 */
+
+    /* Snapshot of the directory, compared by resync() */
+    ino_t           ino;
+    nlink_t         nlink;
+    struct timespec mtime;
+    struct timespec synced;   /* when the snapshot was taken */
 } WD_DATA;
 
 /* Used to store information about symbolic link */
@@ -90,8 +175,51 @@ typedef struct link_data_s
 {
     char    *path;         /* absolute real path of the symbolic link */
     WD_DATA *wd_data;      /* a pointer to it wd_data */
+    LIST_NODE *node;       /* its node of the links of its target */
+    WD_DATA *owner;        /* the directory containing the symbolic link, NULL if it is not watched */
+    LIST_NODE owned;       /* its node of the owned links of the owner */
 } LINK_DATA;
 
+/*
+ * Used to store an event waiting for the end of the coalescing window
+ * They are kept in a free list once executed, and reused.
+ */
+typedef struct coalesced_event_s
+{
+    bstring      key;           /* the coalescing key: event name and full path */
+    char         *event_name;   /* the inotify event name */
+    char         *root;         /* the root directory of the event (%r) */
+    uint32_t     cookie;        /* the cookie of the event (--output option) */
+    bstring      file_name;     /* the name of file/directory that triggered the event */
+    bstring      event_p_path;  /* the path where event occured */
+    bstring      old_path;      /* the path before a rename (%o), empty otherwise */
+    unsigned int count;         /* the number of events folded together */
+    struct coalesced_event_s *next; /* the next event of the window (or of the free list) */
+} COALESCED_EVENT;
+
+/*
+ * Used to store an IN_MOVED_FROM waiting for the IN_MOVED_TO with the same cookie
+ * Paired, they are a rename inside the watched tree (see dispatch_events).
+ */
+typedef struct pending_move_s
+{
+    int             wd;             /* the directory the file or directory is moved from */
+    uint32_t        mask;
+    uint32_t        cookie;
+    struct timespec time;           /* when the IN_MOVED_FROM was read */
+    char            name[NAME_MAX + 1];
+    struct pending_move_s *prev;    /* the pending moves, oldest first */
+    struct pending_move_s *next;
+} PENDING_MOVE;
+
+/* Used to store a command to be executed */
+typedef struct job_s
+{
+    char         **argv;        /* the arguments of the command, NULL terminated */
+    bstring      args;          /* the replaced arguments one after the other, argv points into it */
+    unsigned int number;        /* the exec count of the command (for log purpose) */
+} JOB;
+
 /*
  * Used to describe an event in the events LUT.
  * See the complete LUT definition int cwatch.c
@@ -105,30 +233,86 @@ struct event_t
         );                /* function handler called when the event occurs */
 };
 
-char *root_path;                /* root path that cwatch is monitoring */
+char **root_paths;              /* the root paths that cwatch is monitoring (-d option) */
+unsigned int roots_qty;         /* the number of root paths */
+char *event_root;               /* the root path of the event being executed (%r) */
+uint32_t event_cookie;          /* the cookie of the event being executed (--output option) */
+char *event_old_path;           /* the path before the rename being executed (%o), NULL otherwise */
 bstring command;                /* the command to be execute, defined by -c option*/
 bstring format;                 /* a string containing the output format defined by -F option */
 bstring tmp_command;            /* temporary command used by execute_command */
+TEMPLATE *command_template;     /* the compiled command (or format) */
+TEMPLATE **argv_templates;      /* the compiled arguments of command_argv */
 int (*execute_command)(
     char *,
     char *,
     char *);                    /* the command to be executed when an event is triggered */
-struct bstrList *split_event;   /* list of events parsed from command line */
 uint32_t event_mask;            /* the resulting event_mask */
-regex_t *exclude_regex;         /* the posix regular expression defined by -x option */
+EXCLUDE *exclude_patterns;      /* the patterns defined by -x and --exclude-glob options */
 regex_t *user_catch_regex;      /* the posix regular expression defined by -X option */
 regmatch_t p_match[2];          /* store the matched regular expression by -X option */
 
-int fd;                         /* inotify file descriptor */
+int fd;                         /* file descriptor of the notification backend */
+struct backend_t *backend;      /* the notification backend defined by --backend option */
+size_t read_buffer_len;         /* the size of the read buffer defined by --read-buffer option */
+bool_t reader_flag;             /* TRUE if --reader-thread option is given */
+bool_t uring_flag;              /* TRUE if --io-uring option is given */
+bool_t resync_pending;          /* the kernel queue overflowed, resync() has to be called */
+char *state_file;               /* the state file defined by --state-file option */
+unsigned int state_interval;    /* the seconds between the saves of the state file */
+bool_t state_interval_set;      /* TRUE if --state-interval option is given */
+char *metrics_socket;           /* the UNIX socket defined by --metrics-socket option */
+char *daemon_socket;            /* the control socket defined by --daemon option */
+output_mode_t output_mode;      /* the encoding of the records defined by --output option */
+bool_t output_flag;             /* TRUE if --output option is given */
+unsigned int output_flush_ms;   /* the max delay of the records defined by --output-flush option */
+unsigned int log_rate;          /* the max log messages per second defined by --log-rate option */
+bool_t log_rate_set;            /* TRUE if --log-rate option is given */
 LIST *list_wd;                  /* the list of all watched resource */
+HASH *wd_index;                 /* index of the list_wd nodes by watch descriptor */
+HASH *link_index;               /* index of the symbolic link nodes by symlink path */
+TRIE_NODE *wd_tree;             /* tree of the list_wd nodes by real path */
+PENDING_MOVE *moves_first;      /* the IN_MOVED_FROM waiting for their IN_MOVED_TO, oldest first */
+PENDING_MOVE *moves_last;
+HASH *moves_index;              /* index of the pending moves by cookie */
+LOOP_SOURCE *move_timer;        /* expires when the oldest pending move is not paired in time */
 
 unsigned int exec_c;             /* the number of times command is executed */
 char exec_cstr[10];              /* used as conversion of exec_c to cstring */
 
+unsigned int coalesce_ms;        /* the coalescing window defined by --coalesce option */
+unsigned int coalesce_c;         /* the number of events folded in the coalesced event executed */
+LOOP_SOURCE *coalesce_timer;     /* expires at the end of the coalescing window */
+COALESCED_EVENT *coalesce_first; /* the events waiting for the end of the coalescing window */
+COALESCED_EVENT *coalesce_last;
+COALESCED_EVENT *coalesce_pool;  /* the coalesced events executed, ready to be reused */
+HASH *coalesce_index;            /* index of the waiting events by coalescing key */
+bstring coalesce_key;            /* the key of the last coalesced event */
+
 bool_t nosymlink_flag;
 bool_t recursive_flag;
 bool_t verbose_flag;
 bool_t syslog_flag;
+bool_t coalesce_burst_flag;
+bool_t batch_flag;
+bool_t batch_null_flag;
+bool_t skip_unchanged_flag;
+
+unsigned int max_jobs;           /* the max number of running commands defined by --max-jobs option */
+unsigned int running_jobs;       /* the number of running commands */
+LIST *job_queue;                 /* the commands waiting for a running one to terminate */
+unsigned int scan_threads;       /* the number of threads used by the initial scan (--scan-threads option) */
+size_t max_watches;              /* the budget of watches defined by --max-watches option, 0 if there is none */
+size_t fingerprint_cache_size;   /* the files fingerprinted defined by --fingerprint-cache option */
+unsigned int eager_depth;        /* the levels watched at once defined by --eager-depth option */
+bool_t eager_depth_set;          /* TRUE if --eager-depth option is given */
+unsigned int sweep_interval;     /* the seconds between the sweeps defined by --sweep-interval option */
+bool_t sweep_interval_set;       /* TRUE if --sweep-interval option is given */
+struct bstrList *command_argv;   /* the arguments of the command, when it is executed without the shell */
+
+pid_t batch_pid;                 /* the process started by --batch option */
+int batch_fd;                    /* the pipe connected to the standard input of batch_pid */
+bstring batch_buffer;            /* the records waiting to be written to batch_fd */
 
 /**
  * Print the version of the program and exit
@@ -147,9 +331,11 @@ int help(int);
  * Log
  * 
  * Log message via syslog or via standard output
- * @param char * : Message to log
+ * The message is formatted in a buffer on the stack.
+ * @param char * : printf-like format of the message to log
+ * @param ...    : the arguments of the format
  */
-void log_message(char *);
+void log_message(const char *, ...);
 
 /**
  * Resolve the real path
@@ -184,7 +370,30 @@ LIST_NODE *get_node_from_wd(const int);
  * @param int *      : the watch descriptor
  * @return WD_DATA * : a pointer to WD_DATA, NULL otherwise.
  */
-WD_DATA *create_wd_data(char *, int);
+WD_DATA *create_wd_data(const char *, int);
+
+/**
+ * Build the real path of a watched directory
+ * @param WD_DATA * : the wd_data of the directory
+ * @param char *    : the buffer, of MAXPATHLEN + 1 bytes
+ * @return char *   : the buffer
+ */
+char *get_wd_path(const WD_DATA *, char *);
+
+/**
+ * Take the snapshot of a watched directory (inode, mtime and links count)
+ * @param WD_DATA * : the wd_data of the directory
+ * @param char *    : the real path of the directory
+ */
+void snapshot_wd_data(WD_DATA *, const char *);
+
+/**
+ * Compare two timestamps
+ * @param struct timespec * : the first timestamp
+ * @param struct timespec * : the second timestamp
+ * @return int              : -1 if the first one is before the second one, 1 if it is after, 0 otherwise
+ */
+int timespec_compare(const struct timespec *, const struct timespec *);
 
 /**
  * Searchs and returns the list_node from symlink path
@@ -230,6 +439,35 @@ LINK_DATA *create_link_data(char *, WD_DATA *);
  */
 bool_t is_child_of(const char *, const char *);
 
+/**
+ * Check a directory to monitor, and make its path absolute
+ * @param char *  : the directory
+ * @return char * : the path ending with a slash, NULL if it is not a directory
+ */
+char *resolve_root(const char *);
+
+/**
+ * Add a root path to monitor, -d can be given more than once
+ * The path is checked and made absolute, the duplicates are ignored.
+ * @param char * : the directory to monitor
+ * @return int   : -1 if it is not a directory, 0 otherwise
+ */
+int add_root(const char *);
+
+/**
+ * Returns the deepest root path that contains a path
+ * @param char *  : the path
+ * @return char * : the root path, NULL if the path is outside of every root
+ */
+char *get_root_of(const char *);
+
+/**
+ * Returns TRUE if the path is one of the root paths
+ * @param char * : the path
+ * @return bool_t
+ */
+bool_t is_root(const char *);
+
 /**
  * Checks whetever a string exists in a list
  *
@@ -239,9 +477,9 @@ bool_t is_child_of(const char *, const char *);
 bool_t exists(char *, LIST *);
 
 /**
- * Checks whetever a string match the regular
- * expression pattern defined with -x option
- * See: exclude_regex
+ * Checks whetever a string match one of the patterns
+ * defined with -x and --exclude-glob options
+ * See: exclude_match
  *
  * @param char * : string to check
  */
@@ -257,24 +495,36 @@ bool_t excluded(char *);
 bool_t regex_catch(char *);
 
 /**
- * Return the subexpression matched by regex_catch
+ * Compile a command/format
  *
- * @param  char * : string to check
- * @return char * : matched subexpression
+ * Split the command/format specified by the user in literal
+ * segments and special characters, so that each execution
+ * only has to copy them (see format_command).
+ * @param char *       : the command (-c) or the format (-F) defined by user
+ * @return TEMPLATE *  : the compiled command/format, NULL in case of error
  */
-char *get_regex_catch(char *);
+TEMPLATE *compile_template(const char *);
 
 /**
  * Replace all occurrences in the command/format
  * specified by the user, with the special characters
  *
- * @param char *   : the command (-c) or the format (-F) defined by user
- * @param char *   : the full path in which event was triggered
- * @param char *   : the name of the file or directory that triggered the event
- * @param char *   : the event name
- * @return bstring : the resulting string with all occurrences replaced
+ * The result is written in tmp_command, that is reused
+ * by each call: copy it if it have to be kept.
+ * @param TEMPLATE * : the compiled command (-c) or format (-F)
+ * @param char *     : the full path in which event was triggered
+ * @param char *     : the name of the file or directory that triggered the event
+ * @param char *     : the event name
+ * @return bstring   : the resulting string with all occurrences replaced
  */
-bstring format_command(char *, char *, char *, char *);
+bstring format_command(const TEMPLATE *, char *, char *, char *);
+
+/**
+ * Parse a list of events, as given to the -e option
+ * @param char *      : the events separated by comma (create,delete,...)
+ * @return uint32_t   : the inotify event mask, 0 if an event is not valid
+ */
+uint32_t parse_events(const char *);
 
 /**
  * Parse command line
@@ -295,42 +545,127 @@ int parse_command_line(int, char **);
  * @param char * : The symbolic link that point to the path
  * @return int   : -1 (An error occurred), 0 (Resource added correctly)
  */
-int watch(char *, char *);
+int watch(const char *, char *);
 
 /**
  * Add a directory into watch list
  *
- * This function is used to append a directory into watch list
+ * This function is used to append a directory into watch list,
+ * it is watched for the events of its rule (see get_rule).
+ * The directories skipped by a rule are not added.
+ * The path is copied, the symbolic link is kept by the watch list.
  * @param char* : The absolute path of the directory to watch
  * @param char* : The symbolic link that point to the path
  * @return LIST_NODE* : the pointer of the node of the watch list
  */
-LIST_NODE *add_to_watch_list(char *, char *);
+LIST_NODE *add_to_watch_list(const char *, char *);
+
+/**
+ * Add a directory already watched by the backend into watch list
+ *
+ * Used by the scan threads, that watch a directory before listing it
+ * (see parallel_watch). Nothing is done if it is in the watch list.
+ * @param char* : The absolute path of the directory
+ * @param int   : Its watch descriptor
+ * @return LIST_NODE* : the pointer of the node of the watch list
+ */
+LIST_NODE *add_watched_to_watch_list(const char *, int);
+
+/**
+ * Rename a watched directory, with the directories below it
+ *
+ * The watch descriptors are kept valid by a rename: only the wd_tree
+ * node of the directory is moved, the symbolic links below it are
+ * re-keyed, and the root and the rule of each directory are updated.
+ * @param char * : the old path of the directory
+ * @param char * : the new path of the directory
+ * @return int   : -1 if the directory has to be watched again instead, 0 otherwise
+ */
+int rename_watched(const char *, const char *);
+
+/**
+ * Handle the pending moves that are not paired in time (see MOVE_PAIR_MS)
+ * as moved out of the watched tree
+ * @param bool_t : TRUE to handle all of them, whatever their age
+ */
+void expire_moves(bool_t);
 
 /**
  * Unwatch a directory
  * 
- * Used to remove a file or directory
- * from the list of watched resources
+ * Used to remove a file or directory (and the directories below it)
+ * from the list of watched resources. A path that is not a known
+ * symbolic link costs a lookup of link_index.
  * @param char * : the path of the resource to remove
  * @param bool_t : TRUE if the path to unwatch is a symlink, FALSE otherwise.
  */
 void unwatch(char *, bool_t);
 
+/**
+ * Unwatch a directory that is no longer a root path (see --daemon)
+ * The subtrees of the other root paths and the directories referenced
+ * by a symbolic link are kept.
+ * @param char * : the path of the directory
+ */
+void unwatch_root(const char *);
+
 /**
  * Unwatch a symbolic link from the watched resources
  *
+ * The directories that are no longer reached by the root paths or
+ * by a symbolic link are unwatched, with the links they contain
+ * (the graph of the links is followed, the directories are not read).
  * @param LIST_NODE * : the list_node of the symbolic link to unwatch
  */
 void unwatch_symbolic_link(LIST_NODE *);
 
+/**
+ * Handle the inotify_event records of a buffer
+ *
+ * The event handlers are called and the command is executed
+ * (or coalesced) for each event, as they are read from the backend.
+ * @param char *  : the buffer (aligned as an inotify_event)
+ * @param ssize_t : the length of the records
+ */
+void dispatch_events(char *, ssize_t);
+
+/**
+ * Write the records of the events executed at once (--batch and --output options)
+ */
+void end_batch();
+
 /**
  * Start monitoring
  * 
- * Used to monitor inotify event on watched resources
+ * Used to monitor inotify event on watched resources.
+ * The event loop reads the backend, the terminated commands (SIGCHLD)
+ * and the coalescing timer, until SIGINT or SIGTERM.
+ * @return int : -1 in case of error, 0 otherwise
  */
 int monitor();
 
+/**
+ * Coalesce an event
+ *
+ * Used when the --coalesce option is given, instead of executing the command
+ * the event is kept until the end of the coalescing window. Events with
+ * the same name and path are folded together.
+ * @param char *  : the inotify event name
+ * @param char *  : the name of file/directory that triggered the event
+ * @param char *  : the path where event occured
+ * @return int    : -1 in case of error, 0 otherwise
+ */
+int coalesce_event(char *, char *, char *);
+
+/**
+ * Execute the command for the coalesced events
+ *
+ * Once for each coalesced event, or once for the whole window
+ * when the --coalesce-burst option is given.
+ * %n is replaced with the number of events folded together.
+ */
+void coalesce_flush();
+
 /**
  * Execute a command
  * *_inline   : called when the -c --command option is given
@@ -345,6 +680,65 @@ int monitor();
 
 int execute_command_inline(char *, char *, char *);
 int execute_command_embedded(char *, char *, char *);
+int execute_command_batch(char *, char *, char *);
+
+/**
+ * Create an empty job, its arguments are
+ * allocated once and reused by render_job().
+ *
+ * @return JOB *  : the job, NULL in case of error
+ */
+JOB *create_job();
+
+/**
+ * Prepare the arguments of a job
+ *
+ * The special characters of the command are replaced and
+ * the command is split in its arguments (see command_argv),
+ * otherwise it is executed through the shell.
+ * @param JOB *   : the job
+ * @param char *  : the inotify event name
+ * @param char *  : the name of file/directory that triggered the event
+ * @param char *  : the path where event occured
+ * @return int    : -1 in case of error, 0 otherwise
+ */
+int render_job(JOB *, char *, char *, char *);
+
+/**
+ * Deallocate a job
+ */
+void free_job(JOB *);
+
+/**
+ * Execute a job through posix_spawn()
+ *
+ * @param JOB * : the job to execute
+ * @return int  : -1 in case of error, 0 otherwise
+ */
+int spawn_job(JOB *);
+
+/**
+ * Reap the terminated commands and execute the queued ones
+ * as long as the --max-jobs limit allows it.
+ */
+void reap_jobs();
+
+/**
+ * Start the batch process
+ *
+ * Used when the --batch option is given, the command is started
+ * once and the events are written to its standard input.
+ * @return int : -1 in case of error, 0 otherwise
+ */
+int batch_start();
+
+/**
+ * Write the records collected by execute_command_batch()
+ * to the batch process, restarting it if it is terminated.
+ *
+ * @return int : -1 in case of error, 0 otherwise
+ */
+int batch_flush();
 
 /**
  * Get the inotify event handler from the event mask
@@ -0,0 +1,510 @@
+/* daemon.c
+ * The watch specs served from one process, through a control socket
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "cwatch.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+
+#define DAEMON_WRITE_MS 1000       /* the max wait of a reply for a client that does not read it */
+
+/* Used to store a watch spec */
+typedef struct spec_s
+{
+    unsigned int id;
+    char         *root;             /* the root path (see resolve_root) */
+    char         *request;          /* the arguments of the add request, for the list request */
+    uint32_t     mask;
+    EXCLUDE      *exclude;          /* the names excluded, NULL if there is none */
+    bstring      command;           /* the COMMAND (executed through /bin/sh), NULL otherwise */
+    bstring      format;            /* the FORMAT, NULL otherwise */
+    TEMPLATE     *template;         /* the compiled COMMAND or FORMAT */
+} SPEC;
+
+/* A client of the control socket */
+typedef struct client_s
+{
+    int         fd;
+    LOOP_SOURCE *source;
+    bstring     input;             /* the bytes read after the last complete line */
+} CLIENT;
+
+static LIST *specs;                /* the watch specs, by id */
+static unsigned int last_id;
+static uint32_t default_mask;      /* the events of the specs without events= (-e option) */
+
+/* The root paths of the specs removed, they could still be used by a coalesced event */
+static LIST *retired_roots;
+
+static int daemon_fd = -1;
+static char *daemon_path;
+
+/* The bit of an event name (see get_inotify_event), a rename is a move */
+static uint32_t event_bit(const char *event_name)
+{
+    int i;
+
+    if (strcmp(event_name, "rename") == 0)
+        return IN_MOVE;
+
+    for (i = 0; i < 32; ++i) {
+        struct event_t *event = get_inotify_event(1U << i);
+        if (event->name != NULL && strcmp(event->name, event_name) == 0)
+            return 1U << i;
+    }
+
+    return 0;
+}
+
+static bool_t spec_matches(const SPEC *spec, uint32_t bit, const char *file_name, const char *event_p_path)
+{
+    const char *below = NULL;
+
+    if ((spec->mask & bit) == 0)
+        return FALSE;
+
+    /* Outside of the roots, it is the target of a symbolic link found in event_root */
+    if (is_child_of(event_p_path, spec->root) == TRUE)
+        below = event_p_path + strlen(spec->root);
+    else if (get_root_of(event_p_path) != NULL || is_child_of(event_root, spec->root) == FALSE)
+        return FALSE;
+
+    if (spec->exclude == NULL)
+        return TRUE;
+
+    if (file_name[0] != '\0' && exclude_match(spec->exclude, file_name) == 1)
+        return FALSE;
+
+    /* The directories between the root and the event */
+    char name[MAXPATHLEN + 1];
+    while (below != NULL && *below != '\0') {
+        const char *slash = strchr(below, '/');
+        size_t len = (slash != NULL) ? (size_t) (slash - below) : strlen(below);
+
+        memcpy(name, below, len);
+        name[len] = '\0';
+        if (len > 0 && exclude_match(spec->exclude, name) == 1)
+            return FALSE;
+
+        below = (slash != NULL) ? slash + 1 : NULL;
+    }
+
+    return TRUE;
+}
+
+int daemon_execute(char *event_name, char *file_name, char *event_p_path)
+{
+    uint32_t bit = event_bit(event_name);
+    char *root = event_root;
+    TEMPLATE *template = command_template;
+    bstring spec_command = command;
+    int result = 0;
+
+    LIST_NODE *node;
+    for (node = (specs != NULL) ? specs->first : NULL; node != NULL && result == 0; node = node->next) {
+        SPEC *spec = (SPEC *) node->data;
+
+        if (spec_matches(spec, bit, file_name, event_p_path) == FALSE)
+            continue;
+
+        /* %r is the root of the spec */
+        event_root = spec->root;
+        command_template = spec->template;
+        command = (spec->command != NULL) ? spec->command : spec->format;
+
+        result = (spec->command != NULL)
+            ? execute_command_inline(event_name, file_name, event_p_path)
+            : execute_command_embedded(event_name, file_name, event_p_path);
+    }
+
+    event_root = root;
+    command_template = template;
+    command = spec_command;
+
+    return result;
+}
+
+/* The directories outside of the roots get the root of the symbolic link to them (see trie_walk) */
+static int set_root(TRIE_NODE *trie_node, void *root)
+{
+    char path[MAXPATHLEN + 1];
+
+    if (trie_node->data == NULL)
+        return 0;
+
+    WD_DATA *wd_data = (WD_DATA *) ((LIST_NODE *) trie_node->data)->data;
+    if (get_root_of(get_wd_path(wd_data, path)) != NULL)
+        return 1;
+
+    wd_data->root = (char *) root;
+
+    return 0;
+}
+
+/* Set the root of the watched directories again, after a change of the root paths */
+static void refresh_roots(const char *removed)
+{
+    char path[MAXPATHLEN + 1];
+    LIST_NODE *node;
+    HASH_ENTRY *entry = NULL;
+
+    for (node = list_wd->first; node != NULL; node = node->next) {
+        WD_DATA *wd_data = (WD_DATA *) node->data;
+        char *root = get_root_of(get_wd_path(wd_data, path));
+
+        if (root != NULL)
+            wd_data->root = root;
+        else if (removed != NULL && wd_data->root == removed)
+            wd_data->root = (roots_qty > 0) ? root_paths[0] : NULL;
+    }
+
+    /* As add_to_watch_list does, from the directory containing the link */
+    while ((entry = hash_next(link_index, entry)) != NULL) {
+        LINK_DATA *link_data = (LINK_DATA *) ((LIST_NODE *) entry->data)->data;
+
+        if (link_data->owner != NULL && link_data->owner->root != NULL)
+            trie_walk(link_data->wd_data->entry, set_root, (void *) link_data->owner->root);
+    }
+}
+
+/* The watches are shared: they have all the events of the specs */
+static void widen_mask(uint32_t mask)
+{
+    char path[MAXPATHLEN + 1];
+    LIST_NODE *node;
+
+    mask |= event_mask;
+    if (mask == event_mask)
+        return;
+
+    /* The directories of a rule keep its events */
+    for (node = list_wd->first; node != NULL; node = node->next) {
+        WD_DATA *wd_data = (WD_DATA *) node->data;
+
+        if (wd_data->mask == event_mask && (wd_data->rule == NULL || wd_data->rule->mask == 0)) {
+            backend->add_watch(get_wd_path(wd_data, path), mask);
+            wd_data->mask = mask;
+        }
+    }
+
+    event_mask = mask;
+}
+
+/* Unwatch a root once it is the root of no spec, but for the roots of the other specs */
+static void release_root(const char *root)
+{
+    LIST_NODE *node;
+    unsigned int i;
+
+    for (node = specs->first; node != NULL; node = node->next) {
+        if (strcmp(((SPEC *) node->data)->root, root) == 0)
+            return;
+    }
+
+    for (i = 0; i < roots_qty && strcmp(root_paths[i], root) != 0; ++i)
+        ;
+    if (i == roots_qty)
+        return;
+
+    char *removed = root_paths[i];
+    memmove(root_paths + i, root_paths + i + 1, (roots_qty - i - 1) * sizeof(char *));
+    --roots_qty;
+
+    /* Still watched in the root of another spec */
+    bool_t covered = FALSE;
+    for (node = specs->first; node != NULL; node = node->next) {
+        if (is_child_of(removed, ((SPEC *) node->data)->root) == TRUE)
+            covered = TRUE;
+    }
+
+    if (covered == FALSE)
+        unwatch_root(removed);
+
+    refresh_roots(removed);
+    list_push(retired_roots, (void *) removed);
+}
+
+static void free_spec(SPEC *spec)
+{
+    free(spec->root);
+    free(spec->request);
+    bdestroy(spec->command);
+    bdestroy(spec->format);
+    exclude_free(spec->exclude);
+
+    if (spec->template != NULL) {
+        free(spec->template->segments);
+        free(spec->template);
+    }
+    free(spec);
+}
+
+/* add root=DIRECTORY [events=EVENTS] [exclude=REGEX ...] command=COMMAND|format=FORMAT */
+static void spec_add(char *arguments, bstring reply)
+{
+    SPEC *spec = (SPEC *) calloc(1, sizeof(SPEC));
+    const char *error = NULL;
+    char *p = arguments;
+
+    spec->request = strdup(arguments);
+    spec->mask = default_mask;
+
+    while (error == NULL && *p != '\0') {
+        if (*p == ' ') {
+            ++p;
+            continue;
+        }
+
+        /* The command and the format take the rest of the line */
+        if (strncmp(p, "command=", 8) == 0 || strncmp(p, "format=", 7) == 0) {
+            bstring text = bfromcstr(strchr(p, '=') + 1);
+            btrimws(text);
+
+            if (spec->command != NULL || spec->format != NULL || blength(text) == 0)
+                error = "a command or a format is required";
+            else if (p[0] == 'c')
+                spec->command = text;
+            else
+                spec->format = text;
+            break;
+        }
+
+        char *end = strchr(p, ' ');
+        if (end != NULL)
+            *end = '\0';
+
+        char *value = strchr(p, '=');
+        if (value == NULL) {
+            error = "malformed argument";
+        } else if (strncmp(p, "root=", 5) == 0) {
+            free(spec->root);
+            if ((spec->root = resolve_root(value + 1)) == NULL)
+                error = "the root is not a directory";
+        } else if (strncmp(p, "events=", 7) == 0) {
+            if ((spec->mask = parse_events(value + 1)) == 0)
+                error = "unrecognized event or malformed list of events";
+        } else if (strncmp(p, "exclude=", 8) == 0) {
+            if (spec->exclude == NULL)
+                spec->exclude = exclude_init();
+            if (exclude_add_regex(spec->exclude, value + 1) == -1)
+                error = "the exclude pattern is not valid";
+        } else {
+            error = "unknown argument";
+        }
+
+        p = (end != NULL) ? end + 1 : p + strlen(p);
+    }
+
+    if (error == NULL && spec->root == NULL)
+        error = "a root is required";
+    else if (error == NULL && spec->command == NULL && spec->format == NULL)
+        error = "a command or a format is required";
+    else if (error == NULL && spec->exclude != NULL && exclude_compile(spec->exclude) == -1)
+        error = "the exclude patterns can not be compiled";
+
+    if (error != NULL) {
+        bformata(reply, "error %s\n", error);
+        free_spec(spec);
+        return;
+    }
+
+    spec->template = compile_template((char *) ((NULL != spec->format) ? spec->format->data : spec->command->data));
+    spec->id = ++last_id;
+    list_push(specs, (void *) spec);
+
+    /* The directories are watched once, for all the specs */
+    widen_mask(spec->mask);
+
+    if (is_root(spec->root) == FALSE) {
+        bool_t watched = (get_node_from_path(spec->root) != NULL) ? TRUE : FALSE;
+        add_root(spec->root);
+
+        if (watched == FALSE && watch(spec->root, NULL) == -1) {
+            list_remove(specs, specs->last);
+            release_root(spec->root);
+            free_spec(spec);
+            bformata(reply, "error unable to watch the root\n");
+            return;
+        }
+        refresh_roots(NULL);
+    }
+
+    log_message("SPEC ADDED:\t\t%u \"%s\" (%zu directories watched)", spec->id, spec->root, wd_index->count);
+    bformata(reply, "ok %u\n", spec->id);
+}
+
+/* remove ID */
+static int spec_remove(const char *argument)
+{
+    char *end = NULL;
+    unsigned long id = strtoul(argument, &end, 10);
+    LIST_NODE *node;
+
+    if (end == argument || *end != '\0')
+        return -1;
+
+    for (node = specs->first; node != NULL && ((SPEC *) node->data)->id != id; node = node->next)
+        ;
+    if (node == NULL)
+        return -1;
+
+    SPEC *spec = (SPEC *) node->data;
+    list_remove(specs, node);
+    release_root(spec->root);
+
+    log_message("SPEC REMOVED:\t\t%u \"%s\" (%zu directories watched)", spec->id, spec->root, wd_index->count);
+    free_spec(spec);
+
+    return 0;
+}
+
+static void daemon_request(char *line, bstring reply)
+{
+    size_t len = strlen(line);
+    LIST_NODE *node;
+
+    while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' '))
+        line[--len] = '\0';
+    while (*line == ' ')
+        ++line;
+
+    if (strncmp(line, "add ", 4) == 0) {
+        spec_add(line + 4, reply);
+    } else if (strncmp(line, "remove ", 7) == 0) {
+        bcatcstr(reply, (spec_remove(line + 7) == 0) ? "ok\n" : "error no such spec\n");
+    } else if (strcmp(line, "list") == 0) {
+        for (node = specs->first; node != NULL; node = node->next) {
+            SPEC *spec = (SPEC *) node->data;
+            bformata(reply, "%u %s\n", spec->id, spec->request);
+        }
+        bcatcstr(reply, "ok\n");
+    } else if (*line != '\0') {
+        bcatcstr(reply, "error unknown request\n");
+    }
+}
+
+/* The client could be slow to read a long reply */
+static void client_write(int client_fd, bstring reply)
+{
+    ssize_t written = 0;
+
+    while (written < blength(reply)) {
+        ssize_t n = write(client_fd, reply->data + written, blength(reply) - written);
+        if (n == -1 && errno == EINTR)
+            continue;
+
+        struct pollfd pfd = {client_fd, POLLOUT, 0};
+        if (n == -1 && errno == EAGAIN && poll(&pfd, 1, DAEMON_WRITE_MS) == 1)
+            continue;
+        if (n <= 0)
+            break;
+        written += n;
+    }
+}
+
+/* The requests are handled once their line is complete */
+static void client_read(void *arg)
+{
+    CLIENT *client = (CLIENT *) arg;
+    char chunk[1024];
+    ssize_t n;
+
+    while ((n = read(client->fd, chunk, sizeof(chunk))) > 0 || (n == -1 && errno == EINTR)) {
+        if (n > 0)
+            bcatblk(client->input, chunk, n);
+    }
+    bool_t closed = (n == 0 || errno != EAGAIN) ? TRUE : FALSE;
+
+    bstring reply = bfromcstr("");
+    int start = 0, end;
+    while ((end = bstrchrp(client->input, '\n', start)) != BSTR_ERR) {
+        client->input->data[end] = '\0';
+        daemon_request((char *) client->input->data + start, reply);
+        start = end + 1;
+    }
+    bdelete(client->input, 0, start);
+
+    if (blength(client->input) > DAEMON_LINE_MAX) {
+        bcatcstr(reply, "error request too long\n");
+        closed = TRUE;
+    }
+
+    client_write(client->fd, reply);
+    bdestroy(reply);
+
+    if (closed == TRUE) {
+        loop_remove(client->source);
+        close(client->fd);
+        bdestroy(client->input);
+        free(client);
+    }
+}
+
+static void daemon_accept(void *arg)
+{
+    int client_fd;
+
+    while ((client_fd = accept4(daemon_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        CLIENT *client = (CLIENT *) malloc(sizeof(CLIENT));
+
+        client->fd = client_fd;
+        client->input = bfromcstr("");
+        if ((client->source = loop_add(client_fd, client_read, (void *) client)) == NULL) {
+            log_message("UNABLE TO SERVE A CLIENT OF THE CONTROL SOCKET (%s)", strerror(errno));
+            close(client_fd);
+            bdestroy(client->input);
+            free(client);
+        }
+    }
+}
+
+int daemon_start(const char *path)
+{
+    daemon_fd = listen_unix(path);
+    if (daemon_fd == -1)
+        return -1;
+
+    if (loop_add(daemon_fd, daemon_accept, NULL) == NULL) {
+        close(daemon_fd);
+        daemon_fd = -1;
+        return -1;
+    }
+
+    specs = list_init();
+    retired_roots = list_init();
+    default_mask = event_mask;
+    daemon_path = strdup(path);
+
+    return 0;
+}
+
+void daemon_stop()
+{
+    if (daemon_fd == -1)
+        return;
+
+    close(daemon_fd);
+    daemon_fd = -1;
+    unlink(daemon_path);
+}
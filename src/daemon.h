@@ -0,0 +1,69 @@
+/* daemon.h
+ * The watch specs served from one process, through a control socket
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __DAEMON_H
+#define __DAEMON_H
+
+#define DAEMON_LINE_MAX 4096       /* the longest request read from a client */
+
+/*
+ * With --daemon, the watch specs are added and removed at runtime by
+ * the clients of a UNIX socket, one request for each line:
+ *
+ *   add root=DIRECTORY [events=EVENTS] [exclude=REGEX ...] command=COMMAND|format=FORMAT
+ *   remove ID
+ *   list
+ *
+ * COMMAND and FORMAT take the rest of the line. Each request is answered
+ * by "ok [ID]" or by "error MESSAGE" (list writes a line for each spec
+ * first). The specs share the watch list: a directory is watched once,
+ * whatever the number of specs it belongs to, and each event is executed
+ * for every spec it matches (see daemon_execute).
+ */
+
+/**
+ * Listen for the clients on the control socket (see loop_init)
+ * @param char * : the path of the UNIX socket
+ * @return int   : -1 in case of error, 0 otherwise
+ */
+int daemon_start(const char *);
+
+/**
+ * Close the control socket, and remove it
+ */
+void daemon_stop();
+
+/**
+ * Execute an event for each spec it matches: the path of the event is in
+ * the root of the spec, the event is one of its events and none of the
+ * names of the path below the root is excluded. It is the execute_command
+ * of the daemon mode, the event is read and coalesced once for all the specs.
+ * @param char * : the event name
+ * @param char * : the file name
+ * @param char * : the path of the directory of the event
+ * @return int   : -1 in case of error, 0 otherwise
+ */
+int daemon_execute(char *, char *, char *);
+
+#endif /* !__DAEMON_H */
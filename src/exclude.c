@@ -0,0 +1,468 @@
+/* exclude.c
+ * The patterns of the names to exclude (-x and --exclude-glob options)
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "cwatch.h"
+
+#include <ctype.h>
+
+#define REGEX_SPECIAL ".[]()*+?{}|^$\\"
+
+static EXCLUDE_AFFIX *affix_create(const char *text, size_t len, EXCLUDE_AFFIX *next)
+{
+    EXCLUDE_AFFIX *affix = (EXCLUDE_AFFIX *) malloc(sizeof(EXCLUDE_AFFIX));
+    affix->text = strndup(text, len);
+    affix->len = len;
+    affix->next = next;
+
+    return affix;
+}
+
+/* Add a literal, anchored to the start and/or to the end of the name */
+static void add_literal(EXCLUDE *exclude, const char *text, size_t len, bool_t anchored_start, bool_t anchored_end)
+{
+    if (anchored_start == TRUE && anchored_end == TRUE) {
+        if (exclude->literals == NULL)
+            exclude->literals = hash_init(hash_string, hash_string_compare);
+
+        char *name = strndup(text, len);
+        hash_put(exclude->literals, name, (void *) name);
+    } else if (len == 0) {
+        /* It matches every name */
+        exclude->substrings = affix_create(text, 0, exclude->substrings);
+    } else if (anchored_end == TRUE) {
+        EXCLUDE_AFFIX **bucket = &exclude->suffixes[(unsigned char) text[len - 1]];
+        *bucket = affix_create(text, len, *bucket);
+    } else if (anchored_start == TRUE) {
+        EXCLUDE_AFFIX **bucket = &exclude->prefixes[(unsigned char) text[0]];
+        *bucket = affix_create(text, len, *bucket);
+    } else {
+        exclude->substrings = affix_create(text, len, exclude->substrings);
+    }
+
+    ++exclude->patterns_qty;
+}
+
+/* Unescape a regular expression that is a literal, -1 if it is not */
+static int regex_literal(const char *re, size_t re_len, bstring text, bool_t *anchored_start, bool_t *anchored_end)
+{
+    size_t i = 0;
+
+    btrunc(text, 0);
+    *anchored_start = *anchored_end = FALSE;
+
+    if (re_len > 0 && re[0] == '^') {
+        *anchored_start = TRUE;
+        i = 1;
+    }
+
+    for (; i < re_len; ++i) {
+        char c = re[i];
+
+        if (c == '\\') {
+            /* \w, \b, \1, ... are not literals */
+            if (i + 1 == re_len || strchr(REGEX_SPECIAL, re[i + 1]) == NULL)
+                return -1;
+            bconchar(text, re[++i]);
+        } else if (c == '$' && i == re_len - 1) {
+            *anchored_end = TRUE;
+        } else if (strchr(REGEX_SPECIAL, c) != NULL) {
+            return -1;
+        } else {
+            bconchar(text, c);
+        }
+    }
+
+    return 0;
+}
+
+/* The next '|' that is not escaped, NULL otherwise */
+static const char *next_alternative(const char *re)
+{
+    for (; *re != '\0'; ++re) {
+        if (*re == '\\' && re[1] != '\0')
+            ++re;
+        else if (*re == '|')
+            return re;
+    }
+
+    return NULL;
+}
+
+/* Add a regular expression made of literals only, -1 if it is not */
+static int add_regex_literals(EXCLUDE *exclude, const char *pattern)
+{
+    const char *c;
+
+    /* A '|' in a group or in a bracket is not an alternative */
+    for (c = pattern; *c != '\0'; ++c) {
+        if (*c == '\\' && c[1] != '\0')
+            ++c;
+        else if (*c == '(' || *c == '[')
+            return -1;
+    }
+
+    bstring text = bfromcstr("");
+    bool_t anchored_start, anchored_end;
+    int pass;
+
+    /* Every alternative is checked before adding them */
+    for (pass = 0; pass < 2; ++pass) {
+        const char *alternative = pattern;
+
+        while (1) {
+            const char *bar = next_alternative(alternative);
+            size_t len = (bar != NULL) ? (size_t) (bar - alternative) : strlen(alternative);
+
+            if (regex_literal(alternative, len, text, &anchored_start, &anchored_end) == -1) {
+                bdestroy(text);
+                return -1;
+            }
+
+            if (pass == 1)
+                add_literal(exclude, (char *) text->data, blength(text), anchored_start, anchored_end);
+
+            if (bar == NULL)
+                break;
+            alternative = bar + 1;
+        }
+    }
+
+    bdestroy(text);
+
+    return 0;
+}
+
+/* TRUE if the regular expression has a back-reference, it can not be combined */
+static bool_t has_backreference(const char *pattern)
+{
+    for (; *pattern != '\0'; ++pattern) {
+        if (*pattern == '\\' && pattern[1] != '\0') {
+            if (pattern[1] >= '1' && pattern[1] <= '9')
+                return TRUE;
+            ++pattern;
+        }
+    }
+
+    return FALSE;
+}
+
+/* Compile a regular expression on its own */
+static int add_single_regex(EXCLUDE *exclude, const char *pattern)
+{
+    regex_t *regex = (regex_t *) malloc(sizeof(regex_t));
+
+    if (regcomp(regex, pattern, REG_EXTENDED | REG_NOSUB) != 0) {
+        free(regex);
+        return -1;
+    }
+
+    if (exclude->regexes == NULL)
+        exclude->regexes = list_init();
+    list_push(exclude->regexes, (void *) regex);
+    ++exclude->patterns_qty;
+
+    return 0;
+}
+
+/* Keep a valid regular expression, to be combined with the other ones */
+static int add_source(EXCLUDE *exclude, const char *pattern)
+{
+    regex_t regex;
+
+    if (regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB) != 0)
+        return -1;
+    regfree(&regex);
+
+    if (exclude->sources == NULL)
+        exclude->sources = list_init();
+    list_push(exclude->sources, (void *) strdup(pattern));
+    ++exclude->patterns_qty;
+
+    return 0;
+}
+
+EXCLUDE *exclude_init()
+{
+    return (EXCLUDE *) calloc(1, sizeof(EXCLUDE));
+}
+
+int exclude_add_regex(EXCLUDE *exclude, const char *pattern)
+{
+    if (has_backreference(pattern) == TRUE)
+        return add_single_regex(exclude, pattern);
+
+    if (add_regex_literals(exclude, pattern) == 0)
+        return 0;
+
+    return add_source(exclude, pattern);
+}
+
+/* Unescape the part of a pattern that is a literal, -1 if it is not */
+static int glob_literal(const char *pattern, size_t len, bstring text)
+{
+    size_t i;
+
+    btrunc(text, 0);
+
+    for (i = 0; i < len; ++i) {
+        char c = pattern[i];
+
+        if (c == '*' || c == '?' || c == '[')
+            return -1;
+
+        if (c == '\\') {
+            if (i + 1 == len)
+                return -1;
+            c = pattern[++i];
+        }
+
+        bconchar(text, c);
+    }
+
+    return 0;
+}
+
+/* Translate a shell wildcard pattern in a regular expression matching the whole name */
+static void glob_to_regex(const char *pattern, bstring re)
+{
+    size_t i;
+
+    bassigncstr(re, "^");
+
+    for (i = 0; pattern[i] != '\0'; ++i) {
+        char c = pattern[i];
+
+        if (c == '*') {
+            bcatcstr(re, ".*");
+        } else if (c == '?') {
+            bconchar(re, '.');
+        } else if (c == '[') {
+            /* Search the end of the bracket expression, the classes ([:alpha:]) included */
+            size_t j = i + 1;
+            if (pattern[j] == '!' || pattern[j] == '^')
+                ++j;
+            if (pattern[j] == ']')
+                ++j;
+            while (pattern[j] != '\0' && pattern[j] != ']') {
+                if (pattern[j] == '[' && pattern[j + 1] == ':') {
+                    const char *class_end = strstr(pattern + j + 2, ":]");
+                    if (class_end != NULL)
+                        j = class_end - pattern + 1;
+                }
+                ++j;
+            }
+
+            if (pattern[j] == ']') {
+                size_t k = i + 1;
+
+                bconchar(re, '[');
+                if (pattern[k] == '!' || pattern[k] == '^') {
+                    bconchar(re, '^');
+                    ++k;
+                }
+                bcatblk(re, pattern + k, (int) (j - k + 1));
+                i = j;
+            } else {
+                /* Not terminated, it is a literal */
+                bcatcstr(re, "\\[");
+            }
+        } else {
+            if (c == '\\' && pattern[i + 1] != '\0')
+                c = pattern[++i];
+
+            if (strchr(REGEX_SPECIAL, c) != NULL)
+                bconchar(re, '\\');
+            bconchar(re, c);
+        }
+    }
+
+    bconchar(re, '$');
+}
+
+int exclude_add_glob(EXCLUDE *exclude, const char *pattern)
+{
+    size_t first = 0, last = strlen(pattern);
+    bool_t anchored_start = TRUE, anchored_end = TRUE;
+
+    /* "*TEXT", "TEXT*" and "*TEXT*" */
+    if (last > 0 && pattern[0] == '*') {
+        anchored_start = FALSE;
+        first = 1;
+    }
+    if (last > first && pattern[last - 1] == '*') {
+        anchored_end = FALSE;
+        --last;
+    }
+
+    bstring text = bfromcstr("");
+    int result;
+
+    if (glob_literal(pattern + first, last - first, text) == 0) {
+        add_literal(exclude, (char *) text->data, blength(text), anchored_start, anchored_end);
+        result = 0;
+    } else {
+        glob_to_regex(pattern, text);
+        result = add_source(exclude, (char *) text->data);
+    }
+
+    bdestroy(text);
+
+    return result;
+}
+
+int exclude_compile(EXCLUDE *exclude)
+{
+    if (exclude->sources == NULL || exclude->sources->first == NULL)
+        return 0;
+
+    bstring re = bfromcstr("");
+    LIST_NODE *node;
+
+    for (node = exclude->sources->first; node != NULL; node = node->next) {
+        if (blength(re) > 0)
+            bconchar(re, '|');
+        bconchar(re, '(');
+        bcatcstr(re, (char *) node->data);
+        bconchar(re, ')');
+    }
+
+    exclude->combined = (regex_t *) malloc(sizeof(regex_t));
+
+    /* An expression could be valid only on its own (an unmatched ')') */
+    if (regcomp(exclude->combined, (char *) re->data, REG_EXTENDED | REG_NOSUB) != 0) {
+        free(exclude->combined);
+        exclude->combined = NULL;
+
+        for (node = exclude->sources->first; node != NULL; node = node->next) {
+            if (add_single_regex(exclude, (char *) node->data) == -1) {
+                bdestroy(re);
+                return -1;
+            }
+        }
+    }
+
+    bdestroy(re);
+
+    return 0;
+}
+
+int exclude_match(const EXCLUDE *exclude, const char *name)
+{
+    if (exclude == NULL || exclude->patterns_qty == 0)
+        return 0;
+
+    size_t len = strlen(name);
+    EXCLUDE_AFFIX *affix;
+
+    if (exclude->literals != NULL && hash_get(exclude->literals, name) != NULL)
+        return 1;
+
+    if (len > 0) {
+        for (affix = exclude->suffixes[(unsigned char) name[len - 1]]; affix != NULL; affix = affix->next) {
+            if (affix->len <= len && memcmp(name + len - affix->len, affix->text, affix->len) == 0)
+                return 1;
+        }
+
+        for (affix = exclude->prefixes[(unsigned char) name[0]]; affix != NULL; affix = affix->next) {
+            if (affix->len <= len && memcmp(name, affix->text, affix->len) == 0)
+                return 1;
+        }
+    }
+
+    for (affix = exclude->substrings; affix != NULL; affix = affix->next) {
+        if (affix->len == 1) {
+            if (memchr(name, affix->text[0], len) != NULL)
+                return 1;
+        } else if (affix->len <= len && memmem(name, len, affix->text, affix->len) != NULL) {
+            return 1;
+        }
+    }
+
+    if (exclude->combined != NULL && regexec(exclude->combined, name, 0, NULL, 0) == 0)
+        return 1;
+
+    if (exclude->regexes != NULL) {
+        LIST_NODE *node;
+        for (node = exclude->regexes->first; node != NULL; node = node->next) {
+            if (regexec((regex_t *) node->data, name, 0, NULL, 0) == 0)
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void affixes_free(EXCLUDE_AFFIX *affix)
+{
+    while (affix != NULL) {
+        EXCLUDE_AFFIX *next = affix->next;
+        free(affix->text);
+        free(affix);
+        affix = next;
+    }
+}
+
+void exclude_free(EXCLUDE *exclude)
+{
+    HASH_ENTRY *entry = NULL;
+    void *data;
+    int i;
+
+    if (exclude == NULL)
+        return;
+
+    /* The names are the keys, they are not compared by hash_next */
+    if (exclude->literals != NULL) {
+        while ((entry = hash_next(exclude->literals, entry)) != NULL)
+            free(entry->data);
+        hash_free(exclude->literals);
+    }
+
+    for (i = 0; i < 256; ++i) {
+        affixes_free(exclude->suffixes[i]);
+        affixes_free(exclude->prefixes[i]);
+    }
+    affixes_free(exclude->substrings);
+
+    if (exclude->sources != NULL) {
+        while ((data = list_pop(exclude->sources)) != NULL)
+            free(data);
+        list_free(exclude->sources);
+    }
+
+    if (exclude->combined != NULL) {
+        regfree(exclude->combined);
+        free(exclude->combined);
+    }
+
+    if (exclude->regexes != NULL) {
+        while ((data = list_pop(exclude->regexes)) != NULL) {
+            regfree((regex_t *) data);
+            free(data);
+        }
+        list_free(exclude->regexes);
+    }
+
+    free(exclude);
+}
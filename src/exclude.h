@@ -0,0 +1,110 @@
+/* exclude.h
+ * The patterns of the names to exclude (-x and --exclude-glob options)
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __EXCLUDE_H
+#define __EXCLUDE_H
+
+#include <stddef.h>
+#include <regex.h>
+
+/* Used to store a literal part of the names to exclude (see exclude_match) */
+typedef struct exclude_affix_s
+{
+    char   *text;
+    size_t len;
+    struct exclude_affix_s *next;
+} EXCLUDE_AFFIX;
+
+/*
+ * A set of patterns of the names to exclude
+ * The patterns are sorted by shape, so that most names are matched
+ * without running a regular expression (see exclude_match).
+ */
+typedef struct exclude_s
+{
+    HASH          *literals;        /* the names excluded as they are */
+    EXCLUDE_AFFIX *suffixes[256];   /* the suffixes, by their last character */
+    EXCLUDE_AFFIX *prefixes[256];   /* the prefixes, by their first character */
+    EXCLUDE_AFFIX *substrings;      /* the literals that can be anywhere in the name */
+    LIST          *sources;         /* the regular expressions left, combined by exclude_compile() */
+    regex_t       *combined;        /* the alternation of the sources */
+    LIST          *regexes;         /* the regular expressions that can not be combined */
+    int           patterns_qty;
+} EXCLUDE;
+
+/**
+ * Create an empty set of patterns
+ * @return EXCLUDE * : the set, NULL in case of error
+ */
+EXCLUDE *exclude_init();
+
+/**
+ * Add a POSIX extended regular expression (-x option)
+ *
+ * The expressions that are literals (like "^\.git$", "\.swp$" or "~$"),
+ * or alternatives of literals, are matched without the regex engine.
+ * @param EXCLUDE * : the set of patterns
+ * @param char *    : the regular expression
+ * @return int      : -1 if it is not valid, 0 otherwise
+ */
+int exclude_add_regex(EXCLUDE *, const char *);
+
+/**
+ * Add a shell wildcard pattern (--exclude-glob option, see fnmatch(3))
+ *
+ * The patterns like "NAME", "*SUFFIX", "PREFIX*" and "*TEXT*" are matched
+ * as literals, the other ones are translated in a regular expression.
+ * @param EXCLUDE * : the set of patterns
+ * @param char *    : the pattern
+ * @return int      : -1 if it is not valid, 0 otherwise
+ */
+int exclude_add_glob(EXCLUDE *, const char *);
+
+/**
+ * Compile the regular expressions left in a single one
+ * Called once all the patterns are added.
+ * @param EXCLUDE * : the set of patterns
+ * @return int      : -1 in case of error, 0 otherwise
+ */
+int exclude_compile(EXCLUDE *);
+
+/**
+ * Checks whetever a name matches one of the patterns
+ *
+ * The literal names are found in a hash table, the suffixes and the
+ * prefixes are indexed by their last and first character, so that
+ * the combined regular expression only runs if none of them matches.
+ * @param EXCLUDE * : the set of patterns, NULL if there is none
+ * @param char *    : the name of a file or directory
+ * @return int      : 1 if the name is excluded, 0 otherwise
+ */
+int exclude_match(const EXCLUDE *, const char *);
+
+/**
+ * Deallocate a set of patterns
+ * @param EXCLUDE * : the set of patterns, NULL if there is none
+ */
+void exclude_free(EXCLUDE *);
+
+#endif /* !__EXCLUDE_H */
@@ -0,0 +1,358 @@
+/* fingerprint.c
+ * The fingerprints of the files, to skip the events that change no byte
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "cwatch.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+/* Used to store the fingerprint of a file */
+typedef struct fingerprint_s
+{
+    char            *path;        /* the key of the cache */
+    off_t           size;
+    struct timespec mtime;
+    struct timespec checked;      /* when the hash was computed, by the clock of the mtimes */
+    dev_t           dev;
+    ino_t           ino;
+    uint64_t        hash;
+    LIST_NODE       lru;          /* its node of the lru list */
+} FINGERPRINT;
+
+static HASH *cache;                /* the fingerprints by path, NULL without --skip-unchanged */
+static LIST *lru;                  /* the fingerprints, least recently checked first */
+static size_t capacity;
+static char *read_buffer;          /* FINGERPRINT_READ bytes, the files are read into it */
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t val)
+{
+    acc ^= xxh64_round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+void xxh64_init(XXH64_STATE *state, uint64_t seed)
+{
+    state->v[0] = seed + PRIME64_1 + PRIME64_2;
+    state->v[1] = seed + PRIME64_2;
+    state->v[2] = seed;
+    state->v[3] = seed - PRIME64_1;
+    state->total_len = 0;
+    state->mem_len = 0;
+}
+
+/* The little endian reads of the reference implementation, x86 and arm64 are */
+static inline void xxh64_stripe(uint64_t *v, const unsigned char *p)
+{
+    v[0] = xxh64_round(v[0], read64(p));
+    v[1] = xxh64_round(v[1], read64(p + 8));
+    v[2] = xxh64_round(v[2], read64(p + 16));
+    v[3] = xxh64_round(v[3], read64(p + 24));
+}
+
+void xxh64_update(XXH64_STATE *state, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    const unsigned char *end = p + len;
+
+    state->total_len += len;
+
+    /* Not a whole stripe yet */
+    if (state->mem_len + len < 32) {
+        memcpy(state->mem + state->mem_len, p, len);
+        state->mem_len += len;
+        return;
+    }
+
+    if (state->mem_len > 0) {
+        size_t fill = 32 - state->mem_len;
+        memcpy(state->mem + state->mem_len, p, fill);
+        xxh64_stripe(state->v, state->mem);
+        p += fill;
+        state->mem_len = 0;
+    }
+
+    for (; p + 32 <= end; p += 32)
+        xxh64_stripe(state->v, p);
+
+    state->mem_len = (size_t) (end - p);
+    memcpy(state->mem, p, state->mem_len);
+}
+
+uint64_t xxh64_digest(const XXH64_STATE *state)
+{
+    const unsigned char *p = state->mem;
+    const unsigned char *end = p + state->mem_len;
+    const uint64_t *v = state->v;
+    uint64_t h;
+
+    if (state->total_len >= 32) {
+        h = rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+        h = xxh64_merge(h, v[0]);
+        h = xxh64_merge(h, v[1]);
+        h = xxh64_merge(h, v[2]);
+        h = xxh64_merge(h, v[3]);
+    } else {
+        /* v[2] is the seed */
+        h = v[2] + PRIME64_5;
+    }
+
+    h += state->total_len;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh64_round(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+
+    if (p + 4 <= end) {
+        h ^= (uint64_t) read32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+
+    for (; p < end; ++p) {
+        h ^= (*p) * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+uint64_t xxh64(const void *data, size_t len, uint64_t seed)
+{
+    XXH64_STATE state;
+
+    xxh64_init(&state, seed);
+    xxh64_update(&state, data, len);
+
+    return xxh64_digest(&state);
+}
+
+/*
+ * The hash of the content of an open file, -1 if it can not be read.
+ * A file truncated meanwhile is read short: it is changed, as the error.
+ */
+static int hash_file(int file_fd, off_t size, uint64_t *hash)
+{
+    uint64_t hash_start = metrics_now();
+    XXH64_STATE state;
+    off_t total = 0;
+
+    xxh64_init(&state, 0);
+
+    while (total < size) {
+        size_t len = (size - total < FINGERPRINT_READ) ? (size_t) (size - total) : FINGERPRINT_READ;
+        ssize_t n = pread(file_fd, read_buffer, len, total);
+
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+
+        xxh64_update(&state, read_buffer, (size_t) n);
+        total += n;
+    }
+
+    *hash = xxh64_digest(&state);
+
+    metrics_observe(METRIC_FINGERPRINT_TIME, hash_start);
+    metrics_add(METRIC_FINGERPRINT_BYTES, (unsigned long) size);
+
+    return 0;
+}
+
+static void forget(const char *path)
+{
+    FINGERPRINT *fingerprint = (FINGERPRINT *) hash_remove(cache, path);
+    if (fingerprint == NULL)
+        return;
+
+    list_unlink(lru, &fingerprint->lru);
+    free(fingerprint->path);
+    free(fingerprint);
+}
+
+/* The entry of a path, the least recently checked ones make room */
+static FINGERPRINT *remember(const char *path)
+{
+    FINGERPRINT *fingerprint;
+
+    if (cache->count >= capacity && lru->first != NULL) {
+        fingerprint = (FINGERPRINT *) lru->first->data;
+        hash_remove(cache, fingerprint->path);
+        list_unlink(lru, &fingerprint->lru);
+        free(fingerprint->path);
+    } else {
+        fingerprint = (FINGERPRINT *) malloc(sizeof(FINGERPRINT));
+        if (fingerprint == NULL)
+            return NULL;
+    }
+
+    fingerprint->path = strdup(path);
+    fingerprint->lru.data = (void *) fingerprint;
+    list_link(lru, &fingerprint->lru);
+    hash_put(cache, fingerprint->path, (void *) fingerprint);
+
+    return fingerprint;
+}
+
+int fingerprint_init(size_t size)
+{
+    cache = hash_init(hash_string, hash_string_compare);
+    lru = list_init();
+    read_buffer = (char *) malloc(FINGERPRINT_READ);
+    capacity = size;
+
+    return (cache != NULL && lru != NULL && read_buffer != NULL) ? 0 : -1;
+}
+
+int fingerprint_unchanged(const char *event_name, const char *event_p_path, const char *file_name)
+{
+    char path[MAXPATHLEN + 1];
+    struct stat st;
+
+    if (cache == NULL)
+        return 0;
+
+    if (snprintf(path, sizeof(path), "%s%s", event_p_path, file_name) >= (int) sizeof(path))
+        return 0;
+
+    /* The content at the path is a new one, or there is none */
+    if (strcmp(event_name, "create") == 0
+        || strcmp(event_name, "delete") == 0
+        || strcmp(event_name, "moved_from") == 0
+        || strcmp(event_name, "moved_to") == 0
+        || strcmp(event_name, "rename") == 0
+        || strcmp(event_name, "delete_self") == 0
+        || strcmp(event_name, "move_self") == 0)
+    {
+        if (strcmp(event_name, "rename") == 0 && event_old_path != NULL)
+            forget(event_old_path);
+        forget(path);
+        return 0;
+    }
+
+    /* The content is not changed (open, access and close_nowrite, the hash itself causes them) */
+    if (strcmp(event_name, "modify") != 0
+        && strcmp(event_name, "close_write") != 0
+        && strcmp(event_name, "attrib") != 0)
+    {
+        return 0;
+    }
+
+    /* O_NOATIME is only allowed to the owner of the file */
+    int file_fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK | O_NOATIME);
+    if (file_fd == -1 && errno == EPERM)
+        file_fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+    if (file_fd == -1 || fstat(file_fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        if (file_fd != -1)
+            close(file_fd);
+        forget(path);
+        return 0;
+    }
+
+    FINGERPRINT *fingerprint = (FINGERPRINT *) hash_get(cache, path);
+
+    /* The same stat, unless the file could be written again within the same mtime tick */
+    if (fingerprint != NULL
+        && fingerprint->size == st.st_size
+        && fingerprint->dev == st.st_dev
+        && fingerprint->ino == st.st_ino
+        && timespec_compare(&fingerprint->mtime, &st.st_mtim) == 0
+        && timespec_compare(&fingerprint->mtime, &fingerprint->checked) < 0)
+    {
+        close(file_fd);
+        list_unlink(lru, &fingerprint->lru);
+        list_link(lru, &fingerprint->lru);
+        metrics_count(METRIC_EVENTS_UNCHANGED);
+        return 1;
+    }
+
+    struct timespec checked;
+    uint64_t hash;
+    clock_gettime(CLOCK_REALTIME_COARSE, &checked);
+
+    int result = hash_file(file_fd, st.st_size, &hash);
+    close(file_fd);
+
+    if (result == -1) {
+        forget(path);
+        return 0;
+    }
+
+    int unchanged = (fingerprint != NULL && fingerprint->size == st.st_size && fingerprint->hash == hash) ? 1 : 0;
+
+    if (fingerprint != NULL) {
+        list_unlink(lru, &fingerprint->lru);
+        list_link(lru, &fingerprint->lru);
+    } else if ((fingerprint = remember(path)) == NULL) {
+        return 0;
+    }
+
+    fingerprint->size = st.st_size;
+    fingerprint->mtime = st.st_mtim;
+    fingerprint->checked = checked;
+    fingerprint->dev = st.st_dev;
+    fingerprint->ino = st.st_ino;
+    fingerprint->hash = hash;
+
+    if (unchanged == 1)
+        metrics_count(METRIC_EVENTS_UNCHANGED);
+
+    return unchanged;
+}
@@ -0,0 +1,105 @@
+/* fingerprint.h
+ * The fingerprints of the files, to skip the events that change no byte
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __FINGERPRINT_H
+#define __FINGERPRINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FINGERPRINT_CACHE    65536          /* the files fingerprinted, by default (--fingerprint-cache option) */
+#define FINGERPRINT_READ     (256 * 1024)   /* the bytes of a file read and hashed at once */
+
+/*
+ * With --skip-unchanged, the modify, close_write and attrib events of a
+ * regular file are not executed when its content is the one seen last
+ * time: the fingerprint of a file is its size, mtime, inode and XXH64
+ * hash. The hash is only computed when the stat differs (touch, or an
+ * editor writing a new file with the same content), or when the mtime
+ * is too recent to tell two writes apart. The least recently checked
+ * files are forgotten beyond the size of the cache, and the ones
+ * created, deleted or moved at once.
+ * The file is read to hash it: the open, access and close_nowrite
+ * events of the reading are seen by any watcher of these events,
+ * cwatch included (they do not change the fingerprint).
+ */
+
+/**
+ * Allocate the cache of the fingerprints
+ * @param size_t : the max number of files
+ * @return int   : -1 in case of error, 0 otherwise
+ */
+int fingerprint_init(size_t);
+
+/**
+ * Check whetever an event changes the content of its file, and remember
+ * its fingerprint. A file seen for the first time is changed.
+ * @param char * : the event name
+ * @param char * : the path of the directory of the event
+ * @param char * : the file name
+ * @return int   : 1 if the event is to be skipped, 0 otherwise (always without --skip-unchanged)
+ */
+int fingerprint_unchanged(const char *, const char *, const char *);
+
+/* The state of a XXH64 hash computed piece by piece (see xxh64_update) */
+typedef struct xxh64_state_s
+{
+    uint64_t      v[4];          /* the accumulators of the 32 bytes stripes */
+    uint64_t      total_len;
+    unsigned char mem[32];       /* the bytes of the stripe not complete yet */
+    size_t        mem_len;
+} XXH64_STATE;
+
+/**
+ * Start a XXH64 hash
+ * @param XXH64_STATE * : the state
+ * @param uint64_t      : the seed
+ */
+void xxh64_init(XXH64_STATE *, uint64_t);
+
+/**
+ * Add bytes to a XXH64 hash
+ * @param XXH64_STATE * : the state
+ * @param void *        : the bytes
+ * @param size_t        : their length
+ */
+void xxh64_update(XXH64_STATE *, const void *, size_t);
+
+/**
+ * The XXH64 hash of the bytes added, the state is not modified
+ * @param XXH64_STATE * : the state
+ * @return uint64_t
+ */
+uint64_t xxh64_digest(const XXH64_STATE *);
+
+/**
+ * The XXH64 hash of a buffer
+ * @param void *   : the buffer
+ * @param size_t   : its length
+ * @param uint64_t : the seed
+ * @return uint64_t
+ */
+uint64_t xxh64(const void *, size_t, uint64_t);
+
+#endif /* !__FINGERPRINT_H */
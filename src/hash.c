@@ -0,0 +1,216 @@
+/* hash.c
+ * A simple open-addressing hash table and manipulation functions
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+
+#define HASH_INITIAL_SIZE 8
+
+/* Marks a slot whose entry has been removed */
+static const char tombstone;
+#define TOMBSTONE ((const void *) &tombstone)
+
+HASH *hash_init(unsigned long (*hash)(const void *),
+                int (*compare)(const void *, const void *))
+{
+    HASH *table = malloc(sizeof(HASH));
+    if (table == NULL)
+        return NULL;
+
+    table->entries = calloc(HASH_INITIAL_SIZE, sizeof(HASH_ENTRY));
+    if (table->entries == NULL) {
+        free(table);
+        return NULL;
+    }
+
+    table->size = HASH_INITIAL_SIZE;
+    table->count = table->used = 0;
+    table->hash = hash;
+    table->compare = compare;
+
+    return table;
+}
+
+/*
+ * Returns the slot that holds the key or, if the key is
+ * not in the table, the first free slot where it can be put.
+ */
+static HASH_ENTRY *hash_lookup(const HASH *table, const void *key)
+{
+    size_t mask = table->size - 1;
+    size_t i = table->hash(key) & mask;
+    HASH_ENTRY *free_slot = NULL;
+
+    while (table->entries[i].key != NULL) {
+        if (table->entries[i].key == TOMBSTONE) {
+            if (free_slot == NULL)
+                free_slot = &table->entries[i];
+        } else if (table->compare(table->entries[i].key, key) == 0) {
+            return &table->entries[i];
+        }
+        i = (i + 1) & mask;
+    }
+
+    return (free_slot != NULL) ? free_slot : &table->entries[i];
+}
+
+static int hash_resize(HASH *table, size_t size)
+{
+    HASH_ENTRY *old_entries = table->entries;
+    size_t old_size = table->size;
+
+    table->entries = calloc(size, sizeof(HASH_ENTRY));
+    if (table->entries == NULL) {
+        table->entries = old_entries;
+        return -1;
+    }
+
+    table->size = size;
+    table->used = table->count;
+
+    /* Move every live entry in the new slots, tombstones are dropped */
+    size_t i;
+    for (i = 0; i < old_size; ++i) {
+        if (old_entries[i].key != NULL && old_entries[i].key != TOMBSTONE)
+            *hash_lookup(table, old_entries[i].key) = old_entries[i];
+    }
+
+    free(old_entries);
+
+    return 0;
+}
+
+int hash_put(HASH *table, const void *key, void *data)
+{
+    /* Keep the load factor (tombstones included) under 3/4 */
+    if ((table->used + 1) * 4 > table->size * 3) {
+        size_t size = (table->count * 2 >= table->size) ? table->size * 2 : table->size;
+        if (hash_resize(table, size) == -1)
+            return -1;
+    }
+
+    HASH_ENTRY *entry = hash_lookup(table, key);
+
+    if (entry->key == NULL || entry->key == TOMBSTONE) {
+        if (entry->key == NULL)
+            ++table->used;
+        ++table->count;
+    }
+
+    entry->key = key;
+    entry->data = data;
+
+    return 0;
+}
+
+void *hash_get(const HASH *table, const void *key)
+{
+    HASH_ENTRY *entry = hash_lookup(table, key);
+
+    if (entry->key == NULL || entry->key == TOMBSTONE)
+        return NULL;
+
+    return entry->data;
+}
+
+void *hash_remove(HASH *table, const void *key)
+{
+    HASH_ENTRY *entry = hash_lookup(table, key);
+
+    if (entry->key == NULL || entry->key == TOMBSTONE)
+        return NULL;
+
+    void *data = entry->data;
+
+    entry->key = TOMBSTONE;
+    entry->data = NULL;
+    --table->count;
+
+    return data;
+}
+
+void hash_clear(HASH *table)
+{
+    memset(table->entries, 0, table->size * sizeof(HASH_ENTRY));
+    table->count = table->used = 0;
+}
+
+HASH_ENTRY *hash_next(const HASH *table, HASH_ENTRY *entry)
+{
+    HASH_ENTRY *end = table->entries + table->size;
+
+    entry = (entry == NULL) ? table->entries : entry + 1;
+
+    while (entry < end) {
+        if (entry->key != NULL && entry->key != TOMBSTONE)
+            return entry;
+        ++entry;
+    }
+
+    return NULL;
+}
+
+void hash_free(HASH *table)
+{
+    if (table == NULL)
+        return;
+
+    free(table->entries);
+    free(table);
+}
+
+unsigned long hash_int(const void *key)
+{
+    /* Watch descriptors are small sequential integers: use them as they are */
+    return (unsigned long) *(const int *) key;
+}
+
+int hash_int_compare(const void *a, const void *b)
+{
+    int x = *(const int *) a;
+    int y = *(const int *) b;
+
+    return (x > y) - (x < y);
+}
+
+unsigned long hash_string(const void *key)
+{
+    /* FNV-1a */
+    const unsigned char *str = (const unsigned char *) key;
+    unsigned long hash = 2166136261UL;
+
+    while (*str) {
+        hash ^= *str++;
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+int hash_string_compare(const void *a, const void *b)
+{
+    return strcmp((const char *) a, (const char *) b);
+}
@@ -0,0 +1,114 @@
+/* hash.h
+ * A simple open-addressing hash table and manipulation functions
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __HASH_H
+#define __HASH_H
+
+#include <stddef.h>
+
+/*
+ * Hash table entry
+ * The key is not copied: it must point to memory that
+ * lives as long as the entry (usually a field of data).
+ */
+typedef struct hash_entry_s
+{
+    const void *key;
+    void *data;
+} HASH_ENTRY;
+
+/* Hash table data structure (linear probing) */
+typedef struct hash
+{
+    HASH_ENTRY *entries;
+    size_t size;          /* number of slots, always a power of two */
+    size_t count;         /* number of live entries */
+    size_t used;          /* number of live entries plus tombstones */
+    unsigned long (*hash)(const void *);
+    int (*compare)(const void *, const void *);
+} HASH;
+
+/**
+ * Initialize hash table data structure
+ * @param function : the hash function of the key
+ * @param function : the compare function (0 when keys are equal)
+ * @return HASH *  : a pointer to the new allocated hash table
+ */
+HASH *hash_init(unsigned long (*)(const void *),
+                int (*)(const void *, const void *));
+
+/**
+ * Insert or replace an element
+ * @param HASH *       : a HASH pointer
+ * @param const void * : the key
+ * @param void *       : the data
+ * @return int         : -1 in case of error, 0 otherwise
+ */
+int hash_put(HASH *, const void *, void *);
+
+/**
+ * Search an element
+ * @param HASH *       : a HASH pointer
+ * @param const void * : the key to find
+ * @return void *      : the data, NULL otherwise
+ */
+void *hash_get(const HASH *, const void *);
+
+/**
+ * Remove an element
+ * @param HASH *       : a HASH pointer
+ * @param const void * : the key to remove
+ * @return void *      : the data removed, NULL otherwise
+ */
+void *hash_remove(HASH *, const void *);
+
+/**
+ * Remove all the elements, keeping the allocated slots
+ * @param HASH * : a HASH pointer
+ */
+void hash_clear(HASH *);
+
+/**
+ * Iterate over the elements of the hash table
+ * The table must not be modified during the iteration.
+ * @param HASH *         : a HASH pointer
+ * @param HASH_ENTRY *   : the previous entry returned, NULL to start
+ * @return HASH_ENTRY *  : the next entry, NULL at the end
+ */
+HASH_ENTRY *hash_next(const HASH *, HASH_ENTRY *);
+
+/**
+ * Deallocate hash table data structure
+ */
+void hash_free(HASH *);
+
+/* Hash and compare functions for keys that point to an int */
+unsigned long hash_int(const void *);
+int hash_int_compare(const void *, const void *);
+
+/* Hash and compare functions for keys that are NUL terminated strings */
+unsigned long hash_string(const void *);
+int hash_string_compare(const void *, const void *);
+
+#endif /* !__HASH_H */
@@ -45,6 +45,13 @@ LIST_NODE *list_push(LIST *list, void *data)
         return NULL;
 
     node->data = data;
+    list_link(list, node);
+
+    return node;
+}
+
+void list_link(LIST *list, LIST_NODE *node)
+{
     node->next = node->prev = NULL;
 
     /*
@@ -59,8 +66,6 @@ LIST_NODE *list_push(LIST *list, void *data)
         list->last->next = node;
         list->last = node;
     }
-
-    return node;
 }
 
 void *list_pop(LIST *list)
@@ -93,19 +98,23 @@ void list_remove(LIST* list, LIST_NODE *node)
     if (list->first == NULL)
         return;
     
-    if (node == list->first) {
-        list->first = list->first->next;
-        if (list->first != NULL)
-            list->first->prev = NULL;
-    } else if (node == list->last) {
-        list->last = list->last->prev;
-        list->last->next = NULL;
-    } else {
+    list_unlink(list, node);
+    free(node);
+}
+
+void list_unlink(LIST *list, LIST_NODE *node)
+{
+    if (node->prev != NULL)
         node->prev->next = node->next;
+    else
+        list->first = node->next;
+
+    if (node->next != NULL)
         node->next->prev = node->prev;
-    }
+    else
+        list->last = node->prev;
 
-    free(node);
+    node->next = node->prev = NULL;
 }
 
 void list_free(LIST *list)
@@ -55,6 +55,20 @@ LIST *list_init();
  */
 LIST_NODE *list_push(LIST *, void *);
 
+/**
+ * Append a node allocated by the caller (e.g. embedded in its data)
+ * @param LIST *      : a LIST pointer
+ * @param LIST_NODE * : the node, its data has to be set
+ */
+void list_link(LIST *, LIST_NODE *);
+
+/**
+ * Remove a node from list without deallocating it (see list_link)
+ * @param LIST *      : a pointer to the list
+ * @param LIST_NODE * : the list_node to remove
+ */
+void list_unlink(LIST *, LIST_NODE *);
+
 /**
  * Remove and return the first element of the list
  * @param LIST *  : a LIST pointer
@@ -0,0 +1,279 @@
+/* logger.c
+ * Asynchronous logger, the messages are written by a background thread
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "cwatch.h"
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+/*
+ * A slot of the ring (a bounded MPSC queue): the producers claim a
+ * position incrementing head, and publish the message setting the seq
+ * of its slot to position + 1. The writer thread reads the position
+ * at tail, and releases the slot for the next lap setting its seq to
+ * position + LOG_RING_SLOTS.
+ */
+typedef struct log_slot_s
+{
+    size_t seq;
+    char   text[LOG_SLOT_LEN];
+} LOG_SLOT;
+
+static LOG_SLOT *ring;
+static size_t head;               /* the next position claimed by a producer */
+static size_t tail;               /* the next position written by the thread */
+
+static pthread_t writer;
+static int running;
+static int stopping;
+static int sleeping;              /* 1 when the thread waits on wakeup_fd */
+static int wakeup_fd = -1;
+
+static int to_stdout;
+static int to_syslog;
+
+/* The rate limit, in windows of one second */
+static unsigned int rate;
+static long window;
+static unsigned int window_qty;
+
+static unsigned long dropped;
+
+static long logger_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+    return (long) ts.tv_sec;
+}
+
+static void logger_output(const char *text)
+{
+    if (to_stdout)
+        printf("%s\n", text);
+
+    if (to_syslog)
+        syslog(LOG_INFO, "%s", text);
+}
+
+/* Write the messages published, returns the number written */
+static int logger_drain()
+{
+    int written = 0;
+
+    for (;;) {
+        LOG_SLOT *slot = &ring[tail & (LOG_RING_SLOTS - 1)];
+
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + 1)
+            break;
+
+        logger_output(slot->text);
+        __atomic_store_n(&slot->seq, tail + LOG_RING_SLOTS, __ATOMIC_RELEASE);
+        ++tail;
+        ++written;
+    }
+
+    return written;
+}
+
+static void *logger_thread(void *arg)
+{
+    unsigned long reported = 0;
+    uint64_t value;
+
+    if (to_syslog)
+        openlog(PROGRAM_NAME, LOG_PID, LOG_LOCAL1);
+
+    for (;;) {
+        logger_drain();
+
+        /* The messages dropped since the last report */
+        unsigned long lost = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+        if (lost != reported) {
+            char text[64];
+            snprintf(text, sizeof(text), "LOG MESSAGES DROPPED:\t%lu", lost - reported);
+            logger_output(text);
+            reported = lost;
+        }
+
+        if (to_stdout)
+            fflush(stdout);
+
+        if (__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+            break;
+
+        /* Checked again once sleeping is set, a producer could have missed it */
+        __atomic_store_n(&sleeping, 1, __ATOMIC_SEQ_CST);
+        LOG_SLOT *slot = &ring[tail & (LOG_RING_SLOTS - 1)];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) == tail + 1
+            || __atomic_load_n(&stopping, __ATOMIC_SEQ_CST))
+        {
+            __atomic_store_n(&sleeping, 0, __ATOMIC_SEQ_CST);
+            continue;
+        }
+
+        if (read(wakeup_fd, &value, sizeof(value)) == -1 && errno != EINTR)
+            break;
+        __atomic_store_n(&sleeping, 0, __ATOMIC_SEQ_CST);
+    }
+
+    if (to_syslog)
+        closelog();
+
+    return NULL;
+}
+
+static void logger_wakeup()
+{
+    uint64_t value = 1;
+
+    if (__atomic_exchange_n(&sleeping, 0, __ATOMIC_SEQ_CST) == 1
+        && write(wakeup_fd, &value, sizeof(value)) == -1)
+    {
+        /* The thread is awake anyway, the counter is saturated */
+    }
+}
+
+int logger_start(int stdout_flag, int syslog_flag, unsigned int max_rate)
+{
+    size_t i;
+
+    if (running)
+        return 0;
+
+    ring = (LOG_SLOT *) malloc(LOG_RING_SLOTS * sizeof(LOG_SLOT));
+    if (ring == NULL)
+        return -1;
+
+    for (i = 0; i < LOG_RING_SLOTS; ++i)
+        ring[i].seq = i;
+    head = tail = 0;
+
+    wakeup_fd = eventfd(0, EFD_CLOEXEC);
+    if (wakeup_fd == -1) {
+        free(ring);
+        return -1;
+    }
+
+    to_stdout = stdout_flag;
+    to_syslog = syslog_flag;
+    rate = max_rate;
+    window = logger_seconds();
+
+    /* The signals are handled by the main thread only (see loop_add_signal) */
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    int result = pthread_create(&writer, NULL, logger_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (result != 0) {
+        close(wakeup_fd);
+        free(ring);
+        return -1;
+    }
+
+    __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+    atexit(logger_stop);
+
+    return 0;
+}
+
+int logger_vwrite(const char *message_format, va_list arguments)
+{
+    if (__atomic_load_n(&running, __ATOMIC_ACQUIRE) == 0)
+        return -1;
+
+    /* The rate limit, the window is reset by the first message of each second */
+    if (rate > 0) {
+        long now = logger_seconds();
+
+        if (now != __atomic_load_n(&window, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&window, now, __ATOMIC_RELAXED);
+            __atomic_store_n(&window_qty, 0, __ATOMIC_RELAXED);
+        }
+
+        if (__atomic_add_fetch(&window_qty, 1, __ATOMIC_RELAXED) > rate) {
+            __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+    }
+
+    /* Claim a slot, the message is dropped if the ring is full */
+    size_t position = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    LOG_SLOT *slot;
+
+    for (;;) {
+        slot = &ring[position & (LOG_RING_SLOTS - 1)];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t) seq - (intptr_t) position;
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&head, &position, position + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+            logger_wakeup();
+            return 0;
+        } else {
+            position = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        }
+    }
+
+    vsnprintf(slot->text, LOG_SLOT_LEN, message_format, arguments);
+    __atomic_store_n(&slot->seq, position + 1, __ATOMIC_RELEASE);
+
+    logger_wakeup();
+
+    return 0;
+}
+
+void logger_stop()
+{
+    uint64_t value = 1;
+
+    if (__atomic_exchange_n(&running, 0, __ATOMIC_ACQ_REL) == 0)
+        return;
+
+    __atomic_store_n(&stopping, 1, __ATOMIC_SEQ_CST);
+    if (write(wakeup_fd, &value, sizeof(value)) == -1) {
+        /* The thread is awake anyway */
+    }
+
+    pthread_join(writer, NULL);
+
+    /* The messages published after the last drain */
+    logger_drain();
+    if (to_stdout)
+        fflush(stdout);
+
+    close(wakeup_fd);
+}
+
+unsigned long logger_dropped()
+{
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,64 @@
+/* logger.h
+ * Asynchronous logger, the messages are written by a background thread
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __LOGGER_H
+#define __LOGGER_H
+
+#include <stdarg.h>
+
+#define LOG_RING_SLOTS  1024      /* the messages waiting to be written, a power of two */
+#define LOG_SLOT_LEN    1024      /* the longest message, longer ones are truncated */
+#define LOG_RATE        10000     /* the default max number of messages per second */
+
+/**
+ * Start the thread that writes the log messages, to the standard
+ * output and/or to syslog. The messages left are written at exit.
+ * @param int  : 1 to write the messages to the standard output
+ * @param int  : 1 to write the messages to syslog
+ * @param unsigned int : the max number of messages per second, 0 for no limit
+ * @return int : -1 in case of error, 0 otherwise
+ */
+int logger_start(int, int, unsigned int);
+
+/**
+ * Queue a log message, it never blocks: the message is dropped when
+ * the ring is full or the rate limit is exceeded
+ * @param char *  : the format of the message (see printf)
+ * @param va_list : the arguments of the format
+ * @return int    : -1 if the logger is not started, 0 otherwise
+ */
+int logger_vwrite(const char *, va_list);
+
+/**
+ * Write the messages left and stop the thread (registered with atexit)
+ */
+void logger_stop();
+
+/**
+ * The number of messages dropped
+ * @return unsigned long : the messages dropped since the start
+ */
+unsigned long logger_dropped();
+
+#endif /* !__LOGGER_H */
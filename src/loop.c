@@ -0,0 +1,244 @@
+/* loop.c
+ * A single threaded event loop (epoll, timerfd and signalfd)
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "cwatch.h"
+
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define LOOP_MAX_EVENTS 64
+
+static int epoll_fd = -1;
+static bool_t running;
+
+/* The sources removed while handling the ready ones, deallocated after */
+static LIST *removed_sources;
+
+/* The signals handled, read from a single signalfd */
+static LOOP_SOURCE *signals_source;
+static sigset_t signals_mask;
+static loop_handler_t signal_handlers[NSIG];
+static void *signal_args[NSIG];
+
+static LOOP_SOURCE *loop_source_create(loop_source_t kind, int source_fd, loop_handler_t handler, void *arg)
+{
+    LOOP_SOURCE *source = (LOOP_SOURCE *) malloc(sizeof(LOOP_SOURCE));
+    if (source == NULL)
+        return NULL;
+
+    source->kind = kind;
+    source->fd = source_fd;
+    source->handler = handler;
+    source->arg = arg;
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = (void *) source;
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, source_fd, &event) == -1) {
+        free(source);
+        return NULL;
+    }
+
+    return source;
+}
+
+/* Call the handler of each signal received */
+static void loop_read_signals(void *arg)
+{
+    struct signalfd_siginfo info;
+
+    while (read(signals_source->fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo < NSIG && signal_handlers[info.ssi_signo] != NULL)
+            signal_handlers[info.ssi_signo](signal_args[info.ssi_signo]);
+    }
+}
+
+int loop_init()
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1)
+        return -1;
+
+    removed_sources = list_init();
+    sigemptyset(&signals_mask);
+
+    return 0;
+}
+
+LOOP_SOURCE *loop_add(int source_fd, loop_handler_t handler, void *arg)
+{
+    return loop_source_create(LOOP_FD, source_fd, handler, arg);
+}
+
+LOOP_SOURCE *loop_add_timer(loop_handler_t handler, void *arg)
+{
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd == -1)
+        return NULL;
+
+    LOOP_SOURCE *source = loop_source_create(LOOP_TIMER, timer_fd, handler, arg);
+    if (source == NULL)
+        close(timer_fd);
+
+    return source;
+}
+
+int loop_set_timer(LOOP_SOURCE *timer, unsigned int ms, unsigned int interval_ms)
+{
+    struct itimerspec spec;
+
+    spec.it_value.tv_sec = ms / 1000;
+    spec.it_value.tv_nsec = (ms % 1000) * 1000000L;
+    spec.it_interval.tv_sec = interval_ms / 1000;
+    spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+
+    return timerfd_settime(timer->fd, 0, &spec, NULL);
+}
+
+int loop_add_signal(int signum, loop_handler_t handler, void *arg)
+{
+    if (signum <= 0 || signum >= NSIG)
+        return -1;
+
+    /* The signal is only delivered through the signalfd */
+    sigaddset(&signals_mask, signum);
+    if (sigprocmask(SIG_BLOCK, &signals_mask, NULL) == -1)
+        return -1;
+
+    int signals_fd = signalfd((signals_source != NULL) ? signals_source->fd : -1,
+                              &signals_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signals_fd == -1)
+        return -1;
+
+    if (signals_source == NULL) {
+        signals_source = loop_source_create(LOOP_SIGNALS, signals_fd, loop_read_signals, NULL);
+        if (signals_source == NULL) {
+            close(signals_fd);
+            return -1;
+        }
+    }
+
+    signal_handlers[signum] = handler;
+    signal_args[signum] = arg;
+
+    return 0;
+}
+
+int listen_unix(const char *path)
+{
+    struct sockaddr_un address;
+    struct stat st;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+
+    /* The socket left by a previous run, bind fails on any other file */
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address)) == -1 || listen(fd, 16) == -1) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+
+    return fd;
+}
+
+void loop_remove(LOOP_SOURCE *source)
+{
+    if (source == NULL || source->fd == -1)
+        return;
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+    if (source->kind == LOOP_TIMER)
+        close(source->fd);
+
+    /* It could be one of the sources ready, it is deallocated after handling them */
+    source->fd = -1;
+    list_push(removed_sources, (void *) source);
+}
+
+int loop_run()
+{
+    struct epoll_event events[LOOP_MAX_EVENTS];
+    uint64_t expirations;
+    int i;
+
+    running = TRUE;
+
+    while (running == TRUE) {
+        int ready = epoll_wait(epoll_fd, events, LOOP_MAX_EVENTS, -1);
+
+        if (ready == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        for (i = 0; i < ready; ++i) {
+            LOOP_SOURCE *source = (LOOP_SOURCE *) events[i].data.ptr;
+
+            if (source->fd == -1)
+                continue;
+
+            /* The timer has to be read to be disarmed */
+            if (source->kind == LOOP_TIMER
+                && read(source->fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+            {
+                continue;
+            }
+
+            source->handler(source->arg);
+        }
+
+        void *source;
+        while ((source = list_pop(removed_sources)) != NULL)
+            free(source);
+    }
+
+    return 0;
+}
+
+void loop_stop()
+{
+    running = FALSE;
+}
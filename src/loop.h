@@ -0,0 +1,117 @@
+/* loop.h
+ * A single threaded event loop (epoll, timerfd and signalfd)
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __LOOP_H
+#define __LOOP_H
+
+/* Function called when a source of the loop is ready */
+typedef void (*loop_handler_t)(void *);
+
+typedef enum
+{
+    LOOP_FD,              /* a file descriptor ready to be read */
+    LOOP_TIMER,           /* a timer expired */
+    LOOP_SIGNALS          /* the signals received (see loop_add_signal) */
+} loop_source_t;
+
+/* Used to store a source of events */
+typedef struct loop_source_s
+{
+    loop_source_t  kind;
+    int            fd;        /* -1 once removed */
+    loop_handler_t handler;
+    void           *arg;      /* argument passed to the handler */
+} LOOP_SOURCE;
+
+/**
+ * Initialize the event loop
+ * @return int : -1 in case of error, 0 otherwise
+ */
+int loop_init();
+
+/**
+ * Call a function each time a file descriptor is ready to be read
+ * The handler has to read until EAGAIN (the loop is level triggered).
+ * @param int            : the file descriptor
+ * @param loop_handler_t : the handler
+ * @param void *         : argument passed to the handler
+ * @return LOOP_SOURCE * : the source, NULL in case of error
+ */
+LOOP_SOURCE *loop_add(int, loop_handler_t, void *);
+
+/**
+ * Create a timer, disarmed
+ * @param loop_handler_t : the handler called when the timer expires
+ * @param void *         : argument passed to the handler
+ * @return LOOP_SOURCE * : the timer, NULL in case of error
+ */
+LOOP_SOURCE *loop_add_timer(loop_handler_t, void *);
+
+/**
+ * Arm or disarm a timer
+ * @param LOOP_SOURCE *  : the timer
+ * @param unsigned int   : the milliseconds before the first expiration, 0 to disarm
+ * @param unsigned int   : the milliseconds between the next expirations, 0 for once
+ * @return int           : -1 in case of error, 0 otherwise
+ */
+int loop_set_timer(LOOP_SOURCE *, unsigned int, unsigned int);
+
+/**
+ * Call a function each time a signal is received
+ * The signal is blocked and read through a signalfd,
+ * so the handler runs in the loop as the other sources.
+ * @param int            : the signal number
+ * @param loop_handler_t : the handler
+ * @param void *         : argument passed to the handler
+ * @return int           : -1 in case of error, 0 otherwise
+ */
+int loop_add_signal(int, loop_handler_t, void *);
+
+/**
+ * Open a UNIX stream socket listening on a path, to be added to the loop
+ * A socket left at the path by a previous run is replaced, any other file is kept.
+ * @param const char * : the path of the socket
+ * @return int         : the file descriptor (non blocking), -1 in case of error
+ */
+int listen_unix(const char *);
+
+/**
+ * Remove a source from the loop (the file descriptor of a timer is closed)
+ * @param LOOP_SOURCE * : the source
+ */
+void loop_remove(LOOP_SOURCE *);
+
+/**
+ * Wait for the sources and call their handlers, until loop_stop()
+ * All the sources ready are handled at each wakeup.
+ * @return int : -1 in case of error, 0 otherwise
+ */
+int loop_run();
+
+/**
+ * Stop the loop, once the sources ready are handled
+ */
+void loop_stop();
+
+#endif /* !__LOOP_H */
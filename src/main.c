@@ -30,18 +30,62 @@
 int main(int argc, char *argv[])
 { 
     if (parse_command_line(argc, argv) == 0) {
-        /* File descriptor inotify */
-        fd = inotify_init();
+        /* The log messages are written by a thread, the events are never blocked by the log */
+        int log_stdout = (verbose_flag && (NULL == format || batch_flag)) ? 1 : 0;
+        if ((log_stdout || syslog_flag) && logger_start(log_stdout, syslog_flag, log_rate) == -1)
+            log_message("UNABLE TO START THE LOGGER THREAD (%s), LOGGING SYNCHRONOUSLY", strerror(errno));
+
+        /* File descriptor of the notification backend */
+        fd = backend->init();
+        if (fd == -1 && backend != &inotify_backend) {
+            log_message("UNABLE TO START THE %s BACKEND (%s), USING INOTIFY", backend->name, strerror(errno));
+            backend = &inotify_backend;
+            fd = backend->init();
+        }
+
+        /* The entries of the directories are probed with io_uring */
+        if (uring_flag == TRUE && uring_init() == -1)
+            log_message("UNABLE TO START IO_URING (%s), PROBING THE ENTRIES ONE AFTER ANOTHER", strerror(errno));
 
         /* List of all watch directories */
         list_wd = list_init();
 
-        /* Watch the path */
-        if (watch(root_path, NULL) == -1) {
-            printf("An error occured while adding \"%s\" as watched resource!\n", root_path);
-            return -1;
+        /* Index of watch directories by watch descriptor */
+        wd_index = hash_init(hash_int, hash_int_compare);
+
+        /* Index of symbolic links by path */
+        link_index = hash_init(hash_string, hash_string_compare);
+
+        /* Tree of watch directories by path (it is their index by path too) */
+        wd_tree = trie_init();
+
+        /* Watch the root paths */
+        struct timespec scan_start, scan_end;
+        clock_gettime(CLOCK_MONOTONIC, &scan_start);
+
+        if (state_file == NULL || state_load(state_file) == -1) {
+            /* With a budget, the directories are watched in order of depth by a single thread */
+            if (scan_threads > 1 && recursive_flag == TRUE && backend->per_directory && !budget_enabled()) {
+                if (parallel_watch(root_paths, roots_qty, scan_threads) == -1) {
+                    printf("An error occured while adding the directories as watched resources!\n");
+                    return -1;
+                }
+            } else {
+                unsigned int i;
+                for (i = 0; i < roots_qty; ++i) {
+                    if (watch(root_paths[i], NULL) == -1) {
+                        printf("An error occured while adding \"%s\" as watched resource!\n", root_paths[i]);
+                        return -1;
+                    }
+                }
+            }
         }
 
+        clock_gettime(CLOCK_MONOTONIC, &scan_end);
+        log_message("SCAN COMPLETED:\t%zu directories in %.3f seconds",
+                    wd_index->count,
+                    (scan_end.tv_sec - scan_start.tv_sec) + (scan_end.tv_nsec - scan_start.tv_nsec) / 1e9);
+
         /* Start monitoring */
         return monitor();
     }
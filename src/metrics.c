@@ -0,0 +1,229 @@
+/* metrics.c
+ * Runtime counters and latency histograms (--metrics-socket option)
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "cwatch.h"
+
+#include <sys/socket.h>
+
+METRICS metrics;
+int metrics_enabled;
+
+static int metrics_fd = -1;
+static char *metrics_path;
+
+static const char *counter_names[METRIC_COUNTERS][2] =
+{
+    {"cwatch_events_excluded_total",  "Events discarded by the exclusion patterns."},
+    {"cwatch_events_dropped_total",   "Events read for a directory that is no longer watched."},
+    {"cwatch_queue_overflows_total",  "Overflows of the kernel events queue."},
+    {"cwatch_watches_added_total",    "Directories added to the watch list."},
+    {"cwatch_watches_removed_total",  "Directories removed from the watch list."},
+    {"cwatch_watches_evicted_total",  "Directories evicted by the watch budget."},
+    {"cwatch_commands_spawned_total", "Commands executed."},
+    {"cwatch_command_failures_total", "Commands not executed or terminated with an error."},
+    {"cwatch_events_unchanged_total", "Events skipped because the content of the file is unchanged."},
+    {"cwatch_fingerprint_bytes_total", "Bytes hashed to fingerprint the files."}
+};
+
+static const char *histogram_names[METRIC_HISTOGRAMS][2] =
+{
+    {"cwatch_dispatch_latency_seconds", "Time from the read of an event to its handling."},
+    {"cwatch_lookup_seconds",           "Time to find the watched directory of an event."},
+    {"cwatch_spawn_seconds",            "Time to spawn a command."},
+    {"cwatch_fingerprint_seconds",      "Time to hash a file to fingerprint it."}
+};
+
+void metrics_event(uint32_t mask)
+{
+    if (metrics_enabled == 0)
+        return;
+
+    int bit = ffs((int) mask);
+    if (bit > 0)
+        ++metrics.events_read[bit - 1];
+}
+
+void metrics_count(metric_counter_t counter)
+{
+    if (metrics_enabled == 1)
+        ++metrics.counters[counter];
+}
+
+void metrics_add(metric_counter_t counter, unsigned long amount)
+{
+    if (metrics_enabled == 1)
+        metrics.counters[counter] += amount;
+}
+
+uint64_t metrics_now()
+{
+    struct timespec now;
+
+    if (metrics_enabled == 0)
+        return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+void metrics_observe(metric_histogram_t histogram, uint64_t start)
+{
+    if (metrics_enabled == 0 || start == 0)
+        return;
+
+    uint64_t elapsed = metrics_now() - start;
+    uint64_t us = (elapsed + 999) / 1000;
+    HISTOGRAM *h = &metrics.histograms[histogram];
+
+    /* The smallest bucket 2^i >= us */
+    int i = (us <= 1) ? 0 : 64 - __builtin_clzll(us - 1);
+    if (i < METRIC_BUCKETS)
+        ++h->buckets[i];
+
+    ++h->count;
+    h->sum += elapsed;
+}
+
+bstring metrics_format()
+{
+    bstring text = bfromcstralloc(4096, "");
+    int i, j;
+
+    bformata(text, "# HELP cwatch_events_read_total Events read from the backend, by type.\n");
+    bformata(text, "# TYPE cwatch_events_read_total counter\n");
+    for (i = 0; i < 32; ++i) {
+        if (metrics.events_read[i] == 0)
+            continue;
+
+        struct event_t *event = get_inotify_event(1U << i);
+        bformata(text, "cwatch_events_read_total{event=\"%s\"} %lu\n",
+                 (event != NULL && event->name != NULL) ? event->name : "unknown", metrics.events_read[i]);
+    }
+
+    for (i = 0; i < METRIC_COUNTERS; ++i) {
+        bformata(text, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n",
+                 counter_names[i][0], counter_names[i][1], counter_names[i][0],
+                 counter_names[i][0], metrics.counters[i]);
+    }
+
+    bformata(text, "# HELP cwatch_watches Directories watched.\n# TYPE cwatch_watches gauge\n");
+    bformata(text, "cwatch_watches %zu\n", (wd_index != NULL) ? wd_index->count : 0);
+    bformata(text, "# HELP cwatch_running_jobs Commands running.\n# TYPE cwatch_running_jobs gauge\n");
+    bformata(text, "cwatch_running_jobs %u\n", running_jobs);
+    bformata(text, "# HELP cwatch_log_dropped_total Log messages dropped by the rate limit or a full ring.\n# TYPE cwatch_log_dropped_total counter\n");
+    bformata(text, "cwatch_log_dropped_total %lu\n", logger_dropped());
+
+    READER_STATS reader;
+    if (reader_stats(&reader) == 0) {
+        bformata(text, "# HELP cwatch_reader_reads_total Reads of the kernel queue by the reader thread.\n# TYPE cwatch_reader_reads_total counter\n");
+        bformata(text, "cwatch_reader_reads_total %lu\n", reader.reads);
+        bformata(text, "# HELP cwatch_reader_stalls_total Times the reader thread waited for a free buffer.\n# TYPE cwatch_reader_stalls_total counter\n");
+        bformata(text, "cwatch_reader_stalls_total %lu\n", reader.stalls);
+        bformata(text, "# HELP cwatch_reader_high_water Most buffers of the ring in use at once.\n# TYPE cwatch_reader_high_water gauge\n");
+        bformata(text, "cwatch_reader_high_water %u\n", reader.high_water);
+        bformata(text, "# HELP cwatch_reader_buffers Buffers of the ring.\n# TYPE cwatch_reader_buffers gauge\n");
+        bformata(text, "cwatch_reader_buffers %u\n", reader.chunks);
+    }
+
+    for (i = 0; i < METRIC_HISTOGRAMS; ++i) {
+        const HISTOGRAM *h = &metrics.histograms[i];
+        const char *name = histogram_names[i][0];
+        unsigned long cumulative = 0;
+
+        bformata(text, "# HELP %s %s\n# TYPE %s histogram\n", name, histogram_names[i][1], name);
+        for (j = 0; j < METRIC_BUCKETS; ++j) {
+            cumulative += h->buckets[j];
+            bformata(text, "%s_bucket{le=\"%g\"} %lu\n", name, (double) (1UL << j) / 1e6, cumulative);
+        }
+        bformata(text, "%s_bucket{le=\"+Inf\"} %lu\n", name, h->count);
+        bformata(text, "%s_sum %.9f\n", name, (double) h->sum / 1e9);
+        bformata(text, "%s_count %lu\n", name, h->count);
+    }
+
+    return text;
+}
+
+/* Write the whole text, it is small enough for the socket buffer */
+static void metrics_write(int out_fd)
+{
+    bstring text = metrics_format();
+    ssize_t written = 0;
+
+    while (written < blength(text)) {
+        ssize_t n = write(out_fd, text->data + written, blength(text) - written);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        written += n;
+    }
+
+    bdestroy(text);
+}
+
+/* A client connected, the metrics are written and the connection is closed */
+static void metrics_accept(void *arg)
+{
+    int client_fd;
+
+    while ((client_fd = accept4(metrics_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        metrics_write(client_fd);
+        close(client_fd);
+    }
+}
+
+static void metrics_dump(void *arg)
+{
+    metrics_write(STDERR_FILENO);
+}
+
+int metrics_start(const char *path)
+{
+    metrics_fd = listen_unix(path);
+    if (metrics_fd == -1)
+        return -1;
+
+    if (loop_add(metrics_fd, metrics_accept, NULL) == NULL
+        || loop_add_signal(SIGUSR1, metrics_dump, NULL) == -1)
+    {
+        close(metrics_fd);
+        metrics_fd = -1;
+        return -1;
+    }
+
+    metrics_path = strdup(path);
+
+    return 0;
+}
+
+void metrics_stop()
+{
+    if (metrics_fd == -1)
+        return;
+
+    close(metrics_fd);
+    metrics_fd = -1;
+    unlink(metrics_path);
+}
@@ -0,0 +1,126 @@
+/* metrics.h
+ * Runtime counters and latency histograms (--metrics-socket option)
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <stdint.h>
+
+#define METRIC_BUCKETS  24        /* the histogram buckets, from 1us to 2^23us (about 8s) */
+
+typedef enum
+{
+    METRIC_EVENTS_EXCLUDED,       /* discarded by -x, --exclude-glob or a rule */
+    METRIC_EVENTS_DROPPED,        /* read for a watch descriptor that is no longer watched */
+    METRIC_OVERFLOWS,             /* IN_Q_OVERFLOW */
+    METRIC_WATCHES_ADDED,
+    METRIC_WATCHES_REMOVED,
+    METRIC_WATCHES_EVICTED,       /* removed by --max-watches */
+    METRIC_COMMANDS_SPAWNED,
+    METRIC_COMMAND_FAILURES,      /* not spawned, terminated by a signal or with a status != 0 */
+    METRIC_EVENTS_UNCHANGED,      /* skipped by --skip-unchanged */
+    METRIC_FINGERPRINT_BYTES,     /* hashed by --skip-unchanged */
+    METRIC_COUNTERS
+} metric_counter_t;
+
+typedef enum
+{
+    METRIC_DISPATCH_LATENCY,      /* from the read of an event to its handler */
+    METRIC_LOOKUP_TIME,           /* get_node_from_wd() */
+    METRIC_SPAWN_LATENCY,         /* posix_spawn() */
+    METRIC_FINGERPRINT_TIME,      /* the hash of a file by --skip-unchanged */
+    METRIC_HISTOGRAMS
+} metric_histogram_t;
+
+/* Used to store a distribution of durations, in power of two buckets */
+typedef struct histogram_s
+{
+    unsigned long buckets[METRIC_BUCKETS]; /* the durations <= 2^i microseconds (not cumulative) */
+    unsigned long count;
+    uint64_t      sum;                     /* nanoseconds */
+} HISTOGRAM;
+
+/* The metrics collected, only when metrics_enabled is set */
+typedef struct metrics_s
+{
+    unsigned long events_read[32];         /* by bit of the event mask (see get_inotify_event) */
+    unsigned long counters[METRIC_COUNTERS];
+    HISTOGRAM     histograms[METRIC_HISTOGRAMS];
+} METRICS;
+
+extern METRICS metrics;
+extern int metrics_enabled;
+
+/**
+ * Serve the metrics on a UNIX socket, and write them to the standard
+ * error on SIGUSR1. Called once the event loop is initialized.
+ * @param char * : the path of the socket
+ * @return int   : -1 in case of error, 0 otherwise
+ */
+int metrics_start(const char *);
+
+/**
+ * Remove the socket of the metrics
+ */
+void metrics_stop();
+
+/**
+ * Count an event read from the backend
+ * @param uint32_t : the event mask
+ */
+void metrics_event(uint32_t);
+
+/**
+ * Increment a counter
+ * @param metric_counter_t : the counter
+ */
+void metrics_count(metric_counter_t);
+
+/**
+ * Add to a counter
+ * @param metric_counter_t : the counter
+ * @param unsigned long    : the amount
+ */
+void metrics_add(metric_counter_t, unsigned long);
+
+/**
+ * The monotonic time, to measure a duration (see metrics_observe)
+ * @return uint64_t : nanoseconds, 0 if the metrics are not enabled
+ */
+uint64_t metrics_now();
+
+/**
+ * Add a duration to a histogram
+ * @param metric_histogram_t : the histogram
+ * @param uint64_t           : the start of the duration (see metrics_now), 0 to ignore it
+ */
+void metrics_observe(metric_histogram_t, uint64_t);
+
+/**
+ * Format the metrics in the Prometheus text format
+ * @return bstring : the text, to be deallocated
+ */
+bstring metrics_format();
+
+#endif /* !__METRICS_H */
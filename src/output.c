@@ -0,0 +1,281 @@
+/* output.c
+ * The records written to the standard output (-F and --output options)
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "cwatch.h"
+
+/* The records waiting to be written */
+static bstring buffer;
+
+/* Expires at the end of the flush interval (--output-flush option) */
+static LOOP_SOURCE *flush_timer;
+static bool_t flush_armed;
+
+int get_output_mode(const char *name)
+{
+    if (strcmp(name, "text") == 0)
+        return OUTPUT_TEXT;
+    if (strcmp(name, "jsonl") == 0)
+        return OUTPUT_JSONL;
+    if (strcmp(name, "nul") == 0)
+        return OUTPUT_NUL;
+    if (strcmp(name, "binary") == 0)
+        return OUTPUT_BINARY;
+
+    return -1;
+}
+
+/* The length of the UTF-8 sequence at str, 0 if it is not valid */
+static int utf8_length(const unsigned char *str)
+{
+    unsigned char c = str[0];
+    int length, i;
+
+    if (c >= 0xC2 && c <= 0xDF)
+        length = 2;
+    else if (c >= 0xE0 && c <= 0xEF)
+        length = 3;
+    else if (c >= 0xF0 && c <= 0xF4)
+        length = 4;
+    else
+        return 0;
+
+    for (i = 1; i < length; ++i) {
+        if ((str[i] & 0xC0) != 0x80)
+            return 0;
+    }
+
+    /* Overlong forms, UTF-16 surrogates and code points beyond U+10FFFF */
+    if ((c == 0xE0 && str[1] < 0xA0) || (c == 0xED && str[1] > 0x9F)
+        || (c == 0xF0 && str[1] < 0x90) || (c == 0xF4 && str[1] > 0x8F))
+    {
+        return 0;
+    }
+
+    return length;
+}
+
+/*
+ * Append a JSON string. The bytes that are not valid UTF-8 are written
+ * as lone surrogates \udc80-\udcff, so that they can be decoded back
+ * (e.g. by Python with the surrogateescape error handler).
+ */
+static void output_json_string(const char *key, const char *value)
+{
+    const unsigned char *c = (const unsigned char *) ((value != NULL) ? value : "");
+    char escape[8];
+
+    bformata(buffer, "\"%s\":\"", key);
+
+    while (*c != '\0') {
+        const unsigned char *run = c;
+
+        /* The characters copied as they are */
+        while (*c >= 0x20 && *c < 0x80 && *c != '"' && *c != '\\')
+            ++c;
+        if (c > run)
+            bcatblk(buffer, run, c - run);
+
+        if (*c == '\0')
+            break;
+
+        if (*c >= 0x80) {
+            int length = utf8_length(c);
+
+            if (length > 0) {
+                bcatblk(buffer, c, length);
+                c += length;
+                continue;
+            }
+
+            snprintf(escape, sizeof(escape), "\\udc%02x", *c);
+        } else if (*c == '"' || *c == '\\') {
+            snprintf(escape, sizeof(escape), "\\%c", *c);
+        } else if (*c == '\n') {
+            snprintf(escape, sizeof(escape), "\\n");
+        } else if (*c == '\t') {
+            snprintf(escape, sizeof(escape), "\\t");
+        } else {
+            snprintf(escape, sizeof(escape), "\\u%04x", *c);
+        }
+
+        bcatcstr(buffer, escape);
+        ++c;
+    }
+
+    bconchar(buffer, '"');
+}
+
+/* Append a field of a binary record, returns its length */
+static uint16_t output_binary_field(const char *value)
+{
+    size_t length = (value != NULL) ? strlen(value) : 0;
+
+    if (length > UINT16_MAX)
+        length = UINT16_MAX;
+    if (length > 0)
+        bcatblk(buffer, value, (int) length);
+
+    return (uint16_t) length;
+}
+
+static void output_timer_expired(void *arg)
+{
+    flush_armed = FALSE;
+
+    if (output_flush() == -1) {
+        printf("ERROR OCCURED: Unable to write the events to the standard output!\n");
+        exit(1);
+    }
+}
+
+int output_event(char *event_name, char *file_name, char *event_p_path)
+{
+    unsigned int count = (coalesce_ms > 0) ? coalesce_c : 1;
+    struct timespec now;
+
+    if (NULL == buffer)
+        buffer = bfromcstralloc(OUTPUT_FLUSH_SIZE, "");
+
+    switch (output_mode) {
+    case OUTPUT_TEXT:
+        format_command(command_template, event_p_path, file_name, event_name);
+        bconcat(buffer, tmp_command);
+        bconchar(buffer, '\n');
+        break;
+
+    case OUTPUT_JSONL:
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        bconchar(buffer, '{');
+        output_json_string("root", event_root);
+        bconchar(buffer, ',');
+        output_json_string("path", event_p_path);
+        bconchar(buffer, ',');
+        output_json_string("name", file_name);
+        bconchar(buffer, ',');
+        output_json_string("event", event_name);
+        if (event_old_path != NULL) {
+            bconchar(buffer, ',');
+            output_json_string("old", event_old_path);
+        }
+        bformata(buffer, ",\"cookie\":%u,\"count\":%u,\"time\":%ld.%09ld}\n",
+                 event_cookie, count, (long) now.tv_sec, now.tv_nsec);
+        break;
+
+    case OUTPUT_NUL:
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        bcatcstr(buffer, (event_root != NULL) ? event_root : "");
+        bconchar(buffer, '\0');
+        bcatcstr(buffer, event_p_path);
+        bconchar(buffer, '\0');
+        bcatcstr(buffer, file_name);
+        bconchar(buffer, '\0');
+        bcatcstr(buffer, event_name);
+        bconchar(buffer, '\0');
+        bcatcstr(buffer, (event_old_path != NULL) ? event_old_path : "");
+        bconchar(buffer, '\0');
+        bformata(buffer, "%u", event_cookie);
+        bconchar(buffer, '\0');
+        bformata(buffer, "%u", count);
+        bconchar(buffer, '\0');
+        bformata(buffer, "%ld.%09ld", (long) now.tv_sec, now.tv_nsec);
+        bconchar(buffer, '\0');
+        break;
+
+    case OUTPUT_BINARY:
+    {
+        OUTPUT_RECORD record;
+        int start = blength(buffer);
+
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        memset(&record, 0, sizeof(record));
+        record.cookie = event_cookie;
+        record.time = (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+        record.count = count;
+
+        /* The header is written once the fields are appended */
+        bcatblk(buffer, &record, sizeof(record));
+        record.root_len = output_binary_field(event_root);
+        record.path_len = output_binary_field(event_p_path);
+        record.name_len = output_binary_field(file_name);
+        record.event_len = output_binary_field(event_name);
+        record.old_len = output_binary_field(event_old_path);
+        record.length = (uint32_t) (blength(buffer) - start);
+
+        memcpy(buffer->data + start, &record, sizeof(record));
+        break;
+    }
+    }
+
+    if (blength(buffer) >= OUTPUT_FLUSH_SIZE)
+        return output_flush();
+
+    /* The first record of the interval */
+    if (output_flush_ms > 0 && flush_armed == FALSE) {
+        if (NULL == flush_timer)
+            flush_timer = loop_add_timer(output_timer_expired, NULL);
+
+        if (NULL == flush_timer || loop_set_timer(flush_timer, output_flush_ms, 0) == -1)
+            return output_flush();
+
+        flush_armed = TRUE;
+    }
+
+    return 0;
+}
+
+int output_end_batch()
+{
+    return (output_flush_ms > 0) ? 0 : output_flush();
+}
+
+int output_flush()
+{
+    int written = 0;
+
+    if (NULL == buffer)
+        return 0;
+
+    while (written < blength(buffer)) {
+        ssize_t n = write(STDOUT_FILENO, buffer->data + written, blength(buffer) - written);
+
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            return -1;
+
+        written += n;
+    }
+
+    btrunc(buffer, 0);
+
+    if (flush_armed == TRUE) {
+        loop_set_timer(flush_timer, 0, 0);
+        flush_armed = FALSE;
+    }
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+/* output.h
+ * The records written to the standard output (-F and --output options)
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __OUTPUT_H
+#define __OUTPUT_H
+
+#include <stdint.h>
+
+#include "bstrlib.h"
+
+#define OUTPUT_FLUSH_SIZE (64 * 1024)   /* the records buffered are written at once beyond this size */
+
+/* The encodings of the records (--output option) */
+typedef enum
+{
+    OUTPUT_TEXT,          /* the -F format, terminated by a newline */
+    OUTPUT_JSONL,         /* a JSON object per line */
+    OUTPUT_NUL,           /* the fields terminated by a NUL character */
+    OUTPUT_BINARY         /* an OUTPUT_RECORD followed by the fields */
+} output_mode_t;
+
+/*
+ * The header of a binary record, in host byte order
+ * It is followed by the root, the path, the name, the event name and the
+ * old path of a rename, without NUL terminators: length is the size of the
+ * whole record.
+ */
+typedef struct output_record_s
+{
+    uint32_t length;
+    uint32_t cookie;      /* the cookie of the inotify event (moved_from and moved_to) */
+    uint64_t time;        /* nanoseconds since the epoch */
+    uint32_t count;       /* the events folded in this one (--coalesce option) */
+    uint16_t root_len;
+    uint16_t path_len;
+    uint16_t name_len;
+    uint16_t event_len;
+    uint16_t old_len;     /* 0 unless the event is a rename */
+    uint16_t reserved;
+} OUTPUT_RECORD;
+
+/**
+ * Search an encoding by name
+ * @param char *  : the encoding name (text, jsonl, nul, binary)
+ * @return int    : the output_mode_t, -1 otherwise
+ */
+int get_output_mode(const char *);
+
+/**
+ * Append the record of an event to the buffer of the standard output
+ * The root, the cookie, the old path and the count are the ones of the event
+ * being executed (event_root, event_cookie, event_old_path and coalesce_c).
+ * @param char * : the event name
+ * @param char * : the name of the file or directory that triggered the event
+ * @param char * : the path in which the event was triggered
+ * @return int   : -1 in case of error, 0 otherwise
+ */
+int output_event(char *, char *, char *);
+
+/**
+ * Write the records buffered, once the events read are dispatched:
+ * with --output-flush they are written by a timer instead
+ * @return int : -1 in case of error, 0 otherwise
+ */
+int output_end_batch();
+
+/**
+ * Write the records buffered to the standard output at once
+ * @return int : -1 in case of error, 0 otherwise
+ */
+int output_flush();
+
+#endif /* !__OUTPUT_H */
@@ -0,0 +1,267 @@
+/* reader.c
+ * The reader thread: the events of the kernel queue are read into a ring
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "cwatch.h"
+
+#include <stdint.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+/*
+ * The ring: the reader fills the chunk at head and publishes it
+ * incrementing head, the dispatcher (the main thread) handles the chunk
+ * at tail and gives it back incrementing tail. Each counter is written
+ * by a single thread.
+ */
+static char *ring;
+static size_t chunk_len;
+static size_t lens[READER_CHUNKS];
+static uint64_t times[READER_CHUNKS];
+static size_t head;
+static size_t tail;
+
+static pthread_t reader;
+static int running;
+static int stopping;
+static int failure;               /* the errno of the reader, when it stopped by itself */
+static int waiting;               /* 1 when the reader waits on space_fd */
+static int source_fd = -1;        /* the inotify file descriptor */
+static int ready_fd = -1;         /* readable when there are chunks to dispatch */
+static int space_fd = -1;         /* wakes the reader up, a chunk is free or it has to stop */
+
+static READER_STATS stats;
+
+static void reader_signal(int signal_fd)
+{
+    uint64_t value = 1;
+
+    if (write(signal_fd, &value, sizeof(value)) == -1) {
+        /* The counter is saturated, the other side is awake anyway */
+    }
+}
+
+/* Wait for a free chunk, returns -1 if the reader has to stop */
+static int reader_wait_space()
+{
+    struct pollfd space = {space_fd, POLLIN, 0};
+    uint64_t value;
+
+    __atomic_add_fetch(&stats.stalls, 1, __ATOMIC_RELAXED);
+
+    for (;;) {
+        /* Checked again once waiting is set, the dispatcher could have missed it */
+        __atomic_store_n(&waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&stopping, __ATOMIC_SEQ_CST))
+            return -1;
+        if (head - __atomic_load_n(&tail, __ATOMIC_SEQ_CST) < READER_CHUNKS) {
+            __atomic_store_n(&waiting, 0, __ATOMIC_SEQ_CST);
+            return 0;
+        }
+
+        if (poll(&space, 1, -1) == -1 && errno != EINTR)
+            return -1;
+        if (read(space_fd, &value, sizeof(value)) == -1) {
+            /* Another wake up consumed it, the ring is checked again */
+        }
+    }
+}
+
+static void *reader_thread(void *arg)
+{
+    struct pollfd fds[2];
+    uint64_t value;
+
+    fds[0].fd = source_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = space_fd;
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        if (__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+            break;
+
+        size_t used = head - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        if (used == READER_CHUNKS) {
+            if (reader_wait_space() == -1)
+                break;
+            used = head - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        }
+
+        /* Read until the kernel queue is empty, then wait for it */
+        size_t slot = head & (READER_CHUNKS - 1);
+        ssize_t len = read(source_fd, ring + slot * chunk_len, chunk_len);
+
+        if (len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (poll(fds, 2, -1) == -1 && errno != EINTR) {
+                __atomic_store_n(&failure, errno, __ATOMIC_SEQ_CST);
+                break;
+            }
+            if (fds[1].revents & POLLIN) {
+                if (read(space_fd, &value, sizeof(value)) == -1) {
+                    /* Only a wake up, to check stopping */
+                }
+            }
+            continue;
+        }
+
+        if (len == -1) {
+            if (errno == EINTR)
+                continue;
+
+            __atomic_store_n(&failure, errno ? errno : EIO, __ATOMIC_SEQ_CST);
+            break;
+        }
+
+        lens[slot] = (size_t) len;
+        times[slot] = metrics_now();
+        __atomic_add_fetch(&stats.reads, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stats.bytes, (unsigned long) len, __ATOMIC_RELAXED);
+        if (used + 1 > __atomic_load_n(&stats.high_water, __ATOMIC_RELAXED))
+            __atomic_store_n(&stats.high_water, (unsigned int) (used + 1), __ATOMIC_RELAXED);
+
+        /* The dispatcher is only woken up when it could have seen the ring empty */
+        __atomic_store_n(&head, head + 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&tail, __ATOMIC_SEQ_CST) == head - 1)
+            reader_signal(ready_fd);
+    }
+
+    /* The dispatcher finds out the failure (see reader_error) */
+    if (__atomic_load_n(&failure, __ATOMIC_SEQ_CST) != 0)
+        reader_signal(ready_fd);
+
+    return NULL;
+}
+
+int reader_start(int inotify_fd, size_t len)
+{
+    if (running)
+        return ready_fd;
+
+    ring = (char *) malloc(READER_CHUNKS * len);
+    if (ring == NULL)
+        return -1;
+
+    ready_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    space_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ready_fd == -1 || space_fd == -1) {
+        if (ready_fd != -1)
+            close(ready_fd);
+        if (space_fd != -1)
+            close(space_fd);
+        free(ring);
+        ring = NULL;
+        return -1;
+    }
+
+    source_fd = inotify_fd;
+    chunk_len = len;
+    head = tail = 0;
+    memset(&stats, 0, sizeof(stats));
+    stats.chunks = READER_CHUNKS;
+
+    /* The signals are handled by the main thread only (see loop_add_signal) */
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    int result = pthread_create(&reader, NULL, reader_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (result != 0) {
+        close(ready_fd);
+        close(space_fd);
+        free(ring);
+        ring = NULL;
+        return -1;
+    }
+
+    __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+
+    return ready_fd;
+}
+
+char *reader_next(size_t *len, uint64_t *read_at)
+{
+    if (__atomic_load_n(&head, __ATOMIC_SEQ_CST) == tail)
+        return NULL;
+
+    size_t slot = tail & (READER_CHUNKS - 1);
+    *len = lens[slot];
+    *read_at = times[slot];
+
+    return ring + slot * chunk_len;
+}
+
+void reader_release()
+{
+    __atomic_store_n(&tail, tail + 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_exchange_n(&waiting, 0, __ATOMIC_SEQ_CST) == 1)
+        reader_signal(space_fd);
+}
+
+void reader_clear()
+{
+    uint64_t value;
+
+    if (read(ready_fd, &value, sizeof(value)) == -1) {
+        /* Not readable, there was nothing to clear */
+    }
+}
+
+void reader_wakeup()
+{
+    reader_signal(ready_fd);
+}
+
+void reader_stop()
+{
+    if (__atomic_exchange_n(&running, 0, __ATOMIC_ACQ_REL) == 0)
+        return;
+
+    __atomic_store_n(&stopping, 1, __ATOMIC_SEQ_CST);
+    reader_signal(space_fd);
+
+    pthread_join(reader, NULL);
+    close(space_fd);
+}
+
+int reader_error()
+{
+    return __atomic_load_n(&failure, __ATOMIC_SEQ_CST);
+}
+
+int reader_stats(READER_STATS *copy)
+{
+    if (ring == NULL)
+        return -1;
+
+    copy->reads = __atomic_load_n(&stats.reads, __ATOMIC_RELAXED);
+    copy->bytes = __atomic_load_n(&stats.bytes, __ATOMIC_RELAXED);
+    copy->stalls = __atomic_load_n(&stats.stalls, __ATOMIC_RELAXED);
+    copy->high_water = __atomic_load_n(&stats.high_water, __ATOMIC_RELAXED);
+    copy->chunks = stats.chunks;
+
+    return 0;
+}
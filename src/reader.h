@@ -0,0 +1,99 @@
+/* reader.h
+ * The reader thread: the events of the kernel queue are read into a ring
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __READER_H
+#define __READER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define READER_CHUNKS 64    /* the chunks of the ring, a power of two, each one of the size of the read buffer */
+
+/*
+ * The statistics of the ring, the reader waits for the dispatcher
+ * only when all the chunks are in use (backpressure)
+ */
+typedef struct reader_stats_s
+{
+    unsigned long reads;        /* the chunks read from the kernel queue */
+    unsigned long bytes;        /* the bytes read */
+    unsigned long stalls;       /* the times the reader waited for a free chunk */
+    unsigned int  high_water;   /* the most chunks in use at once */
+    unsigned int  chunks;       /* the chunks of the ring */
+} READER_STATS;
+
+/**
+ * Start the thread that reads the events of the kernel queue into a
+ * single producer, single consumer ring. The signals are blocked in
+ * the thread, they are handled by the main thread (see loop_add_signal).
+ * @param int    : the file descriptor of the inotify backend
+ * @param size_t : the size of a chunk (see --read-buffer)
+ * @return int   : the file descriptor readable when there are chunks to
+ *                 dispatch (an eventfd), -1 in case of error
+ */
+int reader_start(int, size_t);
+
+/**
+ * The oldest chunk read, it is valid until reader_release()
+ * @param size_t *   : filled with the length of the chunk
+ * @param uint64_t * : filled with the time it was read (see metrics_now)
+ * @return char *    : the inotify_event records, NULL if the ring is empty
+ */
+char *reader_next(size_t *, uint64_t *);
+
+/**
+ * Give back the chunk returned by reader_next() to the reader
+ */
+void reader_release();
+
+/**
+ * Clear the readiness of the file descriptor, before the chunks are dispatched
+ */
+void reader_clear();
+
+/**
+ * Make the file descriptor readable again, the chunks left are
+ * dispatched by the next turn of the event loop
+ */
+void reader_wakeup();
+
+/**
+ * Stop the thread, the chunks already read are left in the ring
+ */
+void reader_stop();
+
+/**
+ * The error that stopped the reader, once the chunks left are dispatched
+ * @return int : the errno of the failed read, 0 if the reader did not fail
+ */
+int reader_error();
+
+/**
+ * The statistics of the ring
+ * @param READER_STATS * : filled with the statistics
+ * @return int           : -1 if the reader is not started, 0 otherwise
+ */
+int reader_stats(READER_STATS *);
+
+#endif /* !__READER_H */
@@ -0,0 +1,196 @@
+/* resync.c
+ * Resynchronization of the watched directories after lost events
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "cwatch.h"
+
+/* Read a changed directory again, and handle the events lost */
+static void resync_directory(const char *path, bstring events)
+{
+    /* It could be unwatched by the events of its parent */
+    LIST_NODE *node = get_node_from_path(path);
+    if (node == NULL)
+        return;
+
+    /* If it is gone, the delete event is synthesized by its parent */
+    DIR *dir_stream = opendir(path);
+    if (dir_stream == NULL)
+        return;
+
+    WD_DATA *wd_data = (WD_DATA *) node->data;
+    struct timespec synced = wd_data->synced;
+
+    /* The next changes will be compared with the directory as it is now */
+    snapshot_wd_data(wd_data, path);
+
+    int dir_fd = dirfd(dir_stream);
+    size_t path_len = strlen(path);
+    char child_path[MAXPATHLEN + NAME_MAX + 2];
+    HASH *subdirs = hash_init(hash_string, hash_string_compare);
+    LIST *names = list_init();
+    struct dirent *dir;
+    struct statx stx;
+
+    btrunc(events, 0);
+
+    while ((dir = readdir(dir_stream))) {
+        if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0)
+            continue;
+
+        if (statx(dir_fd, dir->d_name, AT_SYMLINK_NOFOLLOW,
+                  STATX_TYPE | STATX_INO | STATX_MTIME | STATX_CTIME | STATX_BTIME, &stx) != 0)
+            continue;
+
+        struct timespec created = statx_created(&stx);
+        struct timespec modified = statx_time(&stx.stx_mtime);
+
+        snprintf(child_path, sizeof(child_path), "%.*s%s%s",
+                 (int) path_len, path, dir->d_name, S_ISDIR(stx.stx_mode) ? "/" : "");
+
+        if (S_ISDIR(stx.stx_mode)) {
+            /* Discard all filename that matches regular expression (-x option) */
+            if (excluded(dir->d_name) || rule_excludes(wd_data->rule, dir->d_name))
+                continue;
+
+            char *name = strdup(dir->d_name);
+            list_push(names, (void *) name);
+            hash_put(subdirs, name, (void *) name);
+
+            if (recursive_flag == FALSE)
+                continue;
+
+            LIST_NODE *child = get_node_from_path(child_path);
+
+            /* A watched directory replaced by another one */
+            if (child != NULL && ((WD_DATA *) child->data)->ino != stx.stx_ino) {
+                append_event(events, wd_data->wd, IN_DELETE | IN_ISDIR, dir->d_name);
+                child = NULL;
+            }
+
+            /* With a budget, the old ones are left to the expansion and to the sweeps */
+            if (child == NULL && (budget_enabled() == 0 || timespec_compare(&created, &synced) > 0))
+                append_event(events, wd_data->wd, IN_CREATE | IN_ISDIR, dir->d_name);
+        } else {
+
+            if (S_ISLNK(stx.stx_mode) && get_link_data_from_path(child_path) != NULL)
+                continue;
+
+            if (timespec_compare(&created, &synced) > 0)
+                append_event(events, wd_data->wd, IN_CREATE, dir->d_name);
+            else if (S_ISREG(stx.stx_mode) && timespec_compare(&modified, &synced) > 0)
+                append_event(events, wd_data->wd, IN_MODIFY, dir->d_name);
+        }
+    }
+
+    /* The watched subdirectories that are gone */
+    TRIE_NODE *trie_node = trie_find(wd_tree, path);
+    if (trie_node != NULL && trie_node->children != NULL) {
+        HASH_ENTRY *entry = NULL;
+        while ((entry = hash_next(trie_node->children, entry)) != NULL) {
+            TRIE_NODE *child = (TRIE_NODE *) entry->data;
+            if (child->data != NULL && hash_get(subdirs, child->name) == NULL)
+                append_event(events, wd_data->wd, IN_DELETE | IN_ISDIR, child->name);
+        }
+    }
+
+    /* The symbolic links of this directory that are gone */
+    if (nosymlink_flag == FALSE) {
+        HASH_ENTRY *entry = NULL;
+        while ((entry = hash_next(link_index, entry)) != NULL) {
+            const char *link_path = (const char *) entry->key;
+            struct stat st;
+
+            if (strncmp(link_path, path, path_len) == 0
+                && strchr(link_path + path_len, '/') == NULL
+                && fstatat(dir_fd, link_path + path_len, &st, AT_SYMLINK_NOFOLLOW) != 0)
+            {
+                append_event(events, wd_data->wd, IN_DELETE, link_path + path_len);
+            }
+        }
+    }
+
+    closedir(dir_stream);
+
+    char *name;
+    while ((name = (char *) list_pop(names)) != NULL)
+        free(name);
+    list_free(names);
+    hash_free(subdirs);
+
+    if (blength(events) > 0)
+        dispatch_events((char *) events->data, blength(events));
+}
+
+void resync_watched(const char *path)
+{
+    bstring events = bfromcstralloc(4096, "");
+
+    resync_directory(path, events);
+    bdestroy(events);
+}
+
+int resync()
+{
+    LIST *changed = list_init();
+    LIST_NODE *node;
+    struct stat st;
+    char wd_path[MAXPATHLEN + 1];
+    unsigned int watched_c = 0;
+    int changed_c = 0;
+
+    resync_pending = FALSE;
+
+    /* The directories are only read again if they changed since their snapshot */
+    for (node = list_wd->first; node != NULL; node = node->next) {
+        WD_DATA *wd_data = (WD_DATA *) node->data;
+        ++watched_c;
+
+        if (stat(get_wd_path(wd_data, wd_path), &st) != 0)
+            continue;
+
+        if (st.st_ino != wd_data->ino
+            || st.st_nlink != wd_data->nlink
+            || st.st_mtim.tv_sec != wd_data->mtime.tv_sec
+            || st.st_mtim.tv_nsec != wd_data->mtime.tv_nsec)
+        {
+            list_push(changed, (void *) strdup(wd_path));
+        }
+    }
+
+    /* The events handled will change the watch list */
+    bstring events = bfromcstralloc(4096, "");
+    char *path;
+
+    while ((path = (char *) list_pop(changed)) != NULL) {
+        resync_directory(path, events);
+        free(path);
+        ++changed_c;
+    }
+
+    bdestroy(events);
+    list_free(changed);
+
+    log_message("RESYNC COMPLETED:\t%d of %u directories changed", changed_c, watched_c);
+
+    return changed_c;
+}
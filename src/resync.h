@@ -0,0 +1,50 @@
+/* resync.h
+ * Resynchronization of the watched directories after lost events
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __RESYNC_H
+#define __RESYNC_H
+
+/**
+ * Resynchronize the watched directories with the filesystem
+ *
+ * Called when the kernel queue overflowed (IN_Q_OVERFLOW). Every watched
+ * directory is compared with its snapshot (see snapshot_wd_data), only
+ * the changed ones are read again. The events lost in the meantime are
+ * synthesized and handled as the other ones (see dispatch_events):
+ *  - create for the new subdirectories, files and symbolic links
+ *  - modify for the files modified after the snapshot
+ *  - delete for the watched subdirectories and symbolic links that are gone
+ * The files deleted can not be known, as they are not stored.
+ * @return int : the number of directories read again
+ */
+int resync();
+
+/**
+ * Read a watched directory again, as resync() does for the changed ones:
+ * the changes made after its snapshot (synced) are handled as events
+ * @param char * : the path of the watched directory
+ */
+void resync_watched(const char *);
+
+#endif /* !__RESYNC_H */
@@ -0,0 +1,149 @@
+/* rules.c
+ * The event masks and the patterns of the subtrees (--rules option)
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "cwatch.h"
+
+/* The rules by directory */
+static TRIE_NODE *rules_tree;
+
+/* Parse a rule, -1 if it is not valid */
+static int parse_rule(char *line)
+{
+    char *save = NULL;
+    char *directory = strtok_r(line, " \t", &save);
+    char *events = strtok_r(NULL, " \t", &save);
+
+    if (directory == NULL || events == NULL || directory[0] != '/')
+        return -1;
+
+    RULE *rule = (RULE *) calloc(1, sizeof(RULE));
+    if (rule == NULL)
+        return -1;
+
+    /* The watched directories are stored by real path */
+    rule->path = resolve_real_path(directory);
+    if (rule->path == NULL) {
+        size_t len = strlen(directory);
+        rule->path = (char *) malloc(len + 2);
+        strcpy(rule->path, directory);
+        if (directory[len - 1] != '/')
+            strcat(rule->path, "/");
+    }
+
+    if (strcmp(events, "skip") == 0)
+        rule->skip = 1;
+    else if (strcmp(events, "-") != 0 && (rule->mask = parse_events(events)) == 0)
+        return -1;
+
+    char *pattern;
+    while ((pattern = strtok_r(NULL, " \t", &save)) != NULL) {
+        if (rule->exclude == NULL)
+            rule->exclude = exclude_init();
+        if (exclude_add_glob(rule->exclude, pattern) == -1)
+            return -1;
+    }
+
+    if (rule->exclude != NULL && exclude_compile(rule->exclude) == -1)
+        return -1;
+
+    trie_insert(rules_tree, rule->path, (void *) rule);
+
+    return 0;
+}
+
+int rules_load(const char *file)
+{
+    FILE *rules_file = fopen(file, "r");
+    if (rules_file == NULL)
+        return -1;
+
+    if (rules_tree == NULL)
+        rules_tree = trie_init();
+
+    char line[MAXPATHLEN + 1024];
+    int number = 0, result = 0;
+
+    while (result == 0 && fgets(line, sizeof(line), rules_file) != NULL) {
+        ++number;
+
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char *c = line + strspn(line, " \t");
+        if (*c == '\0' || *c == '#')
+            continue;
+
+        if (parse_rule(c) == -1)
+            result = number;
+    }
+
+    fclose(rules_file);
+
+    return result;
+}
+
+RULE *get_rule(const char *path)
+{
+    if (rules_tree == NULL)
+        return NULL;
+
+    TRIE_NODE *trie_node = trie_find_prefix(rules_tree, path);
+
+    return (trie_node != NULL) ? (RULE *) trie_node->data : NULL;
+}
+
+/* Collect the mask of a rule (see trie_walk) */
+static int collect_mask(TRIE_NODE *trie_node, void *mask)
+{
+    RULE *rule = (RULE *) trie_node->data;
+    if (rule != NULL)
+        *(uint32_t *) mask |= rule->mask;
+
+    return 0;
+}
+
+uint32_t rules_subtree_mask(const char *path)
+{
+    uint32_t mask = 0;
+
+    if (rules_tree == NULL)
+        return 0;
+
+    TRIE_NODE *trie_node = trie_find(rules_tree, path);
+    if (trie_node != NULL)
+        trie_walk(trie_node, collect_mask, (void *) &mask);
+
+    return mask;
+}
+
+int rule_skips(const char *path)
+{
+    RULE *rule = get_rule(path);
+
+    return (rule != NULL && rule->skip == 1) ? 1 : 0;
+}
+
+int rule_excludes(const RULE *rule, const char *name)
+{
+    return (rule != NULL) ? exclude_match(rule->exclude, name) : 0;
+}
@@ -0,0 +1,90 @@
+/* rules.h
+ * The event masks and the patterns of the subtrees (--rules option)
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __RULES_H
+#define __RULES_H
+
+#include <stdint.h>
+
+/*
+ * Used to describe the rule of a subtree
+ * The deepest rule containing a directory applies to it, the rules
+ * of its ancestors do not (they are not merged).
+ */
+typedef struct rule_s
+{
+    char     *path;       /* the directory, with the ending slash */
+    int      skip;        /* 1 if the subtree is not watched */
+    uint32_t mask;        /* the events of the subtree, 0 for the ones of -e option */
+    EXCLUDE  *exclude;    /* the names excluded in the subtree, NULL if there is none */
+} RULE;
+
+/**
+ * Load the rules from a file
+ *
+ * Each line is a rule made of a directory, the events
+ * (as given to -e, "skip" to not watch the subtree or "-" for
+ * the ones of -e option) and the patterns of the names to exclude
+ * (see --exclude-glob), separated by whitespaces:
+ *   /var/log/       create,delete
+ *   /srv/www/cache/ skip
+ *   /srv/www/       -              *.swp *~ .git
+ * The empty lines and the ones starting with # are skipped.
+ * @param char * : the path of the rules file
+ * @return int   : 0, the number of the first line that is not valid,
+ *                 -1 if the file can not be read
+ */
+int rules_load(const char *);
+
+/**
+ * Search the rule of a directory (the deepest one containing it)
+ * @param char *  : the real path of the directory
+ * @return RULE * : the rule, NULL if there is none
+ */
+RULE *get_rule(const char *);
+
+/**
+ * Returns the events of the rules of the subdirectories of a directory
+ * (the ones that could be watched below it)
+ * @param char *    : the real path of the directory
+ * @return uint32_t : the union of their masks, 0 if there is none
+ */
+uint32_t rules_subtree_mask(const char *);
+
+/**
+ * Returns 1 if a directory is not watched, as its rule is "skip"
+ * @param char * : the real path of the directory
+ * @return int
+ */
+int rule_skips(const char *);
+
+/**
+ * Checks whetever a name is excluded by the patterns of a rule
+ * @param RULE * : the rule, NULL if there is none
+ * @param char * : the name of a file or directory
+ * @return int   : 1 if the name is excluded, 0 otherwise
+ */
+int rule_excludes(const RULE *, const char *);
+
+#endif /* !__RULES_H */
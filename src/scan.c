@@ -0,0 +1,398 @@
+/* scan.c
+ * Parallel directory traversal used by the initial watch
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "cwatch.h"
+#include "scan.h"
+
+#define SCAN_BUF_LEN    (64 * 1024)
+
+/* Directory entry returned by getdents64 */
+struct linux_dirent64
+{
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+/*
+ * The work queue of a scan thread
+ * The owner takes the last item (depth first), the others steal the first one.
+ */
+typedef struct scan_queue_s
+{
+    pthread_mutex_t mutex;
+    LIST            *items;
+} SCAN_QUEUE;
+
+static SCAN_QUEUE *queues;         /* one queue for each scan thread */
+static unsigned int queues_qty;
+
+/* The state shared by the scan threads and the registration (calling) thread */
+static pthread_mutex_t state_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;   /* an item is queued or the scan is over */
+static pthread_cond_t result_cond = PTHREAD_COND_INITIALIZER; /* a result is ready or there is no more pending item */
+static unsigned long queued;       /* number of items in the queues */
+static unsigned long pending;      /* number of items queued or being traversed */
+static bool_t done;                /* the scan is over */
+static LIST *results;              /* the directories found, waiting to be watched */
+
+static void push_item(unsigned int index, char *path, int dir_fd, int wd)
+{
+    SCAN_ITEM *item = (SCAN_ITEM *) malloc(sizeof(SCAN_ITEM));
+    item->path = path;
+    item->fd = dir_fd;
+    item->wd = wd;
+
+    /* Counted before it is visible: a thread could steal it and finish it first */
+    pthread_mutex_lock(&state_mutex);
+    ++queued;
+    ++pending;
+    pthread_mutex_unlock(&state_mutex);
+
+    pthread_mutex_lock(&queues[index].mutex);
+    list_push(queues[index].items, (void *) item);
+    pthread_mutex_unlock(&queues[index].mutex);
+
+    pthread_mutex_lock(&state_mutex);
+    pthread_cond_signal(&work_cond);
+    pthread_mutex_unlock(&state_mutex);
+}
+
+static SCAN_ITEM *take_item(unsigned int index)
+{
+    SCAN_ITEM *item = NULL;
+    unsigned int i;
+
+    /* Own queue first, then steal from the other ones */
+    for (i = 0; i < queues_qty && item == NULL; ++i) {
+        SCAN_QUEUE *queue = &queues[(index + i) % queues_qty];
+
+        pthread_mutex_lock(&queue->mutex);
+        /* The last node is only meaningful when the list is not empty */
+        if (queue->items->first != NULL) {
+            LIST_NODE *node = (i == 0) ? queue->items->last : queue->items->first;
+            item = (SCAN_ITEM *) node->data;
+            list_remove(queue->items, node);
+        }
+        pthread_mutex_unlock(&queue->mutex);
+    }
+
+    if (item != NULL) {
+        pthread_mutex_lock(&state_mutex);
+        --queued;
+        pthread_mutex_unlock(&state_mutex);
+    }
+
+    return item;
+}
+
+static char *join_path(const char *parent, const char *name, bool_t is_dir)
+{
+    size_t parent_len = strlen(parent);
+    size_t name_len = strlen(name);
+    char *path = (char *) malloc(parent_len + name_len + 2);
+
+    memcpy(path, parent, parent_len);
+    memcpy(path + parent_len, name, name_len);
+    if (is_dir) {
+        path[parent_len + name_len] = '/';
+        path[parent_len + name_len + 1] = '\0';
+    } else {
+        path[parent_len + name_len] = '\0';
+    }
+
+    return path;
+}
+
+static void push_result(LIST *list, char *path, char *symlink, int wd)
+{
+    SCAN_RESULT *result = (SCAN_RESULT *) malloc(sizeof(SCAN_RESULT));
+    result->path = path;
+    result->symlink = symlink;
+    result->wd = wd;
+
+    list_push(list, (void *) result);
+}
+
+/* Watch and traverse a directory, it is reported in found and its subdirectories are queued */
+static void scan_directory(unsigned int index, SCAN_ITEM *item, char *buffer, LIST *found)
+{
+    /* The rules are not modified once loaded, they can be read by every thread */
+    RULE *rule = get_rule(item->path);
+
+    /*
+     * Watched before it is listed: a subdirectory created after the listing is
+     * reported by an event. Not watched, it is added again by the registration.
+     */
+    if (item->wd == -1) {
+        uint32_t mask = (rule != NULL && rule->mask != 0) ? rule->mask : event_mask;
+        item->wd = backend->add_watch(item->path, mask);
+        push_result(found, strdup(item->path), NULL, item->wd);
+
+        if (item->wd == -1) {
+            if (item->fd != -1)
+                close(item->fd);
+            return;
+        }
+    }
+
+    int dir_fd = (item->fd != -1) ? item->fd : open(item->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (dir_fd == -1) {
+        log_message("UNABLE TO OPEN DIRECTORY:\t\"%s\" -> %d", item->path, errno);
+        return;
+    }
+
+    long n;
+    while ((n = syscall(SYS_getdents64, dir_fd, buffer, SCAN_BUF_LEN)) > 0) {
+        long offset;
+        for (offset = 0; offset < n; ) {
+            struct linux_dirent64 *entry = (struct linux_dirent64 *) (buffer + offset);
+            unsigned char type = entry->d_type;
+            struct stat st;
+
+            offset += entry->d_reclen;
+
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                continue;
+
+            /* Some filesystems do not fill the type of the entries */
+            if (type == DT_UNKNOWN && fstatat(dir_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+                if (S_ISDIR(st.st_mode))
+                    type = DT_DIR;
+                else if (S_ISLNK(st.st_mode))
+                    type = DT_LNK;
+            }
+
+            if (type == DT_DIR) {
+                /* Discard all filename that matches regular expression (-x option) */
+                if (excluded(entry->d_name) || rule_excludes(rule, entry->d_name))
+                    continue;
+
+                char *path = join_path(item->path, entry->d_name, TRUE);
+
+                /* The subtree is not watched at all (--rules option) */
+                if (rule_skips(path)) {
+                    free(path);
+                    continue;
+                }
+
+                /* Continue directory traversing, relative to this one */
+                int child_fd = openat(dir_fd, entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+                push_item(index, path, child_fd, -1);
+            } else if (type == DT_LNK && nosymlink_flag == FALSE) {
+                /* Only the symbolic links to a directory are watched */
+                if (fstatat(dir_fd, entry->d_name, &st, 0) != 0 || !S_ISDIR(st.st_mode))
+                    continue;
+
+                char *symlink = join_path(item->path, entry->d_name, FALSE);
+                char *real_path = resolve_real_path(symlink);
+
+                if (real_path != NULL)
+                    push_result(found, real_path, symlink, -1);
+                else
+                    free(symlink);
+            }
+        }
+    }
+
+    close(dir_fd);
+}
+
+static void *scan_thread(void *arg)
+{
+    unsigned int index = (unsigned int) (uintptr_t) arg;
+    char *buffer = (char *) malloc(SCAN_BUF_LEN);
+    LIST *found = list_init();
+
+    while (1) {
+        SCAN_ITEM *item = take_item(index);
+
+        if (item == NULL) {
+            /* Wait for new items, or for the end of the scan */
+            pthread_mutex_lock(&state_mutex);
+            while (queued == 0 && done == FALSE)
+                pthread_cond_wait(&work_cond, &state_mutex);
+            bool_t over = done;
+            pthread_mutex_unlock(&state_mutex);
+
+            if (over == TRUE)
+                break;
+            continue;
+        }
+
+        scan_directory(index, item, buffer, found);
+        free(item->path);
+        free(item);
+
+        /* Hand the directories found to the registration thread */
+        pthread_mutex_lock(&state_mutex);
+        void *result;
+        while ((result = list_pop(found)) != NULL)
+            list_push(results, result);
+        --pending;
+        pthread_cond_signal(&result_cond);
+        pthread_mutex_unlock(&state_mutex);
+    }
+
+    list_free(found);
+    free(buffer);
+
+    return NULL;
+}
+
+/* Add a directory found by the scan threads to the watch list */
+static void register_result(SCAN_RESULT *result, unsigned int *next_queue)
+{
+    if (result->symlink == NULL) {
+        if (result->wd != -1) {
+            add_watched_to_watch_list(result->path, result->wd);
+            free(result->path);
+            return;
+        }
+
+        /* It could not be watched by the scan thread (the error is reported), nor listed */
+        LIST_NODE *node = add_to_watch_list(result->path, NULL);
+        if (node == NULL) {
+            free(result->path);
+        } else {
+            push_item(*next_queue, result->path, -1, ((WD_DATA *) node->data)->wd);
+            *next_queue = (*next_queue + 1) % queues_qty;
+        }
+        return;
+    }
+
+    /* Check if the symbolic link is already watched */
+    if (get_link_data_from_path(result->symlink) != NULL) {
+        free(result->symlink);
+        free(result->path);
+        return;
+    }
+
+    bool_t traversed = (get_node_from_path(result->path) != NULL) ? TRUE : FALSE;
+
+    LIST_NODE *node = add_to_watch_list(result->path, result->symlink);
+
+    /* The directory pointed by the symbolic link is traversed only once */
+    if (traversed == TRUE || node == NULL) {
+        free(result->path);
+    } else {
+        push_item(*next_queue, result->path, -1, ((WD_DATA *) node->data)->wd);
+        *next_queue = (*next_queue + 1) % queues_qty;
+    }
+}
+
+int parallel_watch(char **real_paths, unsigned int paths_qty, unsigned int threads_qty)
+{
+    unsigned int i, next_queue = 0;
+
+    /* Add initial paths to the watch list */
+    int *wds = (int *) malloc(paths_qty * sizeof(int));
+    for (i = 0; i < paths_qty; ++i) {
+        LIST_NODE *node = add_to_watch_list(real_paths[i], NULL);
+        if (node == NULL) {
+            free(wds);
+            return -1;
+        }
+        wds[i] = ((WD_DATA *) node->data)->wd;
+    }
+
+    pthread_t *threads = (pthread_t *) malloc(threads_qty * sizeof(pthread_t));
+
+    queues_qty = threads_qty;
+    queues = (SCAN_QUEUE *) malloc(queues_qty * sizeof(SCAN_QUEUE));
+    for (i = 0; i < queues_qty; ++i) {
+        pthread_mutex_init(&queues[i].mutex, NULL);
+        queues[i].items = list_init();
+    }
+
+    results = list_init();
+    queued = pending = 0;
+    done = FALSE;
+
+    /* Each root starts in its own queue */
+    for (i = 0; i < paths_qty; ++i)
+        push_item(i % queues_qty, strdup(real_paths[i]), -1, wds[i]);
+    free(wds);
+
+    for (i = 0; i < threads_qty; ++i) {
+        if (pthread_create(&threads[i], NULL, scan_thread, (void *) (uintptr_t) i) != 0) {
+            printf("ERROR: UNABLE TO START THE SCAN THREADS!\n");
+            exit(1);
+        }
+    }
+
+    /* Registration stage: the watch list is only modified by this thread */
+    LIST *ready = list_init();
+
+    pthread_mutex_lock(&state_mutex);
+    while (1) {
+        while (results->first == NULL && pending > 0)
+            pthread_cond_wait(&result_cond, &state_mutex);
+
+        if (results->first == NULL)
+            break;
+
+        /* Take all the results found so far */
+        LIST *swap = ready;
+        ready = results;
+        results = swap;
+        pthread_mutex_unlock(&state_mutex);
+
+        SCAN_RESULT *result;
+        while ((result = (SCAN_RESULT *) list_pop(ready)) != NULL) {
+            register_result(result, &next_queue);
+            free(result);
+        }
+
+        pthread_mutex_lock(&state_mutex);
+    }
+
+    done = TRUE;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&state_mutex);
+
+    for (i = 0; i < threads_qty; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (i = 0; i < queues_qty; ++i) {
+        pthread_mutex_destroy(&queues[i].mutex);
+        list_free(queues[i].items);
+    }
+    free(queues);
+    free(threads);
+    list_free(results);
+    list_free(ready);
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+/* scan.h
+ * Parallel directory traversal used by the initial watch
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __SCAN_H
+#define __SCAN_H
+
+/* Used to store a directory waiting to be traversed */
+typedef struct scan_item_s
+{
+    char *path;           /* absolute real path of the directory (with the ending slash) */
+    int  fd;              /* the directory opened by its parent, -1 if not opened yet */
+    int  wd;              /* its watch descriptor, -1 if it is not watched yet */
+} SCAN_ITEM;
+
+/* Used to store a directory found by a scan thread */
+typedef struct scan_result_s
+{
+    char *path;           /* absolute real path of the directory */
+    char *symlink;        /* the symbolic link that point to the path, NULL otherwise */
+    int  wd;              /* the watch descriptor of a directory, -1 if it could not be watched */
+} SCAN_RESULT;
+
+/**
+ * Watch some directories using a pool of threads
+ *
+ * The threads watch and traverse the directories with openat()/getdents64(),
+ * stealing work from each other, while the calling thread adds the
+ * directories they watch to the watch list (see add_watched_to_watch_list).
+ * A directory is watched before it is listed, so that a subdirectory
+ * created meanwhile is either listed or reported by an event.
+ * Directories pointed by symbolic links are traversed only the
+ * first time they are found.
+ * @param char **      : The real paths of the directories to watch
+ * @param unsigned int : The number of directories
+ * @param unsigned int : The number of threads
+ * @return int         : -1 (An error occurred), 0 (Resources added correctly)
+ */
+int parallel_watch(char **, unsigned int, unsigned int);
+
+#endif /* !__SCAN_H */
@@ -0,0 +1,102 @@
+/* slab.c
+ * A fixed size objects allocator, objects are carved from large chunks
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdlib.h>
+
+#include "slab.h"
+
+/* The alignment of the objects (and of the chunks header) */
+#define SLAB_ALIGN (2 * sizeof(void *))
+
+SLAB *slab_init(size_t size, size_t per_chunk)
+{
+    SLAB *slab = malloc(sizeof(SLAB));
+    if (slab == NULL)
+        return NULL;
+
+    if (size < sizeof(void *))
+        size = sizeof(void *);
+
+    slab->size = (size + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+    slab->per_chunk = (per_chunk > 0) ? per_chunk : 1;
+    slab->chunks = slab->free_list = NULL;
+    slab->next = NULL;
+    slab->left = slab->count = 0;
+
+    return slab;
+}
+
+void *slab_alloc(SLAB *slab)
+{
+    void *object;
+
+    if (slab->free_list != NULL) {
+        object = slab->free_list;
+        slab->free_list = *(void **) object;
+    } else {
+        if (slab->left == 0) {
+            char *chunk = malloc(SLAB_ALIGN + slab->size * slab->per_chunk);
+            if (chunk == NULL)
+                return NULL;
+
+            *(void **) chunk = slab->chunks;
+            slab->chunks = chunk;
+            slab->next = chunk + SLAB_ALIGN;
+            slab->left = slab->per_chunk;
+        }
+
+        object = slab->next;
+        slab->next += slab->size;
+        --slab->left;
+    }
+
+    ++slab->count;
+
+    return object;
+}
+
+void slab_release(SLAB *slab, void *object)
+{
+    if (object == NULL)
+        return;
+
+    *(void **) object = slab->free_list;
+    slab->free_list = object;
+    --slab->count;
+}
+
+void slab_free(SLAB *slab)
+{
+    if (slab == NULL)
+        return;
+
+    void *chunk = slab->chunks;
+    while (chunk != NULL) {
+        void *next = *(void **) chunk;
+        free(chunk);
+        chunk = next;
+    }
+
+    free(slab);
+}
@@ -0,0 +1,74 @@
+/* slab.h
+ * A fixed size objects allocator, objects are carved from large chunks
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __SLAB_H
+#define __SLAB_H
+
+#include <stddef.h>
+
+/*
+ * Slab data structure
+ * The objects are carved from chunks of per_chunk objects, the ones
+ * released are kept in a free list (linked through their first bytes)
+ * and reused. The chunks are only deallocated by slab_free.
+ */
+typedef struct slab_s
+{
+    size_t size;          /* the size of an object, rounded up to SLAB_ALIGN */
+    size_t per_chunk;     /* the number of objects of each chunk */
+    void   *chunks;       /* the chunks allocated, linked through their first bytes */
+    void   *free_list;    /* the objects released */
+    char   *next;         /* the first object never used of the last chunk */
+    size_t left;          /* the objects never used of the last chunk */
+    size_t count;         /* the objects in use */
+} SLAB;
+
+/**
+ * Initialize slab data structure
+ * @param size_t  : the size of an object
+ * @param size_t  : the number of objects of each chunk
+ * @return SLAB * : a pointer to the new allocated slab, NULL otherwise
+ */
+SLAB *slab_init(size_t, size_t);
+
+/**
+ * Allocate an object (its content is not initialized)
+ * @param SLAB *  : a SLAB pointer
+ * @return void * : the object, NULL otherwise
+ */
+void *slab_alloc(SLAB *);
+
+/**
+ * Release an object, it will be returned by the next slab_alloc
+ * @param SLAB * : a SLAB pointer
+ * @param void * : the object
+ */
+void slab_release(SLAB *, void *);
+
+/**
+ * Deallocate slab data structure and all its objects
+ */
+void slab_free(SLAB *);
+
+#endif /* !__SLAB_H */
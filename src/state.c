@@ -0,0 +1,346 @@
+/* state.c
+ * The watch state saved on disk, for fast restarts
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "cwatch.h"
+
+#include <sys/mman.h>
+
+#define STATE_ALIGN(n)  (((n) + 7) & ~((size_t) 7))
+
+/* The directories and symbolic links saved, that are gone (directories with the ending slash) */
+static LIST *state_gone;
+static bool_t state_loaded;
+
+static size_t state_record_len(size_t path_len, size_t target_len)
+{
+    return sizeof(STATE_RECORD) + STATE_ALIGN(path_len + 1 + target_len + 1);
+}
+
+/* The root paths, one after the other NUL terminated, as saved in the header */
+static char *state_roots(size_t *roots_len)
+{
+    size_t len = 0;
+    unsigned int i;
+
+    for (i = 0; i < roots_qty; ++i)
+        len += strlen(root_paths[i]) + 1;
+
+    char *roots = (char *) malloc(len);
+    char *p = roots;
+    for (i = 0; i < roots_qty; ++i) {
+        size_t root_len = strlen(root_paths[i]) + 1;
+        memcpy(p, root_paths[i], root_len);
+        p += root_len;
+    }
+
+    *roots_len = len - 1;
+
+    return roots;
+}
+
+static uint16_t state_root_index(const char *root)
+{
+    unsigned int i;
+
+    for (i = 0; i < roots_qty; ++i) {
+        if (root_paths[i] == root)
+            return (uint16_t) i;
+    }
+
+    return 0;
+}
+
+static size_t state_put_record(char *buffer, uint8_t type, const char *path, const char *target, const WD_DATA *wd_data)
+{
+    STATE_RECORD *record = (STATE_RECORD *) buffer;
+    size_t path_len = strlen(path);
+    size_t target_len = (target != NULL) ? strlen(target) : 0;
+
+    record->type = type;
+    record->path_len = (uint16_t) path_len;
+    record->target_len = (uint16_t) target_len;
+    record->root = state_root_index(wd_data->root);
+    record->ino = (uint64_t) wd_data->ino;
+    record->nlink = (uint64_t) wd_data->nlink;
+    record->mtime_sec = (int64_t) wd_data->mtime.tv_sec;
+    record->mtime_nsec = (int64_t) wd_data->mtime.tv_nsec;
+    record->synced_sec = (int64_t) wd_data->synced.tv_sec;
+    record->synced_nsec = (int64_t) wd_data->synced.tv_nsec;
+
+    char *data = (char *) (record + 1);
+    memcpy(data, path, path_len + 1);
+    if (target != NULL)
+        memcpy(data + path_len + 1, target, target_len + 1);
+
+    return state_record_len(path_len, target_len);
+}
+
+int state_load(const char *file)
+{
+    int state_fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (state_fd == -1)
+        return -1;
+
+    struct stat st;
+    if (fstat(state_fd, &st) == -1 || (size_t) st.st_size < sizeof(STATE_HEADER)) {
+        close(state_fd);
+        return -1;
+    }
+
+    size_t size = (size_t) st.st_size;
+    char *map = (char *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, state_fd, 0);
+    close(state_fd);
+
+    if (map == MAP_FAILED)
+        return -1;
+
+    /* The state has to be saved for the same root paths */
+    const STATE_HEADER *header = (const STATE_HEADER *) map;
+    size_t offset = sizeof(STATE_HEADER) + STATE_ALIGN((size_t) header->root_len + 1);
+    size_t roots_len;
+    char *roots = state_roots(&roots_len);
+
+    if (memcmp(header->magic, STATE_MAGIC, sizeof(STATE_MAGIC)) != 0
+        || header->version != STATE_VERSION
+        || header->size != size
+        || offset > size
+        || header->root_len != roots_len
+        || memcmp(map + sizeof(STATE_HEADER), roots, roots_len + 1) != 0)
+    {
+        log_message("IGNORING THE STATE FILE:\t\"%s\"", file);
+        munmap(map, size);
+        free(roots);
+        return -1;
+    }
+    free(roots);
+
+    state_gone = list_init();
+    int restored = 0;
+    uint32_t i;
+
+    for (i = 0; i < header->records && offset + sizeof(STATE_RECORD) <= size; ++i) {
+        const STATE_RECORD *record = (const STATE_RECORD *) (map + offset);
+        size_t record_len = state_record_len(record->path_len, record->target_len);
+
+        if (offset + record_len > size)
+            break;
+        offset += record_len;
+
+        char *path = (char *) (record + 1);
+        char *target = path + record->path_len + 1;
+        struct stat path_st;
+
+        if (path[record->path_len] != '\0' || target[record->target_len] != '\0')
+            break;
+
+        if (record->type == STATE_DIRECTORY) {
+            if (stat(path, &path_st) != 0 || !S_ISDIR(path_st.st_mode)) {
+                list_push(state_gone, (void *) strdup(path));
+                continue;
+            }
+
+            LIST_NODE *node = add_to_watch_list(path, NULL);
+            if (node == NULL)
+                continue;
+
+            /* The snapshot saved, so that the changes made in the meantime are found */
+            WD_DATA *wd_data = (WD_DATA *) node->data;
+            if (record->root < roots_qty)
+                wd_data->root = root_paths[record->root];
+            wd_data->ino = (ino_t) record->ino;
+            wd_data->nlink = (nlink_t) record->nlink;
+            wd_data->mtime.tv_sec = (time_t) record->mtime_sec;
+            wd_data->mtime.tv_nsec = (long) record->mtime_nsec;
+            wd_data->synced.tv_sec = (time_t) record->synced_sec;
+            wd_data->synced.tv_nsec = (long) record->synced_nsec;
+
+            /* The subdirectories not saved are left to the expansion and to the sweeps */
+            if (budget_enabled())
+                wd_data->flags |= WD_FRONTIER;
+
+            ++restored;
+        } else if (record->type == STATE_LINK) {
+            /* Restored even if it is gone, so that the delete event can unwatch its target */
+            if (get_node_from_path(target) == NULL)
+                continue;
+
+            add_to_watch_list(target, strdup(path));
+
+            char *real_path = (lstat(path, &path_st) == 0) ? resolve_real_path(path) : NULL;
+            if (real_path == NULL || strcmp(real_path, target) != 0)
+                list_push(state_gone, (void *) strdup(path));
+            free(real_path);
+        }
+    }
+
+    munmap(map, size);
+
+    for (i = 0; i < roots_qty; ++i) {
+        if (get_node_from_path(root_paths[i]) == NULL)
+            return -1;
+    }
+
+    state_loaded = TRUE;
+    log_message("STATE RESTORED:\t%d directories from \"%s\"", restored, file);
+
+    return restored;
+}
+
+void state_replay()
+{
+    if (state_loaded == FALSE)
+        return;
+
+    state_loaded = FALSE;
+
+    /* The delete events, for the parents that are still watched */
+    bstring events = bfromcstralloc(1024, "");
+    char *path;
+
+    while ((path = (char *) list_pop(state_gone)) != NULL) {
+        size_t len = strlen(path);
+        uint32_t mask = IN_DELETE;
+
+        if (len > 1 && path[len - 1] == '/') {
+            path[--len] = '\0';
+            mask |= IN_ISDIR;
+        }
+
+        char *name = strrchr(path, '/');
+        if (name != NULL && name[1] != '\0') {
+            char c = name[1];
+            name[1] = '\0';
+            LIST_NODE *parent = get_node_from_path(path);
+            name[1] = c;
+
+            if (parent != NULL) {
+                append_event(events, ((WD_DATA *) parent->data)->wd, mask, name + 1);
+            }
+        }
+
+        free(path);
+    }
+
+    list_free(state_gone);
+    state_gone = NULL;
+
+    if (blength(events) > 0)
+        dispatch_events((char *) events->data, blength(events));
+    bdestroy(events);
+
+    /* The other changes are found comparing the snapshots */
+    resync();
+}
+
+int state_save(const char *file)
+{
+    size_t root_len;
+    char *roots = state_roots(&root_len);
+    size_t size = sizeof(STATE_HEADER) + STATE_ALIGN(root_len + 1);
+    uint32_t records = 0;
+    LIST_NODE *node, *link_node;
+    char path[MAXPATHLEN + 1];
+
+    for (node = list_wd->first; node != NULL; node = node->next) {
+        WD_DATA *wd_data = (WD_DATA *) node->data;
+        size_t path_len = strlen(get_wd_path(wd_data, path));
+
+        size += state_record_len(path_len, 0);
+        ++records;
+
+        if (wd_data->links == NULL)
+            continue;
+
+        for (link_node = wd_data->links->first; link_node != NULL; link_node = link_node->next) {
+            size += state_record_len(strlen(((LINK_DATA *) link_node->data)->path), path_len);
+            ++records;
+        }
+    }
+
+    /* Written aside, the state file is replaced at once */
+    char *tmp_file = (char *) malloc(strlen(file) + 5);
+    sprintf(tmp_file, "%s.tmp", file);
+
+    int state_fd = open(tmp_file, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (state_fd == -1 || ftruncate(state_fd, (off_t) size) == -1) {
+        if (state_fd != -1)
+            close(state_fd);
+        free(tmp_file);
+        free(roots);
+        return -1;
+    }
+
+    char *map = (char *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, state_fd, 0);
+    if (map == MAP_FAILED) {
+        close(state_fd);
+        unlink(tmp_file);
+        free(tmp_file);
+        free(roots);
+        return -1;
+    }
+
+    STATE_HEADER *header = (STATE_HEADER *) map;
+    memcpy(header->magic, STATE_MAGIC, sizeof(STATE_MAGIC));
+    header->version = STATE_VERSION;
+    header->records = records;
+    header->size = size;
+    header->root_len = (uint32_t) root_len;
+    memcpy(map + sizeof(STATE_HEADER), roots, root_len + 1);
+    free(roots);
+
+    size_t offset = sizeof(STATE_HEADER) + STATE_ALIGN(root_len + 1);
+
+    /* The directories first, the symbolic links need their target when loaded */
+    for (node = list_wd->first; node != NULL; node = node->next) {
+        WD_DATA *wd_data = (WD_DATA *) node->data;
+        offset += state_put_record(map + offset, STATE_DIRECTORY, get_wd_path(wd_data, path), NULL, wd_data);
+    }
+
+    for (node = list_wd->first; node != NULL; node = node->next) {
+        WD_DATA *wd_data = (WD_DATA *) node->data;
+
+        if (wd_data->links == NULL)
+            continue;
+
+        get_wd_path(wd_data, path);
+        for (link_node = wd_data->links->first; link_node != NULL; link_node = link_node->next) {
+            offset += state_put_record(map + offset, STATE_LINK,
+                                       ((LINK_DATA *) link_node->data)->path, path, wd_data);
+        }
+    }
+
+    int result = msync(map, size, MS_SYNC);
+    munmap(map, size);
+    close(state_fd);
+
+    if (result == 0)
+        result = rename(tmp_file, file);
+    if (result == -1)
+        unlink(tmp_file);
+    free(tmp_file);
+
+    log_message("STATE SAVED:\t%u records into \"%s\"", records, file);
+
+    return result;
+}
@@ -0,0 +1,98 @@
+/* state.h
+ * The watch state saved on disk, for fast restarts
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __STATE_H
+#define __STATE_H
+
+#include <stdint.h>
+
+#define STATE_MAGIC         "CWSTATE"
+#define STATE_VERSION       1
+#define STATE_INTERVAL      60          /* default seconds between the checkpoints */
+
+#define STATE_DIRECTORY     'D'
+#define STATE_LINK          'L'
+
+/*
+ * State file header
+ * The root paths follow the header (each one NUL terminated), then the records.
+ */
+typedef struct state_header_s
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t records;       /* number of records */
+    uint64_t size;          /* size of the whole file */
+    uint32_t root_len;      /* length of the root paths, without the last NUL */
+    uint32_t reserved;
+} STATE_HEADER;
+
+/*
+ * State file record, for a watched directory or a symbolic link
+ * The path and the target (the directory pointed by a symbolic link)
+ * follow the record, NUL terminated and padded to 8 bytes.
+ */
+typedef struct state_record_s
+{
+    uint8_t  type;          /* STATE_DIRECTORY, STATE_LINK */
+    uint8_t  reserved;
+    uint16_t path_len;
+    uint16_t target_len;    /* 0 for a directory */
+    uint16_t root;          /* the index of the root path of a directory (see root_paths) */
+    uint64_t ino;           /* the snapshot of the directory (see snapshot_wd_data) */
+    uint64_t nlink;
+    int64_t  mtime_sec;
+    int64_t  mtime_nsec;
+    int64_t  synced_sec;
+    int64_t  synced_nsec;
+} STATE_RECORD;
+
+/**
+ * Watch the directories saved in a state file, without reading them
+ *
+ * The snapshots of the directories are restored too, so that
+ * state_replay() can report the changes made in the meantime.
+ * @param char * : the path of the state file
+ * @return int   : the number of directories watched, -1 if the state can not be used
+ */
+int state_load(const char *);
+
+/**
+ * Report the changes made while cwatch was not running
+ *
+ * The directories and symbolic links that are gone are deleted,
+ * then the other changes are found by resync().
+ * Called once the events can be handled (see monitor).
+ */
+void state_replay();
+
+/**
+ * Save the watched directories and their snapshots into a state file
+ * The file is written aside, through a memory mapping, then renamed.
+ * @param char * : the path of the state file
+ * @return int   : -1 in case of error, 0 otherwise
+ */
+int state_save(const char *);
+
+#endif /* !__STATE_H */
@@ -0,0 +1,369 @@
+/* trie.c
+ * A path-component prefix tree and manipulation functions
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <limits.h>
+
+#include "slab.h"
+#include "trie.h"
+
+#define TRIE_SLAB_CHUNK 1024     /* the nodes allocated at once */
+
+/*
+ * An interned name, shared by all the nodes with that name
+ * (the same names repeat all over a tree: "src", "include", ".git", ...)
+ */
+typedef struct trie_name_s
+{
+    size_t refs;          /* the nodes using it */
+    char   name[];
+} TRIE_NAME;
+
+/* The interned names by name */
+static HASH *names;
+
+/* The nodes of all the tries */
+static SLAB *nodes;
+
+static char *trie_name_get(const char *name)
+{
+    if (names == NULL) {
+        names = hash_init(hash_string, hash_string_compare);
+        if (names == NULL)
+            return NULL;
+    }
+
+    TRIE_NAME *interned = (TRIE_NAME *) hash_get(names, name);
+
+    if (interned == NULL) {
+        size_t length = strlen(name);
+
+        interned = malloc(sizeof(TRIE_NAME) + length + 1);
+        if (interned == NULL)
+            return NULL;
+
+        interned->refs = 0;
+        memcpy(interned->name, name, length + 1);
+
+        if (hash_put(names, interned->name, (void *) interned) == -1) {
+            free(interned);
+            return NULL;
+        }
+    }
+
+    ++interned->refs;
+
+    return interned->name;
+}
+
+static void trie_name_put(char *name)
+{
+    TRIE_NAME *interned = (TRIE_NAME *) (name - offsetof(TRIE_NAME, name));
+
+    if (--interned->refs == 0) {
+        hash_remove(names, interned->name);
+        free(interned);
+    }
+}
+
+static TRIE_NODE *trie_node_create(const char *name, TRIE_NODE *parent)
+{
+    if (nodes == NULL && (nodes = slab_init(sizeof(TRIE_NODE), TRIE_SLAB_CHUNK)) == NULL)
+        return NULL;
+
+    TRIE_NODE *node = (TRIE_NODE *) slab_alloc(nodes);
+    if (node == NULL)
+        return NULL;
+
+    node->name = trie_name_get(name);
+    if (node->name == NULL) {
+        slab_release(nodes, node);
+        return NULL;
+    }
+
+    node->data = NULL;
+    node->parent = parent;
+    node->children = NULL;
+
+    return node;
+}
+
+/*
+ * Copy the next component of path into name and
+ * returns a pointer past it, NULL when there is no more component.
+ */
+static const char *trie_next_component(const char *path, char *name)
+{
+    while (*path == '/')
+        ++path;
+
+    if (*path == '\0')
+        return NULL;
+
+    size_t length = strcspn(path, "/");
+    if (length > NAME_MAX)
+        length = NAME_MAX;
+
+    memcpy(name, path, length);
+    name[length] = '\0';
+
+    return path + length;
+}
+
+TRIE_NODE *trie_init()
+{
+    return trie_node_create("", NULL);
+}
+
+/* Search the node of an absolute path, creating the nodes missing */
+static TRIE_NODE *trie_descend(TRIE_NODE *root, const char *path)
+{
+    char name[NAME_MAX + 1];
+    TRIE_NODE *node = root;
+
+    while ((path = trie_next_component(path, name)) != NULL) {
+        TRIE_NODE *child = NULL;
+
+        if (node->children == NULL) {
+            node->children = hash_init(hash_string, hash_string_compare);
+            if (node->children == NULL)
+                return NULL;
+        } else {
+            child = (TRIE_NODE *) hash_get(node->children, name);
+        }
+
+        if (child == NULL) {
+            child = trie_node_create(name, node);
+            if (child == NULL)
+                return NULL;
+            hash_put(node->children, child->name, (void *) child);
+        }
+
+        node = child;
+    }
+
+    return node;
+}
+
+TRIE_NODE *trie_insert(TRIE_NODE *root, const char *path, void *data)
+{
+    TRIE_NODE *node = trie_descend(root, path);
+    if (node == NULL)
+        return NULL;
+
+    node->data = data;
+
+    return node;
+}
+
+TRIE_NODE *trie_find(TRIE_NODE *root, const char *path)
+{
+    char name[NAME_MAX + 1];
+    TRIE_NODE *node = root;
+
+    while ((path = trie_next_component(path, name)) != NULL) {
+        if (node->children == NULL)
+            return NULL;
+
+        node = (TRIE_NODE *) hash_get(node->children, name);
+        if (node == NULL)
+            return NULL;
+    }
+
+    return node;
+}
+
+TRIE_NODE *trie_find_prefix(TRIE_NODE *root, const char *path)
+{
+    char name[NAME_MAX + 1];
+    TRIE_NODE *node = root;
+    TRIE_NODE *found = (root->data != NULL) ? root : NULL;
+
+    while ((path = trie_next_component(path, name)) != NULL) {
+        if (node->children == NULL)
+            break;
+
+        node = (TRIE_NODE *) hash_get(node->children, name);
+        if (node == NULL)
+            break;
+
+        if (node->data != NULL)
+            found = node;
+    }
+
+    return found;
+}
+
+void *trie_remove(TRIE_NODE *root, const char *path)
+{
+    TRIE_NODE *node = trie_find(root, path);
+    if (node == NULL)
+        return NULL;
+
+    return trie_remove_node(node);
+}
+
+/* Deallocate a node and its ancestors, as long as they have no data and no children */
+static void trie_prune(TRIE_NODE *node)
+{
+    while (node->parent != NULL
+           && node->data == NULL
+           && (node->children == NULL || node->children->count == 0))
+    {
+        TRIE_NODE *parent = node->parent;
+
+        hash_remove(parent->children, node->name);
+        hash_free(node->children);
+        trie_name_put(node->name);
+        slab_release(nodes, node);
+
+        node = parent;
+    }
+}
+
+void *trie_remove_node(TRIE_NODE *node)
+{
+    void *data = node->data;
+    node->data = NULL;
+
+    trie_prune(node);
+
+    return data;
+}
+
+TRIE_NODE *trie_move(TRIE_NODE *root, TRIE_NODE *node, const char *path)
+{
+    char name[NAME_MAX + 1];
+    char parent_path[PATH_MAX];
+    const char *next, *last = NULL;
+
+    if (node->parent == NULL || trie_find(root, path) != NULL)
+        return NULL;
+
+    /* The last component is the new name, the ones before lead to the new parent */
+    for (next = path; (next = trie_next_component(next, name)) != NULL; )
+        last = next;
+
+    if (last == NULL || (size_t) (last - path) >= sizeof(parent_path))
+        return NULL;
+
+    size_t parent_len = (size_t) (last - path) - strlen(name);
+    memcpy(parent_path, path, parent_len);
+    parent_path[parent_len] = '\0';
+
+    /* A node cannot be moved inside itself */
+    TRIE_NODE *parent = trie_find(root, parent_path), *n;
+    for (n = parent; n != NULL; n = n->parent) {
+        if (n == node)
+            return NULL;
+    }
+
+    if (parent == NULL && (parent = trie_descend(root, parent_path)) == NULL)
+        return NULL;
+
+    if (parent->children == NULL) {
+        parent->children = hash_init(hash_string, hash_string_compare);
+        if (parent->children == NULL) {
+            trie_prune(parent);
+            return NULL;
+        }
+    }
+
+    char *new_name = trie_name_get(name);
+    if (new_name == NULL) {
+        trie_prune(parent);
+        return NULL;
+    }
+
+    /* Attached to the new parent before pruning the old one, they can share ancestors */
+    TRIE_NODE *old_parent = node->parent;
+    hash_remove(old_parent->children, node->name);
+    trie_name_put(node->name);
+
+    node->name = new_name;
+    node->parent = parent;
+    hash_put(parent->children, node->name, (void *) node);
+
+    trie_prune(old_parent);
+
+    return node;
+}
+
+size_t trie_path(const TRIE_NODE *node, char *buffer, size_t size)
+{
+    const TRIE_NODE *n;
+    size_t length = 1;
+
+    /* The length, every component is followed by a slash */
+    for (n = node; n->parent != NULL; n = n->parent)
+        length += strlen(n->name) + 1;
+
+    if (length >= size)
+        return 0;
+
+    /* The components from the last one */
+    buffer[length] = '\0';
+    char *end = buffer + length;
+
+    for (n = node; n->parent != NULL; n = n->parent) {
+        size_t name_len = strlen(n->name);
+
+        *--end = '/';
+        end -= name_len;
+        memcpy(end, n->name, name_len);
+    }
+    buffer[0] = '/';
+
+    return length;
+}
+
+void trie_walk(TRIE_NODE *node, int (*visit)(TRIE_NODE *, void *), void *arg)
+{
+    if (visit(node, arg) != 0 || node->children == NULL)
+        return;
+
+    HASH_ENTRY *entry = NULL;
+    while ((entry = hash_next(node->children, entry)) != NULL) {
+        trie_walk((TRIE_NODE *) entry->data, visit, arg);
+    }
+}
+
+void trie_free(TRIE_NODE *node)
+{
+    if (node == NULL)
+        return;
+
+    if (node->children != NULL) {
+        HASH_ENTRY *entry = NULL;
+        while ((entry = hash_next(node->children, entry)) != NULL) {
+            trie_free((TRIE_NODE *) entry->data);
+        }
+        hash_free(node->children);
+    }
+
+    trie_name_put(node->name);
+    slab_release(nodes, node);
+}
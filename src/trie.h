@@ -0,0 +1,125 @@
+/* trie.h
+ * A path-component prefix tree and manipulation functions
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __TRIE_H
+#define __TRIE_H
+
+#include "hash.h"
+
+/*
+ * Trie node
+ * There is a node for each component of an absolute path,
+ * e.g. "/home/user/" is made of the nodes "", "home" and "user".
+ */
+typedef struct trie_node_s
+{
+    char *name;                    /* the path component, interned (shared by the nodes with the same name) */
+    void *data;                    /* data stored for the path, NULL otherwise */
+    struct trie_node_s *parent;    /* NULL for the root node */
+    HASH *children;                /* children nodes by name, NULL when there is none */
+} TRIE_NODE;
+
+/**
+ * Initialize trie data structure
+ * @return TRIE_NODE * : a pointer to the root node
+ */
+TRIE_NODE *trie_init();
+
+/**
+ * Store an element for an absolute path
+ * @param TRIE_NODE *  : the root node
+ * @param char *       : the path
+ * @param void *       : the data
+ * @return TRIE_NODE * : the node of the path, NULL in case of error
+ */
+TRIE_NODE *trie_insert(TRIE_NODE *, const char *, void *);
+
+/**
+ * Search the node of an absolute path
+ * @param TRIE_NODE *  : the root node
+ * @param char *       : the path to find
+ * @return TRIE_NODE * : the node of the path, NULL otherwise
+ */
+TRIE_NODE *trie_find(TRIE_NODE *, const char *);
+
+/**
+ * Search the deepest node with data along an absolute path
+ * @param TRIE_NODE *  : the root node
+ * @param char *       : the path
+ * @return TRIE_NODE * : the node of the path or of its nearest ancestor with data, NULL otherwise
+ */
+TRIE_NODE *trie_find_prefix(TRIE_NODE *, const char *);
+
+/**
+ * Remove the element stored for an absolute path
+ * Nodes left without data and children are deallocated.
+ * @param TRIE_NODE * : the root node
+ * @param char *      : the path to remove
+ * @return void *     : the data removed, NULL otherwise
+ */
+void *trie_remove(TRIE_NODE *, const char *);
+
+/**
+ * Remove the element stored in a node (see trie_remove)
+ * @param TRIE_NODE * : the node
+ * @return void *     : the data removed, NULL otherwise
+ */
+void *trie_remove_node(TRIE_NODE *);
+
+/**
+ * Move a node, with all its descendants, to another absolute path
+ * Only the node is renamed: the data of the descendants is kept as is.
+ * @param TRIE_NODE *  : the root node
+ * @param TRIE_NODE *  : the node to move
+ * @param char *       : the new path, that must not be in the trie yet
+ * @return TRIE_NODE * : the node moved, NULL if the path is in use or in case of error
+ */
+TRIE_NODE *trie_move(TRIE_NODE *, TRIE_NODE *, const char *);
+
+/**
+ * Build the absolute path of a node, with a trailing slash ("/home/user/")
+ * @param TRIE_NODE * : the node
+ * @param char *      : the buffer
+ * @param size_t      : the size of the buffer
+ * @return size_t     : the length of the path, 0 if it does not fit in the buffer
+ */
+size_t trie_path(const TRIE_NODE *, char *, size_t);
+
+/**
+ * Visit a node and all its descendants (depth-first)
+ * The visit function returns 0 to continue through the children
+ * of the node, any other value to skip them.
+ * The trie must not be modified during the visit.
+ * @param TRIE_NODE * : the node from which to start
+ * @param function    : the visit function
+ * @param void *      : argument passed to the visit function
+ */
+void trie_walk(TRIE_NODE *, int (*)(TRIE_NODE *, void *), void *);
+
+/**
+ * Deallocate trie data structure
+ */
+void trie_free(TRIE_NODE *);
+
+#endif /* !__TRIE_H */
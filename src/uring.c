@@ -0,0 +1,350 @@
+/* uring.c
+ * Batched probes of the directory entries with io_uring
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "cwatch.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* The rings shared with the kernel */
+static int ring_fd = -1;
+static unsigned int *sq_head;
+static unsigned int *sq_tail;
+static unsigned int *sq_mask;
+static unsigned int *sq_array;
+static unsigned int *cq_head;
+static unsigned int *cq_tail;
+static unsigned int *cq_mask;
+static struct io_uring_sqe *sqes;
+static struct io_uring_cqe *cqes;
+static unsigned int sq_entries;
+
+/* An operation of a batch, the result is stored at its completion */
+typedef struct uring_op_s
+{
+    PROBE       *probe;
+    int         result;
+    struct statx stx;
+} URING_OP;
+
+static int uring_setup(unsigned int entries, struct io_uring_params *params)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(unsigned int to_submit, unsigned int min_complete)
+{
+    return (int) syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                         IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+/* Check that the operations used are supported by the kernel */
+static int uring_supports(const uint8_t *ops, unsigned int qty)
+{
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = (struct io_uring_probe *) calloc(1, len);
+    unsigned int i;
+    int supported = 1;
+
+    if (probe == NULL)
+        return 0;
+
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, 256) == -1) {
+        free(probe);
+        return 0;
+    }
+
+    for (i = 0; i < qty; ++i) {
+        if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+            supported = 0;
+    }
+
+    free(probe);
+
+    return supported;
+}
+
+int uring_init()
+{
+    struct io_uring_params params;
+    static const uint8_t ops[] = {IORING_OP_STATX, IORING_OP_OPENAT};
+
+    if (ring_fd != -1)
+        return 0;
+
+    memset(&params, 0, sizeof(params));
+    ring_fd = uring_setup(URING_ENTRIES, &params);
+    if (ring_fd == -1)
+        return -1;
+
+    size_t sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    size_t cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    /* The two rings can be mapped at once (Linux >= 5.4) */
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        sq_len = cq_len = MAX(sq_len, cq_len);
+
+    char *sq_ring = (char *) mmap(NULL, sq_len, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    char *cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP)
+        ? sq_ring
+        : (char *) mmap(NULL, cq_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    sqes = (struct io_uring_sqe *) mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+                                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                        ring_fd, IORING_OFF_SQES);
+
+    if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+        close(ring_fd);
+        ring_fd = -1;
+        return -1;
+    }
+
+    sq_head = (unsigned int *) (sq_ring + params.sq_off.head);
+    sq_tail = (unsigned int *) (sq_ring + params.sq_off.tail);
+    sq_mask = (unsigned int *) (sq_ring + params.sq_off.ring_mask);
+    sq_array = (unsigned int *) (sq_ring + params.sq_off.array);
+    cq_head = (unsigned int *) (cq_ring + params.cq_off.head);
+    cq_tail = (unsigned int *) (cq_ring + params.cq_off.tail);
+    cq_mask = (unsigned int *) (cq_ring + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *) (cq_ring + params.cq_off.cqes);
+    sq_entries = params.sq_entries;
+
+    if (uring_supports(ops, sizeof(ops)) == 0) {
+        close(ring_fd);
+        ring_fd = -1;
+        errno = ENOSYS;
+        return -1;
+    }
+
+    /* The real paths are read from /proc (see fd_real_path) */
+    int root_fd = open("/", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    char *root = (root_fd != -1) ? fd_real_path(root_fd) : NULL;
+    if (root_fd != -1)
+        close(root_fd);
+    if (root == NULL) {
+        close(ring_fd);
+        ring_fd = -1;
+        errno = ENOENT;
+        return -1;
+    }
+    free(root);
+
+    return 0;
+}
+
+int uring_enabled()
+{
+    return (ring_fd != -1) ? 1 : 0;
+}
+
+/* Submit the operations of a batch, and wait for all of them */
+static int uring_run(URING_OP *batch, unsigned int qty)
+{
+    unsigned int completed = 0;
+    unsigned int submitted = 0;
+
+    while (completed < qty) {
+        int result = uring_enter(qty - submitted, qty - completed);
+        if (result == -1) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                continue;
+
+            /* The operations queued would be submitted by the next batch */
+            close(ring_fd);
+            ring_fd = -1;
+            return -1;
+        }
+        submitted += (unsigned int) result;
+
+        unsigned int head = *cq_head;
+        while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+
+            batch[cqe->user_data].result = cqe->res;
+            ++head;
+            ++completed;
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    return 0;
+}
+
+/* Queue an operation into the submission ring */
+static struct io_uring_sqe *uring_queue(unsigned int index)
+{
+    unsigned int tail = *sq_tail;
+    unsigned int slot = tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[slot];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = index;
+    sq_array[slot] = slot;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    return sqe;
+}
+
+/* The type of the entries without d_type (statx), then the targets of the symbolic links (openat) */
+static int uring_probe(int dir_fd, PROBE *probes, unsigned int qty, bool_t open_links)
+{
+    URING_OP batch[URING_ENTRIES];
+    unsigned int i = 0;
+
+    while (i < qty) {
+        unsigned int queued = 0;
+
+        for (; i < qty && queued < sq_entries && queued < URING_ENTRIES; ++i) {
+            PROBE *probe = &probes[i];
+            struct io_uring_sqe *sqe;
+
+            if (open_links == FALSE && probe->type == DT_UNKNOWN) {
+                sqe = uring_queue(queued);
+                sqe->opcode = IORING_OP_STATX;
+                sqe->fd = dir_fd;
+                sqe->addr = (uint64_t) (uintptr_t) probe->name;
+                sqe->len = STATX_TYPE;
+                sqe->off = (uint64_t) (uintptr_t) &batch[queued].stx;
+                sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+            } else if (open_links == TRUE && probe->type == DT_LNK) {
+                sqe = uring_queue(queued);
+                sqe->opcode = IORING_OP_OPENAT;
+                sqe->fd = dir_fd;
+                sqe->addr = (uint64_t) (uintptr_t) probe->name;
+                sqe->open_flags = O_PATH | O_DIRECTORY | O_CLOEXEC;
+            } else {
+                continue;
+            }
+
+            batch[queued].probe = probe;
+            ++queued;
+        }
+
+        if (queued == 0 || uring_run(batch, queued) == -1)
+            return (queued == 0) ? 0 : -1;
+
+        unsigned int j;
+        for (j = 0; j < queued; ++j) {
+            PROBE *probe = batch[j].probe;
+
+            if (open_links == FALSE && batch[j].result == 0) {
+                mode_t mode = batch[j].stx.stx_mode;
+                probe->type = S_ISDIR(mode) ? DT_DIR : S_ISLNK(mode) ? DT_LNK : S_ISREG(mode) ? DT_REG : DT_UNKNOWN;
+            } else if (open_links == TRUE && batch[j].result >= 0) {
+                probe->target = fd_real_path(batch[j].result);
+                close(batch[j].result);
+            }
+        }
+    }
+
+    return 0;
+}
+
+PROBE *uring_read_dir(DIR *dir_stream, unsigned int *qty)
+{
+    unsigned int len = 0, size = 64;
+    PROBE *probes = (PROBE *) malloc(size * sizeof(PROBE));
+    struct dirent *dir;
+
+    if (probes == NULL)
+        return NULL;
+
+    while ((dir = readdir(dir_stream))) {
+        if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0)
+            continue;
+
+        /* Only the directories and the symbolic links are probed */
+        if (dir->d_type != DT_DIR && dir->d_type != DT_LNK && dir->d_type != DT_UNKNOWN)
+            continue;
+
+        if (len == size) {
+            PROBE *larger = (PROBE *) realloc(probes, 2 * size * sizeof(PROBE));
+            if (larger == NULL) {
+                uring_free(probes, len);
+                rewinddir(dir_stream);
+                return NULL;
+            }
+            probes = larger;
+            size *= 2;
+        }
+
+        probes[len].name = strdup(dir->d_name);
+        probes[len].type = dir->d_type;
+        probes[len].target = NULL;
+        ++len;
+    }
+
+    int dir_fd = dirfd(dir_stream);
+    if (uring_probe(dir_fd, probes, len, FALSE) == -1 || uring_probe(dir_fd, probes, len, TRUE) == -1) {
+        uring_free(probes, len);
+        rewinddir(dir_stream);
+        return NULL;
+    }
+
+    *qty = len;
+
+    return probes;
+}
+
+void uring_free(PROBE *probes, unsigned int qty)
+{
+    unsigned int i;
+
+    for (i = 0; i < qty; ++i) {
+        free(probes[i].name);
+        free(probes[i].target);
+    }
+
+    free(probes);
+}
+
+char *fd_real_path(int dir_fd)
+{
+    char link[32];
+    char *resolved = malloc(MAXPATHLEN + 2);
+
+    if (resolved == NULL)
+        return NULL;
+
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", dir_fd);
+    ssize_t len = readlink(link, resolved, MAXPATHLEN);
+
+    /* The directory could be deleted since it was opened */
+    if (len <= 0 || resolved[0] != '/'
+        || (len > 10 && strncmp(resolved + len - 10, " (deleted)", 10) == 0))
+    {
+        free(resolved);
+        return NULL;
+    }
+
+    /* The root directory is the only one ending with a slash */
+    if (resolved[len - 1] != '/')
+        resolved[len++] = '/';
+    resolved[len] = '\0';
+
+    return resolved;
+}
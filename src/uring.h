@@ -0,0 +1,82 @@
+/* uring.h
+ * Batched probes of the directory entries with io_uring
+ *
+ * Copyright (C) 2012, Giuseppe Leone <joebew42@gmail.com>,
+ *                     Vincenzo Di Cicco <enzodicicco@gmail.com>
+ *
+ * This file is part of cwatch
+ *
+ * cwatch is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * cwatch is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __URING_H
+#define __URING_H
+
+#include <dirent.h>
+
+#define URING_ENTRIES 64    /* the operations in flight at once */
+
+/*
+ * An entry of a directory, probed by uring_read_dir(): the type of the
+ * entries without d_type is found by statx, and the symbolic links are
+ * opened (O_PATH) to find out if they point to a directory
+ */
+typedef struct probe_s
+{
+    char          *name;     /* the name of the entry */
+    unsigned char type;      /* its d_type, found by statx when the filesystem does not report it */
+    char          *target;   /* the real path of the directory pointed by a symbolic link, NULL otherwise */
+} PROBE;
+
+/**
+ * Set up the io_uring instance, it needs IORING_OP_STATX and
+ * IORING_OP_OPENAT (Linux >= 5.6)
+ * @return int : -1 if io_uring is not available (errno is set), 0 otherwise
+ */
+int uring_init();
+
+/**
+ * Returns 1 if the io_uring instance is set up (see uring_init)
+ * @return int
+ */
+int uring_enabled();
+
+/**
+ * Read all the entries of a directory, and probe them in batches of
+ * URING_ENTRIES operations, relative to the directory file descriptor
+ * @param DIR *          : the directory stream
+ * @param unsigned int * : filled with the number of entries
+ * @return PROBE *       : the entries (see uring_free), NULL in case of error
+ *                         (the stream is rewound, it can be read again)
+ */
+PROBE *uring_read_dir(DIR *, unsigned int *);
+
+/**
+ * Deallocate the entries returned by uring_read_dir
+ * @param PROBE *      : the entries
+ * @param unsigned int : the number of entries
+ */
+void uring_free(PROBE *, unsigned int);
+
+/**
+ * The real path of a directory from a file descriptor opened on it,
+ * without walking the path again (see resolve_real_path)
+ * @param int     : the file descriptor
+ * @return char * : the real path with a trailing slash, NULL in case of error or if it is deleted
+ */
+char *fd_real_path(int);
+
+#endif /* !__URING_H */